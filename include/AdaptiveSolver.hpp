@@ -0,0 +1,307 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_ADAPTIVESOLVER_HPP
+#define REACTIONDIFFUSION2_ADAPTIVESOLVER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Kernels.hpp"
+#include "Precision.hpp"
+#include "Profiler.hpp"
+#include "ReactionState.hpp"
+#include "Reactions.hpp"
+#include "Seeders.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * Integrates a reaction (see Reactions.hpp) with the classic stencil over the whole grid using the embedded
+ * Bogacki-Shampine 3(2) Runge-Kutta pair, growing and shrinking the step so the estimated error of each one stays
+ * within a tolerance. While the pattern evolves slowly the step grows until the stability of the explicit stages
+ * limits it, and it shrinks again wherever the pattern moves quickly, so a run takes fewer steps than it would at a
+ * fixed step small enough for its fastest stretch.
+ *
+ * The outer ring is held fixed as ReactionDiffusion holds it. Values aren't clamped as react() clamps them.
+ * @tparam Reaction the reaction to integrate
+ */
+template <typename Reaction>
+class AdaptiveSolver {
+public:
+    using Scalar = typename Reaction::Scalar;
+    using Precision = ScalarPrecision<Scalar>;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+
+    /**
+     * @param width cells across the grid
+     * @param height cells down the grid
+     * @param tolerance the largest error any concentration may pick up in a step
+     */
+    AdaptiveSolver(unsigned int width, unsigned int height, const ClassicStencil<Scalar> &stencil, const Reaction &reaction,
+                   Scalar tolerance, std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder,
+                   unsigned int threadCount = std::thread::hardware_concurrency())
+            : width(std::max(width, 3u)), height(std::max(height, 3u)),
+              cellCount(static_cast<std::size_t>(this->width) * this->height), stencil(stencil), reaction(reaction),
+              tolerance(tolerance), rowError(this->height), state(GridLayout{this->width, this->height}, reaction.background())
+    {
+        pool = std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount);
+        for(auto *planes : {&current, &next, &stages[0], &stages[1]}) {
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                (*planes)[chem].resize(cellCount);
+            }
+        }
+        for(auto &planes : rates) {
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                // The outer ring is never written, its rates stay 0
+                planes[chem].assign(cellCount, Scalar(0));
+            }
+        }
+        seed(std::move(seeder));
+    }
+
+    /// Resets the grid to the reaction's background and seeds it
+    void seed(std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder) {
+        state.fill(reaction.background());
+        seeder->seed(state);
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < height; ++y) {
+                state.copyRow(chem, y, current[chem].data() + static_cast<std::size_t>(y) * width);
+            }
+            // Every buffer a stage is written to needs the fixed outer ring too
+            next[chem] = current[chem];
+            stages[0][chem] = current[chem];
+            stages[1][chem] = current[chem];
+        }
+
+        // Only the rates, the error of a step of 0 is 0
+        pass<0, true, true>(current, nullptr, 0);
+        stepSize = reaction.timeStep();
+        time = 0;
+        stepCount = 0;
+        rejectedCount = 0;
+    }
+
+    /**
+     * Advances the simulation by duration, in the same units as Reaction::timeStep, in as few steps as the tolerance
+     * allows. The last step is shortened to land on duration exactly.
+     * @return false if the step had to shrink to nothing to meet the tolerance, which means the simulation blew up
+     */
+    bool advance(Scalar duration) {
+        const Scalar end = time + duration;
+        bool ok = true;
+        while(time < end) {
+            const Scalar remaining = end - time;
+            const bool last = stepSize >= remaining;
+            const Scalar step = last ? remaining : stepSize;
+
+            const Scalar error = attempt(step) / tolerance;
+            // Grow or shrink as the error of a third order step scales, within bounds so one odd step can't swing it
+            const Scalar factor = std::isfinite(error) ? std::clamp(Scalar(0.9) * std::cbrt(Scalar(1) / std::max(error, Scalar(1e-6))), Scalar(0.2), Scalar(5))
+                                                       : Scalar(0.2);
+            if(error <= 1) {
+                std::swap(current, next);
+                // The rates at the end of this step are the first stage of the next one
+                std::swap(rates[0], rates[3]);
+                time = last ? end : time + step;
+                ++stepCount;
+                // A step cut short to land on the end says nothing about how long the next one can be
+                if(!last || factor < 1) {
+                    stepSize = step * factor;
+                }
+            } else {
+                ++rejectedCount;
+                stepSize = step * std::min(factor, Scalar(0.9));
+                if(!(stepSize > reaction.timeStep() * MinimumStep)) {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < height; ++y) {
+                state.setRow(chem, y, current[chem].data() + static_cast<std::size_t>(y) * width);
+            }
+        }
+        return ok;
+    }
+
+    /// The grid as of the last advance
+    const ReactionState<ChemicalCount, Precision> &getState() const {
+        return state;
+    }
+
+    /// The RGBA colouring of the grid as of the last advance, see ReactionState::getColoring
+    std::uint8_t *getColoring() {
+        return state.getColoring();
+    }
+
+    const Reaction &getReaction() const {
+        return reaction;
+    }
+
+    Scalar getTolerance() const {
+        return tolerance;
+    }
+
+    /// The time simulated since the grid was last seeded
+    Scalar getTime() const {
+        return time;
+    }
+
+    /// The length the next step will try
+    Scalar getStepSize() const {
+        return stepSize;
+    }
+
+    /// The number of steps accepted since the grid was last seeded
+    unsigned long long getStepCount() const {
+        return stepCount;
+    }
+
+    /// The number of steps retried with a shorter step since the grid was last seeded
+    unsigned long long getRejectedCount() const {
+        return rejectedCount;
+    }
+
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+private:
+    using Planes = std::array<std::vector<Scalar>, ChemicalCount>;
+
+    /// The shortest step, relative to the reaction's own, before advance gives up
+    static constexpr Scalar MinimumStep = Scalar(1e-6);
+
+    /**
+     * Each stage's combination of the rates so far: stage 0 to 2 give the input of the next stage as the state plus
+     * the step times the combination, stage 3 gives the difference between the third and second order solutions.
+     * Stage 2's input to stage 3 is the third order solution itself.
+     */
+    static constexpr double Weights[4][4] = {
+            {1.0 / 2, 0, 0, 0},
+            {0, 3.0 / 4, 0, 0},
+            {2.0 / 9, 1.0 / 3, 4.0 / 9, 0},
+            {-5.0 / 72, 1.0 / 12, 1.0 / 9, -1.0 / 8}};
+
+    /**
+     * Tries a step of the given length from current into next, leaving the rates at next in rates[3]
+     * @return the largest error estimate of any concentration
+     */
+    Scalar attempt(Scalar step) {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("adaptive attempt", static_cast<double>(cellCount));
+        pass<0, false, false>(current, &stages[0], step);
+        pass<1, true, false>(stages[0], &stages[1], step);
+        pass<2, true, false>(stages[1], &next, step);
+        return pass<3, true, true>(next, nullptr, step);
+    }
+
+    /**
+     * One pass over the interior for a stage. With Rates, the rates of in go into rates[Stage] first. Then either out
+     * gets current plus step times the stage's combination of the rates (see Weights), or with MeasureError the
+     * combination is reduced to its largest magnitude as the pass goes rather than written.
+     * @return the largest error estimate with MeasureError, otherwise 0
+     */
+    template <unsigned int Stage, bool Rates, bool MeasureError>
+    Scalar pass(const Planes &in, Planes *out, Scalar step) {
+        using Batch = simd::NativeBatch<Scalar>;
+        using Single = simd::ScalarBatch<Scalar>;
+        const std::array<Scalar, ChemicalCount> diffusion = reaction.diffusion();
+        const std::array<Scalar, ChemicalCount> linear = reaction.linear();
+
+        pool->parallelFor(height - 2, [&](unsigned int row) {
+            const unsigned int y = row + 1;
+            const std::size_t offset = static_cast<std::size_t>(y) * width;
+
+            auto cells = [&](auto batch, unsigned int x) {
+                using CellBatch = decltype(batch);
+                if constexpr(Rates) {
+                    std::array<CellBatch, ChemicalCount> conc, nonlinear;
+                    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                        conc[chem] = CellBatch::load(in[chem].data() + offset + x);
+                    }
+                    reaction.nonlinear(conc, nonlinear);
+                    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                        const Scalar *at = in[chem].data() + offset;
+                        const CellBatch conv = stencil.template apply<CellBatch>(at - width, at, at + width, static_cast<int>(x));
+                        const CellBatch rate = CellBatch::broadcast(diffusion[chem]) * conv
+                                               + CellBatch::broadcast(linear[chem]) * conc[chem] + nonlinear[chem];
+                        rate.store(rates[Stage][chem].data() + offset + x);
+                    }
+                }
+
+                CellBatch largest = CellBatch::broadcast(Scalar(0));
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    CellBatch sum = CellBatch::broadcast(Scalar(0));
+                    for(unsigned int k = 0; k <= Stage; ++k) {
+                        if(Weights[Stage][k] != 0) {
+                            sum = sum + CellBatch::broadcast(static_cast<Scalar>(step * Weights[Stage][k]))
+                                        * CellBatch::load(rates[k][chem].data() + offset + x);
+                        }
+                    }
+                    if constexpr(MeasureError) {
+                        largest = max(largest, max(sum, CellBatch::broadcast(Scalar(0)) - sum));
+                    } else {
+                        (CellBatch::load(current[chem].data() + offset + x) + sum).store((*out)[chem].data() + offset + x);
+                    }
+                }
+                return largest;
+            };
+
+            // The largest error in each lane, and the sum of them as a max can drop a NaN where a sum can't
+            Batch largest = Batch::broadcast(Scalar(0)), total = largest;
+            unsigned int x = 1;
+            for(; x + Batch::Lanes <= width - 1; x += Batch::Lanes) {
+                const Batch error = cells(Batch{}, x);
+                largest = max(largest, error);
+                total = total + error;
+            }
+            Single remainder = Single::broadcast(Scalar(0)), remainderTotal = remainder;
+            for(; x < width - 1; ++x) {
+                const Single error = cells(Single{}, x);
+                remainder = max(remainder, error);
+                remainderTotal = remainderTotal + error;
+            }
+
+            if constexpr(MeasureError) {
+                alignas(simd::Alignment) Scalar lanes[Batch::Lanes];
+                total.store(lanes);
+                Scalar sum = remainderTotal.v;
+                for(Scalar lane : lanes) {
+                    sum += lane;
+                }
+                rowError[y] = std::isfinite(sum) ? std::max(horizontalMax<Batch, Scalar>(largest), remainder.v)
+                                                 : std::numeric_limits<Scalar>::infinity();
+            }
+        });
+
+        return MeasureError ? *std::max_element(rowError.begin() + 1, rowError.end() - 1) : Scalar(0);
+    }
+
+    unsigned int width, height;
+    std::size_t cellCount;
+    ClassicStencil<Scalar> stencil;
+    Reaction reaction;
+    Scalar tolerance;
+    /// The state at the start of the step, and at its end once accepted
+    Planes current, next;
+    /// The inputs of the second and third stages
+    std::array<Planes, 2> stages;
+    /// The rates of each stage
+    std::array<Planes, 4> rates;
+    /// The largest error estimate in each row of the last step
+    std::vector<Scalar> rowError;
+    Scalar stepSize = 0;
+    Scalar time = 0;
+    unsigned long long stepCount = 0;
+    unsigned long long rejectedCount = 0;
+    ReactionState<ChemicalCount, Precision> state;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif //REACTIONDIFFUSION2_ADAPTIVESOLVER_HPP
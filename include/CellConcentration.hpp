@@ -2,52 +2,41 @@
 #ifndef REACTIONDIFFUSION2_CELLCONCENTRATION_HPP
 #define REACTIONDIFFUSION2_CELLCONCENTRATION_HPP
 
-#include <SFML/Graphics/Color.hpp>
-
 #include <array>
+#include <cstdint>
 #include <iterator>
 #include <algorithm>
 
 #include "Util.hpp"
+#include "Palette.hpp"
 #include "Random.hpp"
 
 /**
  * Defines the concentration of each chemical at a particular cell in the grid.
- * For more efficiency this could probably follow a SOA pattern instead of the AOS pattern but this is far
- * simpler to work with and does increase flexibility.
+ * The grid itself is stored as a structure of arrays (see ReactionState), this is the value type used to read and
+ * write a single cell at a time, which is far simpler to work with for seeders and the generic models.
  * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Scalar the type each concentration is held in
  */
-template <unsigned int ChemicalCount>
+template <unsigned int ChemicalCount, typename Scalar = double>
 struct CellConcentration {
-    std::array<double, ChemicalCount> conc = {};
+    std::array<Scalar, ChemicalCount> conc = {};
     CellConcentration()= default;
-    explicit CellConcentration(const std::array<double, ChemicalCount> &conc) : conc(conc) {}
-
-    /// Make and return a new random CellConcentration
-    static CellConcentration makeRandom() {
-        static RandomFloatingRange rand(0, 1);
-
-        std::array<double, ChemicalCount> conc;
+    explicit CellConcentration(const std::array<Scalar, ChemicalCount> &conc) : conc(conc) {}
 
-        for(auto &val : conc) {
-            val = rand();
+    /// Make a random CellConcentration that only depends on the generator's seed and the index, see CounterRandom
+    static CellConcentration makeRandom(const CounterRandom &random, std::uint64_t index) {
+        std::array<Scalar, ChemicalCount> conc;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            conc[chem] = static_cast<Scalar>(random.uniform<double>(chem / 4, index, chem % 4));
         }
-
         return CellConcentration(conc);
     }
 
-    /// Converts the cell concentration to an SFML colour based on the concentration of each chemical
-    sf::Color toColor() const {
-        unsigned long long total = 0;
-        for(unsigned int i = 0; i < ChemicalCount; ++i) {
-            unsigned int hue = ((i + 4) * 41);
-            sf::Color col = colorFromHSL(hue, 0.70, 0.5);
-
-            double multiplier = i; // incorporating i can give cool effects
-            col.a = static_cast<sf::Uint8>(conc[i] * col.a * multiplier);
-            total += col.toInteger();
-        }
-        return sf::Color(static_cast<sf::Uint32>(total/ChemicalCount));
+    /// Converts the cell concentration to a colour based on the concentration of each chemical
+    Rgba toColor() const {
+        // Each chemical's colour with an alpha for its concentration, averaged (see Palette)
+        return Palette<ChemicalCount>::get().color(conc);
 
         auto index = std::distance(conc.begin(), std::max_element(conc.begin(), conc.end()));
 
@@ -58,18 +47,18 @@ struct CellConcentration {
         return colorFromHSL(hue, 0.70, 0.5);
     }
 
-    double operator[](unsigned int index) const {
+    Scalar operator[](unsigned int index) const {
         return conc[index];
     }
 
-    double &operator[](unsigned int index) {
+    Scalar &operator[](unsigned int index) {
         return conc[index];
     }
 
     // ====== Iteration ======
 
-    using iterator = typename std::array<double, ChemicalCount>::iterator;
-    using const_iterator = typename std::array<double, ChemicalCount>::const_iterator;
+    using iterator = typename std::array<Scalar, ChemicalCount>::iterator;
+    using const_iterator = typename std::array<Scalar, ChemicalCount>::const_iterator;
 
     iterator begin() { return conc.begin(); }
 
@@ -0,0 +1,513 @@
+/**
+ * Saving and restoring a simulation. A checkpoint is a fixed size header followed by each chemical plane as it is
+ * stored in the grid, row after row without halos, every plane starting on a page boundary. Restoring maps the file
+ * and copies the planes straight into the tiles, and saving snapshots the planes in one copy so the file can be
+ * written on another thread while stepping carries on.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_CHECKPOINT_HPP
+#define REACTIONDIFFUSION2_CHECKPOINT_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define REACTIONDIFFUSION2_CHECKPOINT_MMAP 1
+#endif
+
+#include "ReactionDiffusion.hpp"
+
+/// Identifies the type the values of a checkpoint are computed or stored in
+enum class CheckpointType : std::uint32_t {
+    Double = 1,
+    Float = 2,
+    Half = 3,
+    Fixed16 = 4
+};
+
+template <typename T>
+struct CheckpointTypeOf;
+
+template <> struct CheckpointTypeOf<double> { static constexpr CheckpointType value = CheckpointType::Double; };
+template <> struct CheckpointTypeOf<float> { static constexpr CheckpointType value = CheckpointType::Float; };
+template <> struct CheckpointTypeOf<Half> { static constexpr CheckpointType value = CheckpointType::Half; };
+template <> struct CheckpointTypeOf<Fixed16> { static constexpr CheckpointType value = CheckpointType::Fixed16; };
+
+/// The name of a checkpoint type as the headless runner's --precision takes it, or nullptr if it isn't one
+inline const char *checkpointPrecisionName(CheckpointType scalar, CheckpointType storage) {
+    if(scalar == CheckpointType::Double && storage == CheckpointType::Double) return "double";
+    if(scalar == CheckpointType::Float && storage == CheckpointType::Float) return "float";
+    if(scalar == CheckpointType::Float && storage == CheckpointType::Half) return "half";
+    if(scalar == CheckpointType::Float && storage == CheckpointType::Fixed16) return "fixed16";
+    return nullptr;
+}
+
+/**
+ * The start of every checkpoint file. Integers are in the byte order of the machine that wrote it, which byteOrder
+ * records so a file from a machine of the other order is rejected rather than misread.
+ */
+struct CheckpointHeader {
+    static constexpr char Magic[8] = {'R', 'D', 'C', 'K', 'P', 'T', '\r', '\n'};
+    /// Version 2 added the model's name, version 1 checkpoints are read with it empty
+    static constexpr std::uint32_t CurrentVersion = 2;
+    static constexpr std::uint32_t ByteOrderMark = 0x01020304;
+    static constexpr unsigned int MaxParameters = 16;
+    static constexpr unsigned int MaxModelName = 32;
+    /// Planes start on multiples of this, a multiple of the page size of every common platform
+    static constexpr std::uint64_t PageSize = 16384;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t chemicalCount;
+    /// CheckpointType of the values the simulation was computed in and of the values in the planes
+    std::uint32_t scalarType;
+    std::uint32_t storageType;
+    std::uint32_t storageSize;
+    std::uint64_t stepCount;
+    /// Offset of the first plane from the start of the file, and from the start of each plane to the next
+    std::uint64_t planeOffset;
+    std::uint64_t planeStride;
+    /// The reaction model's parameters, see AbstractReactionModel::getParameters
+    std::uint32_t parameterCount;
+    /// The BoundaryCondition the grid was stepped with, 0 (the fixed ring) in checkpoints written before it was recorded
+    std::uint32_t boundary;
+    double parameters[MaxParameters];
+    /// The reaction model's name, see AbstractReactionModel::getName, null terminated and empty if it has none
+    char model[MaxModelName];
+
+    /// The header of a checkpoint of the given grid
+    template <unsigned int ChemicalCount, typename Precision>
+    static CheckpointHeader describe(const ReactionDiffusion<ChemicalCount, Precision> &model) {
+        using Storage = typename Precision::Storage;
+        const auto &state = model.getState();
+
+        CheckpointHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = CurrentVersion;
+        header.byteOrder = ByteOrderMark;
+        header.width = state.getWidth();
+        header.height = state.getHeight();
+        header.boundary = static_cast<std::uint32_t>(state.getLayout().boundary);
+        header.chemicalCount = ChemicalCount;
+        header.scalarType = static_cast<std::uint32_t>(CheckpointTypeOf<typename Precision::Scalar>::value);
+        header.storageType = static_cast<std::uint32_t>(CheckpointTypeOf<Storage>::value);
+        header.storageSize = sizeof(Storage);
+        header.stepCount = model.getStepCount();
+        header.planeOffset = roundToPage(sizeof(CheckpointHeader));
+        header.planeStride = roundToPage(static_cast<std::uint64_t>(header.width) * header.height * sizeof(Storage));
+
+        const std::vector<double> parameters = model.getReactionModel().getParameters();
+        header.parameterCount = static_cast<std::uint32_t>(std::min<std::size_t>(parameters.size(), MaxParameters));
+        std::copy(parameters.begin(), parameters.begin() + header.parameterCount, header.parameters);
+
+        const std::string name = model.getReactionModel().getName();
+        std::memcpy(header.model, name.data(), std::min<std::size_t>(name.size(), MaxModelName - 1));
+        return header;
+    }
+
+    /// The name of the model that wrote the checkpoint, empty if it wasn't recorded
+    std::string modelName() const {
+        return std::string(model, std::find(model, model + MaxModelName, '\0'));
+    }
+
+    /// The size of the whole file this header describes, which Checkpoint checks can't overflow before trusting it
+    std::uint64_t fileSize() const {
+        return planeOffset + planeStride * chemicalCount;
+    }
+
+    static std::uint64_t roundToPage(std::uint64_t bytes) {
+        return (bytes + PageSize - 1) / PageSize * PageSize;
+    }
+};
+
+static_assert(std::is_trivially_copyable<CheckpointHeader>::value, "The header is written and mapped as raw bytes");
+
+/**
+ * A copy of a simulation laid out exactly as its checkpoint file, taken in one pass over the grid so the file can be
+ * written at leisure while the simulation moves on.
+ */
+class CheckpointSnapshot {
+public:
+    /// Copies the state of model, reusing the buffer of the last capture if it is big enough
+    template <unsigned int ChemicalCount, typename Precision>
+    void capture(const ReactionDiffusion<ChemicalCount, Precision> &model) {
+        using Storage = typename Precision::Storage;
+        const CheckpointHeader header = CheckpointHeader::describe(model);
+        const auto &state = model.getState();
+
+        // Everything but the padding after each plane is overwritten, which stays zero while the size is the same
+        if(bytes.size() != header.fileSize()) {
+            bytes.assign(header.fileSize(), 0);
+        }
+        std::memcpy(bytes.data(), &header, sizeof(header));
+
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            auto plane = reinterpret_cast<Storage *>(bytes.data() + header.planeOffset + header.planeStride * chem);
+            for(unsigned int y = 0; y < header.height; ++y) {
+                state.copyStoredRow(chem, y, plane + static_cast<std::size_t>(y) * header.width);
+            }
+        }
+        stepCount = header.stepCount;
+    }
+
+    /**
+     * Writes the snapshot to path. The file is written under a temporary name and renamed over path once complete,
+     * so a run killed part way through a write still leaves the previous checkpoint intact.
+     * @return an empty string on success, otherwise why it failed
+     */
+    std::string write(const std::string &path) const {
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if(!file) {
+                return "Could not open " + temporary + " for writing";
+            }
+            file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if(!file.flush()) {
+                return "Could not write " + temporary;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if(error) {
+            return "Could not rename " + temporary + " to " + path + ": " + error.message();
+        }
+        return {};
+    }
+
+    unsigned long long getStepCount() const {
+        return stepCount;
+    }
+
+private:
+    std::vector<char> bytes;
+    unsigned long long stepCount = 0;
+};
+
+/// Saves model to path synchronously, returns an empty string on success, otherwise why it failed
+template <unsigned int ChemicalCount, typename Precision>
+std::string saveCheckpoint(const ReactionDiffusion<ChemicalCount, Precision> &model, const std::string &path) {
+    CheckpointSnapshot snapshot;
+    snapshot.capture(model);
+    return snapshot.write(path);
+}
+
+/**
+ * Writes checkpoints on a thread of its own. Saving only costs the caller one copy of the grid, and a save requested
+ * while the last one is still being written is skipped rather than waited for.
+ */
+class CheckpointWriter {
+public:
+    CheckpointWriter() {
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~CheckpointWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    // Non-copyable
+    CheckpointWriter(const CheckpointWriter &other)= delete;
+    CheckpointWriter& operator=(const CheckpointWriter &source)= delete;
+
+    /**
+     * Snapshots model and queues it to be written to path.
+     * @return false if the last checkpoint is still being written, in which case nothing is saved
+     */
+    template <unsigned int ChemicalCount, typename Precision>
+    bool save(const ReactionDiffusion<ChemicalCount, Precision> &model, const std::string &path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(pending) {
+                return false;
+            }
+        }
+
+        // The writer thread doesn't touch the snapshot until pending is set
+        {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("checkpoint capture");
+            snapshot.capture(model);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingPath = path;
+            pending = true;
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    /**
+     * Waits for the checkpoint being written, if there is one.
+     * @return the error of the last write that failed since the previous call, or an empty string
+     */
+    std::string wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return !pending; });
+        std::string result;
+        std::swap(result, error);
+        return result;
+    }
+
+private:
+    void run() {
+        REACTIONDIFFUSION2_PROFILE_THREAD("checkpoint writer");
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || pending; });
+            if(pending) {
+                const std::string path = pendingPath;
+                lock.unlock();
+                std::string result;
+                {
+                    REACTIONDIFFUSION2_PROFILE_SCOPE("checkpoint write");
+                    result = snapshot.write(path);
+                }
+                lock.lock();
+
+                if(!result.empty()) {
+                    error = std::move(result);
+                }
+                pending = false;
+                finished.notify_all();
+            } else if(stopping) {
+                return;
+            }
+        }
+    }
+
+    CheckpointSnapshot snapshot;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::string pendingPath;
+    std::string error;
+    bool pending = false;
+    bool stopping = false;
+
+    // Started last, once everything it uses has been constructed
+    std::thread thread;
+};
+
+/**
+ * A checkpoint file opened for restoring. Where the platform allows the file is memory mapped, so opening costs
+ * nothing beyond checking the header and restoring copies each plane directly from the page cache.
+ */
+class Checkpoint {
+public:
+    Checkpoint()= default;
+
+    ~Checkpoint() {
+        close();
+    }
+
+    // Non-copyable
+    Checkpoint(const Checkpoint &other)= delete;
+    Checkpoint& operator=(const Checkpoint &source)= delete;
+
+    /**
+     * Opens and checks the checkpoint at path.
+     * @return an empty string on success, otherwise why it can't be used
+     */
+    std::string open(const std::string &path) {
+        close();
+
+#if defined(REACTIONDIFFUSION2_CHECKPOINT_MMAP)
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if(descriptor < 0) {
+            return "Could not open " + path;
+        }
+        struct stat info{};
+        if(fstat(descriptor, &info) != 0 || info.st_size <= 0) {
+            ::close(descriptor);
+            return "Could not read " + path;
+        }
+
+        size = static_cast<std::size_t>(info.st_size);
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+        if(mapping == MAP_FAILED) {
+            size = 0;
+            return "Could not map " + path;
+        }
+        data = static_cast<const char *>(mapping);
+        // Restoring reads every plane front to back once
+        madvise(mapping, size, MADV_SEQUENTIAL);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if(!file) {
+            return "Could not open " + path;
+        }
+        buffer.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0);
+        if(!file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+            return "Could not read " + path;
+        }
+        data = buffer.data();
+        size = buffer.size();
+#endif
+
+        std::string problem = check();
+        if(!problem.empty()) {
+            close();
+            return path + " " + problem;
+        }
+        return {};
+    }
+
+    void close() {
+#if defined(REACTIONDIFFUSION2_CHECKPOINT_MMAP)
+        if(data) {
+            munmap(const_cast<char *>(data), size);
+        }
+#else
+        buffer.clear();
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    const CheckpointHeader &getHeader() const {
+        return header;
+    }
+
+    /**
+     * Replaces the state of model with the checkpoint, which must be of a grid of the same size and precision, and
+     * carries on the step count from it. The model's tiles and temporal blocking may differ from the ones saved, its
+     * boundaries and reaction model may not, though the model's parameters may.
+     * @return an empty string on success, otherwise why it can't be restored into model
+     */
+    template <unsigned int ChemicalCount, typename Precision>
+    std::string restore(ReactionDiffusion<ChemicalCount, Precision> &model) const {
+        if(!isOpen()) {
+            return "No checkpoint is open";
+        }
+
+        const CheckpointHeader expected = CheckpointHeader::describe(model);
+        if(header.width != expected.width || header.height != expected.height) {
+            return "The checkpoint is of a " + std::to_string(header.width) + "x" + std::to_string(header.height)
+                   + " grid, not " + std::to_string(expected.width) + "x" + std::to_string(expected.height);
+        }
+        if(header.chemicalCount != ChemicalCount) {
+            return "The checkpoint has " + std::to_string(header.chemicalCount) + " chemicals, not " + std::to_string(ChemicalCount);
+        }
+        if(header.scalarType != expected.scalarType || header.storageType != expected.storageType) {
+            return "The checkpoint was saved in a different precision";
+        }
+        // check() bounded the planes by storageSize, and the seeder reads them as Storage
+        if(header.storageSize != expected.storageSize) {
+            return "The checkpoint's header is corrupt, its values are " + std::to_string(header.storageSize)
+                   + " bytes each, not " + std::to_string(expected.storageSize);
+        }
+        if(header.boundary != expected.boundary) {
+            return "The checkpoint was stepped with different boundaries";
+        }
+        if(!header.modelName().empty() && header.modelName() != expected.modelName()) {
+            return "The checkpoint is of the " + header.modelName() + " model, not "
+                   + (expected.modelName().empty() ? std::string("an unnamed one") : expected.modelName());
+        }
+        if(header.parameterCount != expected.parameterCount) {
+            return "The checkpoint's model has " + std::to_string(header.parameterCount) + " parameters, not "
+                   + std::to_string(expected.parameterCount);
+        }
+
+        model.seedReaction(std::make_unique<Seeder<ChemicalCount, Precision>>(*this), header.stepCount);
+        return {};
+    }
+
+private:
+    /// Copies the planes of a checkpoint into a grid
+    template <unsigned int ChemicalCount, typename Precision>
+    class Seeder : public AbstractSeeder<ChemicalCount, Precision> {
+    public:
+        explicit Seeder(const Checkpoint &checkpoint) : checkpoint(checkpoint) {}
+
+        void seed(ReactionState<ChemicalCount, Precision> &state) override {
+            using Storage = typename Precision::Storage;
+            const CheckpointHeader &header = checkpoint.header;
+
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                auto plane = reinterpret_cast<const Storage *>(checkpoint.data + header.planeOffset + header.planeStride * chem);
+                for(unsigned int y = 0; y < header.height; ++y) {
+                    state.setStoredRow(chem, y, plane + static_cast<std::size_t>(y) * header.width);
+                }
+            }
+        }
+
+    private:
+        const Checkpoint &checkpoint;
+    };
+
+    /// Validates the header against the file, returns why it is unusable or an empty string
+    std::string check() {
+        if(size < sizeof(CheckpointHeader)) {
+            return "is too short to be a checkpoint";
+        }
+        std::memcpy(&header, data, sizeof(header));
+
+        if(std::memcmp(header.magic, CheckpointHeader::Magic, sizeof(header.magic)) != 0) {
+            return "is not a checkpoint";
+        }
+        if(header.byteOrder != CheckpointHeader::ByteOrderMark) {
+            return "was written on a machine of a different byte order";
+        }
+        if(header.version == 0 || header.version > CheckpointHeader::CurrentVersion) {
+            return "is checkpoint version " + std::to_string(header.version) + ", only versions up to "
+                   + std::to_string(CheckpointHeader::CurrentVersion) + " are supported";
+        }
+        if(header.version < 2) {
+            std::fill(std::begin(header.model), std::end(header.model), '\0');
+        }
+        if(header.parameterCount > CheckpointHeader::MaxParameters
+           || header.boundary > static_cast<std::uint32_t>(BoundaryCondition::FixedValue)
+           || std::find(std::begin(header.model), std::end(header.model), '\0') == std::end(header.model)) {
+            return "has a corrupt header";
+        }
+
+        // Bounded by division, as a crafted header could make fileSize() or the size of a plane wrap around
+        const std::uint64_t cells = static_cast<std::uint64_t>(header.width) * header.height;
+        if(header.chemicalCount == 0 || header.storageSize == 0 || header.planeOffset < sizeof(CheckpointHeader)
+           || header.planeOffset > size || header.planeStride > (size - header.planeOffset) / header.chemicalCount
+           || cells > header.planeStride / header.storageSize) {
+            return "is truncated or has a corrupt header";
+        }
+        return {};
+    }
+
+    CheckpointHeader header{};
+    const char *data = nullptr;
+    std::size_t size = 0;
+#if !defined(REACTIONDIFFUSION2_CHECKPOINT_MMAP)
+    std::vector<char> buffer;
+#endif
+};
+
+#endif //REACTIONDIFFUSION2_CHECKPOINT_HPP
@@ -9,17 +9,19 @@
 
 /**
  * Abstract convolution functor that essentially just returns the result of some convolution around the centre cell.
- * @tparam CellDim the dimensions in cells of the reaction state
  * @tparam ChemicalCount the number of chemicals
+ * @tparam Precision the ScalarPrecision of the state
  */
-template <unsigned int CellDim, unsigned int ChemicalCount>
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
 class AbstractConvolution {
 public:
+    using Scalar = typename Precision::Scalar;
+
     /**
-     * Calls the convolution around the cell at position (x, y) and returns an array of doubles that matches to the result
+     * Calls the convolution around the cell at position (x, y) and returns an array of scalars that matches to the result
      * of the convolution for that chemical.
      */
-    virtual std::array<double, ChemicalCount> operator()(unsigned int x, unsigned int y, const ReactionState<CellDim, ChemicalCount> &state)= 0;
+    virtual std::array<Scalar, ChemicalCount> operator()(unsigned int x, unsigned int y, const ReactionState<ChemicalCount, Precision> &state)= 0;
     virtual ~AbstractConvolution()= default;
 };
 
@@ -27,34 +29,32 @@ public:
 /**
  * A "classic" convolution operates on the center cell of interest and the 8 neighbour cells.
  * Furthermore, all edges share a weight and all corners share a weight. The center also has its own weight.
+ * Neighbours are read from the halo of the cell's tile, so cells on the grid's edges see whatever the layout's
+ * BoundaryCondition puts beyond it.
  */
-template <unsigned int CellDim, unsigned int ChemicalCount>
-class ClassicConvolution : public AbstractConvolution<CellDim, ChemicalCount> {
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class ClassicConvolution : public AbstractConvolution<ChemicalCount, Precision> {
 public:
-    ClassicConvolution(double center, double edges, double corners)
+    using Scalar = typename Precision::Scalar;
+
+    ClassicConvolution(Scalar center, Scalar edges, Scalar corners)
             : centerMultiplier(center), edgeMultiplier(edges), cornerMultiplier(corners) {}
 
-    std::array<double, ChemicalCount> operator()(unsigned int x, unsigned int y, const ReactionState<CellDim, ChemicalCount> &state) override {
-        // TODO: Boundary Conditions. Just assumes all indexes valid for now
-        std::array<double, ChemicalCount> result = {};
+    std::array<Scalar, ChemicalCount> operator()(unsigned int x, unsigned int y, const ReactionState<ChemicalCount, Precision> &state) override {
+        std::array<Scalar, ChemicalCount> result = {};
 
         auto edges = getEdges(x, y, state);
         auto corners = getCorners(x, y, state);
         auto center = state.getConcentration(x, y);
 
-        // Apply the convolution for each chemical
+        // Apply the convolution for each chemical, adding opposite neighbours first as ClassicStencil does
         for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
             // Do the edges
-            for(auto const &edge : edges) {
-                result[chem] += edge[chem];
-            }
+            result[chem] = (edges[3][chem] + edges[1][chem]) + (edges[0][chem] + edges[2][chem]);
             result[chem] *= edgeMultiplier;
 
             // Do the corners
-            double cornerResult = 0;
-            for(auto const &corner : corners) {
-                cornerResult += corner[chem];
-            }
+            Scalar cornerResult = (corners[0][chem] + corners[1][chem]) + (corners[3][chem] + corners[2][chem]);
             result[chem] += (cornerResult * cornerMultiplier);
 
             // Do the center
@@ -64,31 +64,35 @@ public:
         return result;
     }
 
+    Scalar getCenterWeight() const { return centerMultiplier; }
+    Scalar getEdgeWeight() const { return edgeMultiplier; }
+    Scalar getCornerWeight() const { return cornerMultiplier; }
+
 protected:
-    double centerMultiplier;
-    double edgeMultiplier;
-    double cornerMultiplier;
+    Scalar centerMultiplier;
+    Scalar edgeMultiplier;
+    Scalar cornerMultiplier;
 
     /// Returns edges centered around (x, y) starting from the top and going clockwise
-    std::array<CellConcentration<ChemicalCount>, 4> getEdges(unsigned int x, unsigned int y, const ReactionState<CellDim, ChemicalCount> &state) {
-        std::array<CellConcentration<ChemicalCount>, 4> result;
+    std::array<CellConcentration<ChemicalCount, Scalar>, 4> getEdges(unsigned int x, unsigned int y, const ReactionState<ChemicalCount, Precision> &state) {
+        std::array<CellConcentration<ChemicalCount, Scalar>, 4> result;
 
-        result[0] = state.getConcentration(x, y - 1);
-        result[1] = state.getConcentration(x + 1, y);
-        result[2] = state.getConcentration(x, y + 1);
-        result[3] = state.getConcentration(x - 1, y);
+        result[0] = state.getNeighbour(x, y, 0, -1);
+        result[1] = state.getNeighbour(x, y, 1, 0);
+        result[2] = state.getNeighbour(x, y, 0, 1);
+        result[3] = state.getNeighbour(x, y, -1, 0);
 
         return result;
     }
 
     /// Returns corners centered around (x, y) starting from the top left and going clockwise
-    std::array<CellConcentration<ChemicalCount>, 4> getCorners(unsigned int x, unsigned int y, const ReactionState<CellDim, ChemicalCount> &state) {
-        std::array<CellConcentration<ChemicalCount>, 4> result;
+    std::array<CellConcentration<ChemicalCount, Scalar>, 4> getCorners(unsigned int x, unsigned int y, const ReactionState<ChemicalCount, Precision> &state) {
+        std::array<CellConcentration<ChemicalCount, Scalar>, 4> result;
 
-        result[0] = state.getConcentration(x - 1, y - 1);
-        result[1] = state.getConcentration(x + 1, y - 1);
-        result[2] = state.getConcentration(x + 1, y + 1);
-        result[3] = state.getConcentration(x - 1, y + 1);
+        result[0] = state.getNeighbour(x, y, -1, -1);
+        result[1] = state.getNeighbour(x, y, 1, -1);
+        result[2] = state.getNeighbour(x, y, 1, 1);
+        result[3] = state.getNeighbour(x, y, -1, 1);
 
         return result;
     }
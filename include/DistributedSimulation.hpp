@@ -0,0 +1,231 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_DISTRIBUTEDSIMULATION_HPP
+#define REACTIONDIFFUSION2_DISTRIBUTEDSIMULATION_HPP
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "HaloTransport.hpp"
+#include "ReactionDiffusion.hpp"
+
+/**
+ * One rank's part of a grid split across processes, which is a band of whole rows. Each rank steps its band as a
+ * ReactionDiffusion of its own, one row taller at each end. The extra rows are ghost rows holding copies of the
+ * neighbouring ranks' edge rows, or the grid's fixed outer ring at the first and last rank. Every step the edge rows
+ * are exchanged through an AbstractHaloTransport while the rest of the band is stepped (see AbstractRowExchange). Each
+ * cell goes through the same arithmetic as it would in one process, so the result is the same.
+ *
+ * Every rank constructs the simulation with the same layout and calls scatter, update and gather in the same order.
+ * Only the fixed ring boundary is supported, and temporal blocking isn't, as neither spans the ranks yet.
+ * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision to compute and store the grid in
+ */
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class DistributedSimulation {
+public:
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+
+    /// The rows of the whole grid a rank steps, the interior rows split between the ranks as evenly as they go
+    static RowRange bandOf(unsigned int rank, unsigned int rankCount, unsigned int height) {
+        const unsigned int interior = height - 2;
+        return {1 + interior * rank / rankCount, 1 + interior * (rank + 1) / rankCount};
+    }
+
+    /// The message size a transport needs for a grid this wide, one row of every chemical
+    static std::size_t messageSize(unsigned int width) {
+        return static_cast<std::size_t>(width) * ChemicalCount * sizeof(Storage);
+    }
+
+    /**
+     * Sets the band up at the background of the model, see scatter
+     * @param layout the whole grid, which must be at least a row per rank plus the outer ring tall
+     * @param transport carries rows between this rank and the others, with a message size of messageSize
+     */
+    DistributedSimulation(const GridLayout &layout, AbstractHaloTransport &transport,
+                          std::unique_ptr<AbstractConvolution<ChemicalCount, Precision>> convolution,
+                          std::unique_ptr<AbstractReactionModel<ChemicalCount, Scalar>> reactionModel,
+                          unsigned int threadCount = std::thread::hardware_concurrency())
+            : layout(layout), transport(transport), band(bandOf(transport.getRank(), transport.getRankCount(), layout.height)),
+              message(static_cast<std::size_t>(layout.width) * ChemicalCount)
+    {
+        const GridLayout local{layout.width, band.last - band.first + 2, layout.tileSize, 1, BoundaryCondition::FixedRing};
+        model = std::make_unique<ReactionDiffusion<ChemicalCount, Precision>>(local, std::move(convolution),
+                std::make_unique<BandSeeder>(nullptr, 0), std::move(reactionModel), threadCount);
+        model->setRowExchange(std::make_unique<Exchange>(transport, layout.width));
+    }
+
+    /**
+     * Seeds every rank's band from the whole grid, which only rank 0 passes, counting steps from startingStep
+     * @param whole the whole grid at rank 0, nullptr elsewhere
+     */
+    void scatter(const ReactionState<ChemicalCount, Precision> *whole, unsigned long long startingStep = 0) {
+        const unsigned int rank = transport.getRank();
+        if(rank == 0) {
+            for(unsigned int other = 1; other < transport.getRankCount(); ++other) {
+                const RowRange rows = bandOf(other, transport.getRankCount(), layout.height);
+                for(unsigned int y = rows.first - 1; y < rows.last + 1; ++y) {
+                    pack(*whole, y, message.data());
+                    transport.send(other, message.data());
+                }
+            }
+            model->seedReaction(std::make_unique<BandSeeder>(whole, band.first - 1), startingStep);
+            return;
+        }
+
+        ReactionState<ChemicalCount, Precision> incoming(model->getState().getLayout());
+        for(unsigned int y = 0; y < incoming.getHeight(); ++y) {
+            transport.receive(0, message.data());
+            unpack(message.data(), incoming, y);
+        }
+        model->seedReaction(std::make_unique<BandSeeder>(&incoming, 0), startingStep);
+    }
+
+    /// Advances every rank by the given number of steps
+    void update(unsigned int steps = 1) {
+        model->update(steps);
+    }
+
+    /**
+     * Copies every rank's rows into the whole grid at rank 0
+     * @param whole the whole grid at rank 0, nullptr elsewhere
+     */
+    void gather(ReactionState<ChemicalCount, Precision> *whole) {
+        const unsigned int rank = transport.getRank();
+        const unsigned int rankCount = transport.getRankCount();
+        if(rank != 0) {
+            const RowRange rows = ownedRows(rank);
+            for(unsigned int y = rows.first; y < rows.last; ++y) {
+                pack(model->getState(), y - (band.first - 1), message.data());
+                transport.send(0, message.data());
+            }
+            return;
+        }
+
+        const RowRange rows = ownedRows(0);
+        for(unsigned int y = rows.first; y < rows.last; ++y) {
+            pack(model->getState(), y - (band.first - 1), message.data());
+            unpack(message.data(), *whole, y);
+        }
+        for(unsigned int other = 1; other < rankCount; ++other) {
+            const RowRange otherRows = ownedRows(other);
+            for(unsigned int y = otherRows.first; y < otherRows.last; ++y) {
+                transport.receive(other, message.data());
+                unpack(message.data(), *whole, y);
+            }
+        }
+    }
+
+    /// This rank's part of the simulation, its rows offset by one less than the first row of its band
+    ReactionDiffusion<ChemicalCount, Precision> &getModel() {
+        return *model;
+    }
+
+    /// The rows of the whole grid this rank steps
+    RowRange getBand() const {
+        return band;
+    }
+
+    const GridLayout &getLayout() const {
+        return layout;
+    }
+
+    unsigned long long getStepCount() const {
+        return model->getStepCount();
+    }
+
+private:
+    /// Sends and receives the ghost rows of a band, see AbstractRowExchange
+    class Exchange : public AbstractRowExchange<ChemicalCount, Precision> {
+    public:
+        Exchange(AbstractHaloTransport &transport, unsigned int width)
+                : transport(transport), outgoing(static_cast<std::size_t>(width) * ChemicalCount), incoming(outgoing.size()) {}
+
+        void send(const ReactionState<ChemicalCount, Precision> &state) override {
+            const unsigned int rank = transport.getRank();
+            if(rank > 0) {
+                pack(state, 1, outgoing.data());
+                transport.send(rank - 1, outgoing.data());
+            }
+            if(rank + 1 < transport.getRankCount()) {
+                pack(state, state.getHeight() - 2, outgoing.data());
+                transport.send(rank + 1, outgoing.data());
+            }
+        }
+
+        void receive(ReactionState<ChemicalCount, Precision> &state) override {
+            const unsigned int rank = transport.getRank();
+            if(rank > 0) {
+                transport.receive(rank - 1, incoming.data());
+                unpack(incoming.data(), state, 0);
+            }
+            if(rank + 1 < transport.getRankCount()) {
+                transport.receive(rank + 1, incoming.data());
+                unpack(incoming.data(), state, state.getHeight() - 1);
+            }
+        }
+
+    private:
+        AbstractHaloTransport &transport;
+        std::vector<Storage> outgoing, incoming;
+    };
+
+    /// Copies the rows of a grid from firstRow on into a band, as many as the band has
+    class BandSeeder : public AbstractSeeder<ChemicalCount, Precision> {
+    public:
+        /// Leaves the band as it is if source is nullptr
+        BandSeeder(const ReactionState<ChemicalCount, Precision> *source, unsigned int firstRow) : source(source), firstRow(firstRow) {}
+
+        void seed(ReactionState<ChemicalCount, Precision> &state) override {
+            if(!source) {
+                return;
+            }
+            std::vector<Storage> row(state.getWidth());
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                for(unsigned int y = 0; y < state.getHeight(); ++y) {
+                    source->copyStoredRow(chem, firstRow + y, row.data());
+                    state.setStoredRow(chem, y, row.data());
+                }
+            }
+        }
+
+    private:
+        const ReactionState<ChemicalCount, Precision> *source;
+        unsigned int firstRow;
+    };
+
+    /// Row y of every chemical as stored, one after the other, which is what a message holds
+    static void pack(const ReactionState<ChemicalCount, Precision> &state, unsigned int y, Storage *out) {
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            state.copyStoredRow(chem, y, out + static_cast<std::size_t>(chem) * state.getWidth());
+        }
+    }
+
+    static void unpack(const Storage *in, ReactionState<ChemicalCount, Precision> &state, unsigned int y) {
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            state.setStoredRow(chem, y, in + static_cast<std::size_t>(chem) * state.getWidth());
+        }
+    }
+
+    /// The rows of the whole grid a rank gathers from, its band plus the outer ring at the first and last rank
+    RowRange ownedRows(unsigned int rank) const {
+        RowRange rows = bandOf(rank, transport.getRankCount(), layout.height);
+        if(rank == 0) {
+            rows.first = 0;
+        }
+        if(rank + 1 == transport.getRankCount()) {
+            rows.last = layout.height;
+        }
+        return rows;
+    }
+
+    GridLayout layout;
+    AbstractHaloTransport &transport;
+    RowRange band;
+    /// One message's worth of rows
+    std::vector<Storage> message;
+    std::unique_ptr<ReactionDiffusion<ChemicalCount, Precision>> model;
+};
+
+#endif //REACTIONDIFFUSION2_DISTRIBUTEDSIMULATION_HPP
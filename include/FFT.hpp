@@ -0,0 +1,155 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_FFT_HPP
+#define REACTIONDIFFUSION2_FFT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+/**
+ * Radix-2 fast Fourier transform of a power of two number of complex values, done in place. Neither direction is
+ * normalised, so a forward and inverse transform scale the data by the size.
+ * @tparam Scalar the type of the real and imaginary parts
+ */
+template <typename Scalar = double>
+class FFT {
+public:
+    using Complex = std::complex<Scalar>;
+
+    static bool supportsSize(unsigned int size) {
+        return size != 0 && (size & (size - 1)) == 0;
+    }
+
+    /// size must be a power of two, see supportsSize
+    explicit FFT(unsigned int size) : size(size), reversed(size) {
+        unsigned int bits = 0;
+        while((1u << bits) < size) {
+            ++bits;
+        }
+        for(unsigned int i = 0; i < size; ++i) {
+            unsigned int reverse = 0;
+            for(unsigned int bit = 0; bit < bits; ++bit) {
+                reverse |= ((i >> bit) & 1u) << (bits - 1 - bit);
+            }
+            reversed[i] = reverse;
+        }
+
+        // The twiddles of each pass one after the other, so every pass reads its own contiguously. Computed in double
+        // whatever Scalar is, so a float transform only rounds once
+        const double pi = std::acos(-1.0);
+        for(unsigned int half = 1; half < size; half <<= 1) {
+            for(unsigned int i = 0; i < half; ++i) {
+                const double angle = pi * i / half;
+                forward.push_back(static_cast<Scalar>(std::cos(angle)));
+                forward.push_back(static_cast<Scalar>(-std::sin(angle)));
+                backward.push_back(static_cast<Scalar>(std::cos(angle)));
+                backward.push_back(static_cast<Scalar>(std::sin(angle)));
+            }
+        }
+    }
+
+    unsigned int getSize() const {
+        return size;
+    }
+
+    /// Transforms size values starting at data
+    void transform(Complex *data, bool inverse) const {
+        for(unsigned int i = 0; i < size; ++i) {
+            if(i < reversed[i]) {
+                std::swap(data[i], data[reversed[i]]);
+            }
+        }
+
+        // Interleaved real and imaginary parts as std::complex lays them out, written out in full so the butterflies
+        // vectorise (std::complex multiplication checks for infinities on every product)
+        Scalar *values = reinterpret_cast<Scalar *>(data);
+        const Scalar *twiddles = (inverse ? backward : forward).data();
+        for(unsigned int half = 1; half < size; half <<= 1) {
+            for(unsigned int begin = 0; begin < size; begin += 2 * half) {
+                Scalar *even = values + 2 * begin;
+                Scalar *odd = even + 2 * half;
+                for(unsigned int i = 0; i < half; ++i) {
+                    const Scalar twiddleReal = twiddles[2 * i], twiddleImag = twiddles[2 * i + 1];
+                    const Scalar productReal = odd[2 * i] * twiddleReal - odd[2 * i + 1] * twiddleImag;
+                    const Scalar productImag = odd[2 * i] * twiddleImag + odd[2 * i + 1] * twiddleReal;
+                    odd[2 * i] = even[2 * i] - productReal;
+                    odd[2 * i + 1] = even[2 * i + 1] - productImag;
+                    even[2 * i] += productReal;
+                    even[2 * i + 1] += productImag;
+                }
+            }
+            twiddles += 2 * half;
+        }
+    }
+
+private:
+    unsigned int size;
+    std::vector<unsigned int> reversed;
+    std::vector<Scalar> forward, backward;
+};
+
+/**
+ * Two dimensional FFT of a row major width * height grid of complex values, done in place: every row, then every
+ * column a block of columns at a time so each pass over the grid reads whole cache lines. Rows and column blocks are
+ * shared out over a thread pool. Not normalised, see FFT.
+ * @tparam Scalar the type of the real and imaginary parts
+ */
+template <typename Scalar = double>
+class FFT2D {
+public:
+    using Complex = std::complex<Scalar>;
+
+    static bool supportsSize(unsigned int width, unsigned int height) {
+        return FFT<Scalar>::supportsSize(width) && FFT<Scalar>::supportsSize(height);
+    }
+
+    /// width and height must be powers of two, see supportsSize
+    FFT2D(unsigned int width, unsigned int height) : rows(width), columns(height) {}
+
+    void transform(Complex *data, bool inverse, ThreadPool &pool) const {
+        const unsigned int width = rows.getSize();
+        const unsigned int height = columns.getSize();
+
+        pool.parallelFor(height, [&](unsigned int y) {
+            rows.transform(data + static_cast<std::size_t>(y) * width, inverse);
+        });
+
+        const unsigned int blocks = (width + ColumnBlock - 1) / ColumnBlock;
+        pool.parallelFor(blocks, [&](unsigned int block) {
+            const unsigned int first = block * ColumnBlock;
+            const unsigned int count = std::min(ColumnBlock, width - first);
+
+            // Only grows, so each thread allocates once
+            thread_local std::vector<Complex> scratch;
+            scratch.resize(static_cast<std::size_t>(ColumnBlock) * height);
+
+            for(unsigned int y = 0; y < height; ++y) {
+                const Complex *row = data + static_cast<std::size_t>(y) * width + first;
+                for(unsigned int column = 0; column < count; ++column) {
+                    scratch[static_cast<std::size_t>(column) * height + y] = row[column];
+                }
+            }
+            for(unsigned int column = 0; column < count; ++column) {
+                columns.transform(scratch.data() + static_cast<std::size_t>(column) * height, inverse);
+            }
+            for(unsigned int y = 0; y < height; ++y) {
+                Complex *row = data + static_cast<std::size_t>(y) * width + first;
+                for(unsigned int column = 0; column < count; ++column) {
+                    row[column] = scratch[static_cast<std::size_t>(column) * height + y];
+                }
+            }
+        });
+    }
+
+private:
+    /// Columns gathered per task, 8 complex doubles span two cache lines of each row
+    static constexpr unsigned int ColumnBlock = 8;
+
+    FFT<Scalar> rows;
+    FFT<Scalar> columns;
+};
+
+#endif //REACTIONDIFFUSION2_FFT_HPP
@@ -0,0 +1,226 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_GRIDARENA_HPP
+#define REACTIONDIFFUSION2_GRIDARENA_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define REACTIONDIFFUSION2_ARENA_MMAP 1
+#endif
+
+#include "Simd.hpp"
+
+/**
+ * Where the planes of grids are allocated. Every block starts on a simd::Alignment boundary.
+ *
+ * Blocks of a huge page or more are mapped straight from the kernel, aligned to and rounded up to whole huge pages, and
+ * advised to be backed by transparent huge pages. A step strides through several planes a tile apart, and with 4KiB
+ * pages each of those strides is a TLB miss of its own. The pages aren't touched when they are mapped, so the thread
+ * that first writes a page decides which NUMA node it is placed on. ReactionState fills its tiles across the thread
+ * pool that will step them for that reason (see ReactionState::fill). With huge pages that happens a huge page at a
+ * time, a few tiles of the default size.
+ *
+ * Released blocks are kept and handed out again for the next block of the same size, up to a limit, so grids that are
+ * made and dropped over and over, as by warm starts, restarts and sweeps, cost no trip to the kernel and no page
+ * faults. A block handed out again keeps the placement its pages were first given. The kept blocks are tracked in a
+ * fixed array, so releasing a block never allocates.
+ */
+class GridArena {
+public:
+    /// The size of a transparent huge page on x86-64 and most ARM64 Linux kernels
+    static constexpr std::size_t HugePageSize = std::size_t(2) << 20;
+    /// How many bytes of released blocks are kept for reuse unless set otherwise
+    static constexpr std::size_t DefaultKeepLimit = std::size_t(1) << 30;
+    /// How many released blocks are kept at most, whatever their size
+    static constexpr std::size_t MaxKeptBlocks = 64;
+
+    /// The arena grids allocate their planes from
+    static GridArena &shared() {
+        static GridArena arena;
+        return arena;
+    }
+
+    GridArena()= default;
+
+    ~GridArena() {
+        trim();
+    }
+
+    // Non-copyable
+    GridArena(const GridArena &other)= delete;
+    GridArena& operator=(const GridArena &source)= delete;
+
+    /// Returns a block of at least bytes, which must be handed back to release with the same size
+    void *allocate(std::size_t bytes) {
+        const std::size_t size = roundedSize(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The most recently released first, its pages are the likeliest to still be cached
+            for(std::size_t index = keptCount; index-- > 0;) {
+                if(kept[index].bytes == size) {
+                    void *memory = kept[index].memory;
+                    std::move(kept.begin() + index + 1, kept.begin() + keptCount, kept.begin() + index);
+                    --keptCount;
+                    keptBytes -= size;
+                    ++reuseCount;
+                    return memory;
+                }
+            }
+            ++freshCount;
+        }
+        return obtain(size);
+    }
+
+    /// Hands a block from allocate back to be kept or freed
+    void release(void *memory, std::size_t bytes) {
+        if(memory == nullptr) {
+            return;
+        }
+
+        const std::size_t size = roundedSize(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(size <= keepLimit) {
+                // Make room by freeing the blocks released longest ago
+                std::size_t freed = 0;
+                while(freed < keptCount && (keptBytes + size > keepLimit || keptCount - freed == MaxKeptBlocks)) {
+                    giveBack(kept[freed].memory, kept[freed].bytes);
+                    keptBytes -= kept[freed].bytes;
+                    ++freed;
+                }
+                std::move(kept.begin() + freed, kept.begin() + keptCount, kept.begin());
+                keptCount -= freed;
+                kept[keptCount++] = {memory, size};
+                keptBytes += size;
+                return;
+            }
+        }
+        giveBack(memory, size);
+    }
+
+    /// Frees every kept block
+    void trim() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(std::size_t index = 0; index < keptCount; ++index) {
+            giveBack(kept[index].memory, kept[index].bytes);
+        }
+        keptCount = 0;
+        keptBytes = 0;
+    }
+
+    /// Whether blocks mapped from now on are advised to be backed by huge pages, on by default
+    void setHugePages(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        hugePages = enabled;
+    }
+
+    bool getHugePages() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hugePages;
+    }
+
+    /// Sets how many bytes of released blocks may be kept, 0 frees every block as it is released
+    void setKeepLimit(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        keepLimit = bytes;
+    }
+
+    /// The bytes of released blocks kept for reuse
+    std::size_t getKeptBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return keptBytes;
+    }
+
+    /// How many blocks have been obtained from the system
+    unsigned long long getFreshCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return freshCount;
+    }
+
+    /// How many blocks have been handed out again after being released
+    unsigned long long getReuseCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return reuseCount;
+    }
+
+private:
+    struct Block {
+        void *memory;
+        std::size_t bytes;
+    };
+
+    /// The size a block is actually allocated at, so blocks asked for with slightly different sizes can be reused
+    static std::size_t roundedSize(std::size_t bytes) {
+        const std::size_t unit = isMapped(bytes) ? HugePageSize : simd::Alignment;
+        return (std::max<std::size_t>(bytes, 1) + unit - 1) / unit * unit;
+    }
+
+    static bool isMapped(std::size_t bytes) {
+#if REACTIONDIFFUSION2_ARENA_MMAP
+        return bytes >= HugePageSize;
+#else
+        static_cast<void>(bytes);
+        return false;
+#endif
+    }
+
+    /// Allocates a block of size, a rounded size, from the system
+    void *obtain(std::size_t size) {
+#if REACTIONDIFFUSION2_ARENA_MMAP
+        if(isMapped(size)) {
+            // Mapped with a huge page to spare and trimmed so the block starts on a huge page boundary, or the kernel
+            // can only back the whole pages within it with huge pages
+            const std::size_t mappedSize = size + HugePageSize;
+            void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(mapped == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            const auto start = reinterpret_cast<std::uintptr_t>(mapped);
+            const std::uintptr_t aligned = (start + HugePageSize - 1) / HugePageSize * HugePageSize;
+            if(aligned != start) {
+                munmap(mapped, aligned - start);
+            }
+            const std::uintptr_t end = start + mappedSize;
+            if(end != aligned + size) {
+                munmap(reinterpret_cast<void *>(aligned + size), end - (aligned + size));
+            }
+#if defined(MADV_HUGEPAGE)
+            if(getHugePages()) {
+                madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+            }
+#endif
+            return reinterpret_cast<void *>(aligned);
+        }
+#endif
+        return operator new[](size, std::align_val_t(simd::Alignment));
+    }
+
+    /// Frees a block obtained from the system
+    static void giveBack(void *memory, std::size_t size) {
+#if REACTIONDIFFUSION2_ARENA_MMAP
+        if(isMapped(size)) {
+            munmap(memory, size);
+            return;
+        }
+#endif
+        operator delete[](memory, std::align_val_t(simd::Alignment));
+    }
+
+    mutable std::mutex mutex;
+    /// The kept blocks, the longest ago released first
+    std::array<Block, MaxKeptBlocks> kept{};
+    std::size_t keptCount = 0;
+    std::size_t keptBytes = 0;
+    std::size_t keepLimit = DefaultKeepLimit;
+    bool hugePages = true;
+    unsigned long long freshCount = 0;
+    unsigned long long reuseCount = 0;
+};
+
+#endif //REACTIONDIFFUSION2_GRIDARENA_HPP
@@ -0,0 +1,284 @@
+/**
+ * Carrying rows between the processes a grid is split across, see DistributedSimulation. AbstractHaloTransport is all
+ * the simulation sees, so a transport over an interconnect between machines can stand in for the shared memory one.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_HALOTRANSPORT_HPP
+#define REACTIONDIFFUSION2_HALOTRANSPORT_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define REACTIONDIFFUSION2_SHARED_MEMORY 1
+#endif
+
+/**
+ * Messages between the ranks of a simulation, one process each. Every message is the same size, and the messages from
+ * one rank to another arrive in the order they were sent.
+ */
+class AbstractHaloTransport {
+public:
+    /// This process's rank, from 0 to getRankCount() - 1
+    virtual unsigned int getRank() const = 0;
+    virtual unsigned int getRankCount() const = 0;
+    /// The size of every message in bytes
+    virtual std::size_t getMessageSize() const = 0;
+    /// Sends a message to another rank, returning once data can be reused rather than once it has been received
+    virtual void send(unsigned int rank, const void *data)= 0;
+    /// Waits for the next message from another rank and copies it into data
+    virtual void receive(unsigned int rank, void *data)= 0;
+    /// Waits until every rank has reached the barrier
+    virtual void barrier()= 0;
+    virtual ~AbstractHaloTransport()= default;
+};
+
+/**
+ * Carries messages between processes on one machine through a block of POSIX shared memory. Each ordered pair of ranks
+ * has a mailbox of two slots, so a sender can fill one while the receiver is still reading the other and only waits
+ * when it gets two messages ahead. Waiting spins briefly, then yields, so ranks sharing a core still make progress.
+ * One process creates the block and the others attach to it by name, forked or started separately.
+ */
+class SharedMemoryTransport : public AbstractHaloTransport {
+public:
+    SharedMemoryTransport()= default;
+
+    SharedMemoryTransport(const SharedMemoryTransport &other)= delete;
+    SharedMemoryTransport& operator=(const SharedMemoryTransport &source)= delete;
+
+    ~SharedMemoryTransport() override {
+        close();
+    }
+
+    /**
+     * Creates the shared memory for rankCount ranks and joins it as rank 0. It is removed again when this process
+     * closes it, ranks already attached keep their mapping.
+     * @param name a POSIX shared memory name, a slash then no others
+     * @return why it couldn't be created, or an empty string
+     */
+    std::string create(const std::string &name, unsigned int rankCount, std::size_t messageSize) {
+        close();
+        if(rankCount == 0 || messageSize == 0) {
+            return "A transport needs at least one rank and a message size";
+        }
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+        const std::size_t mailboxSize = roundUp(sizeof(Mailbox)) + 2 * roundUp(messageSize);
+        const std::size_t size = roundUp(sizeof(Header)) + mailboxSize * rankCount * rankCount;
+
+        const int descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(descriptor < 0) {
+            return "Could not create shared memory " + name + ": " + std::strerror(errno);
+        }
+        std::string error = ftruncate(descriptor, static_cast<off_t>(size)) == 0 ? map(descriptor, size) : std::strerror(errno);
+        ::close(descriptor);
+        if(!error.empty()) {
+            shm_unlink(name.c_str());
+            return "Could not size shared memory " + name + ": " + error;
+        }
+        this->name = name;
+        creator = static_cast<long>(getpid());
+
+        // Fresh shared memory is zeroed, which is every counter's starting value
+        header = new(memory) Header{};
+        header->magic = Header::Magic;
+        header->rankCount = rankCount;
+        header->messageSize = messageSize;
+        header->mailboxSize = mailboxSize;
+        for(unsigned int box = 0; box < rankCount * rankCount; ++box) {
+            new(memory + roundUp(sizeof(Header)) + mailboxSize * box) Mailbox{};
+        }
+        join(0);
+        return "";
+#else
+        return "Shared memory isn't supported on this platform";
+#endif
+    }
+
+    /**
+     * Joins shared memory another process created
+     * @return why it couldn't be joined, or an empty string
+     */
+    std::string attach(const std::string &name, unsigned int rank) {
+        close();
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+        const int descriptor = shm_open(name.c_str(), O_RDWR, 0);
+        if(descriptor < 0) {
+            return "Could not open shared memory " + name + ": " + std::strerror(errno);
+        }
+        struct stat info{};
+        std::string error = fstat(descriptor, &info) == 0 ? map(descriptor, static_cast<std::size_t>(info.st_size)) : std::strerror(errno);
+        ::close(descriptor);
+        if(!error.empty()) {
+            return "Could not map shared memory " + name + ": " + error;
+        }
+
+        header = reinterpret_cast<Header *>(memory);
+        if(size < sizeof(Header) || header->magic != Header::Magic) {
+            close();
+            return name + " is not a transport's shared memory";
+        }
+        if(rank >= header->rankCount) {
+            const unsigned int rankCount = header->rankCount;
+            close();
+            return "Rank " + std::to_string(rank) + " is out of range, " + name + " has " + std::to_string(rankCount) + " ranks";
+        }
+        join(rank);
+        return "";
+#else
+        return "Shared memory isn't supported on this platform";
+#endif
+    }
+
+    /// Leaves the shared memory, removing it if this process created it
+    void close() {
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+        if(memory) {
+            munmap(memory, size);
+            // A forked rank holds a copy of the creator's transport, only the creator itself removes the memory
+            if(!name.empty() && creator == static_cast<long>(getpid())) {
+                shm_unlink(name.c_str());
+            }
+        }
+#endif
+        memory = nullptr;
+        header = nullptr;
+        size = 0;
+        name.clear();
+    }
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    unsigned int getRank() const override {
+        return rank;
+    }
+
+    unsigned int getRankCount() const override {
+        return header ? header->rankCount : 0;
+    }
+
+    std::size_t getMessageSize() const override {
+        return header ? header->messageSize : 0;
+    }
+
+    void send(unsigned int to, const void *data) override {
+        Mailbox &box = mailbox(rank, to);
+        const std::uint64_t message = sent[to]++;
+        // The slot last held the message before last, which must have been taken
+        waitFor([&] { return box.taken.load(std::memory_order_acquire) + 2 > message; });
+        std::memcpy(slot(box, message % 2), data, header->messageSize);
+        box.posted[message % 2].store(message + 1, std::memory_order_release);
+    }
+
+    void receive(unsigned int from, void *data) override {
+        Mailbox &box = mailbox(from, rank);
+        const std::uint64_t message = received[from]++;
+        waitFor([&] { return box.posted[message % 2].load(std::memory_order_acquire) == message + 1; });
+        std::memcpy(data, slot(box, message % 2), header->messageSize);
+        box.taken.store(message + 1, std::memory_order_release);
+    }
+
+    void barrier() override {
+        const std::uint32_t generation = header->generation.load(std::memory_order_acquire);
+        if(header->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == header->rankCount) {
+            header->arrived.store(0, std::memory_order_relaxed);
+            header->generation.fetch_add(1, std::memory_order_release);
+        } else {
+            waitFor([&] { return header->generation.load(std::memory_order_acquire) != generation; });
+        }
+    }
+
+private:
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+                  "counters shared between processes must not hide a lock in one of them");
+
+    /// Counters that are written by different processes are kept on separate cache lines
+    static constexpr std::size_t CacheLine = 64;
+    /// Spins before a wait starts yielding the core, roughly the time another rank takes to post a row
+    static constexpr unsigned int SpinsBeforeYield = 256;
+
+    struct Header {
+        static constexpr std::uint64_t Magic = 0x52444841'4c4f5331;  // "RDHALOS1"
+
+        std::uint64_t magic;
+        std::uint32_t rankCount;
+        std::uint64_t messageSize;
+        /// Bytes from one mailbox to the next
+        std::uint64_t mailboxSize;
+        alignas(CacheLine) std::atomic<std::uint32_t> arrived;
+        std::atomic<std::uint32_t> generation;
+    };
+
+    /// The messages from one rank to another, followed in memory by its two slots
+    struct Mailbox {
+        /// The number of the message each slot holds, plus one
+        alignas(CacheLine) std::atomic<std::uint64_t> posted[2];
+        /// How many messages the receiver has taken
+        alignas(CacheLine) std::atomic<std::uint64_t> taken;
+    };
+
+    static std::size_t roundUp(std::size_t bytes) {
+        return (bytes + CacheLine - 1) / CacheLine * CacheLine;
+    }
+
+    template <typename Condition>
+    static void waitFor(Condition condition) {
+        for(unsigned int spins = 0; !condition(); ++spins) {
+            if(spins >= SpinsBeforeYield) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+    /// Maps the shared memory behind descriptor, returns why it couldn't or an empty string
+    std::string map(int descriptor, std::size_t bytes) {
+        void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        if(mapped == MAP_FAILED) {
+            return std::strerror(errno);
+        }
+        memory = static_cast<unsigned char *>(mapped);
+        size = bytes;
+        return "";
+    }
+#endif
+
+    void join(unsigned int rank) {
+        this->rank = rank;
+        sent.assign(header->rankCount, 0);
+        received.assign(header->rankCount, 0);
+    }
+
+    Mailbox &mailbox(unsigned int from, unsigned int to) const {
+        const std::size_t box = static_cast<std::size_t>(from) * header->rankCount + to;
+        return *reinterpret_cast<Mailbox *>(memory + roundUp(sizeof(Header)) + header->mailboxSize * box);
+    }
+
+    unsigned char *slot(Mailbox &box, std::uint64_t index) const {
+        return reinterpret_cast<unsigned char *>(&box) + roundUp(sizeof(Mailbox)) + roundUp(header->messageSize) * index;
+    }
+
+    unsigned char *memory = nullptr;
+    std::size_t size = 0;
+    Header *header = nullptr;
+    /// The name to remove on closing, only set in the process that created it
+    std::string name;
+    long creator = 0;
+    unsigned int rank = 0;
+    /// Messages sent to and received from each rank so far
+    std::vector<std::uint64_t> sent, received;
+};
+
+#endif //REACTIONDIFFUSION2_HALOTRANSPORT_HPP
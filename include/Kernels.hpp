@@ -0,0 +1,429 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_KERNELS_HPP
+#define REACTIONDIFFUSION2_KERNELS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "Precision.hpp"
+#include "Random.hpp"
+#include "Reactions.hpp"
+#include "Simd.hpp"
+#include "Util.hpp"
+
+/**
+ * The classic 9 point stencil (see ClassicConvolution) evaluated on a pack of neighbouring cells in one row.
+ * The sums are done in the same order as ClassicConvolution so both paths produce the same values. Opposite
+ * neighbours are added first, so a cell next to a mirrored halo sums the same values its mirror image would, and a
+ * zero-flux grid rounds the same whether a cell's neighbours come from the halo or from the interior.
+ * @tparam Scalar the type the stencil is computed in
+ */
+template <typename Scalar = double>
+struct ClassicStencil {
+    Scalar center, edge, corner;
+
+    /// Applies the stencil to the cells starting at x, given the rows above, at and below the cells
+    template <typename Batch>
+    inline Batch apply(const Scalar *above, const Scalar *at, const Scalar *below, int x) const {
+        Batch edges = (Batch::load(at + x - 1) + Batch::load(at + x + 1)) + (Batch::load(above + x) + Batch::load(below + x));
+        Batch corners = (Batch::load(above + x - 1) + Batch::load(above + x + 1)) + (Batch::load(below + x - 1) + Batch::load(below + x + 1));
+
+        return edges * Batch::broadcast(edge) + corners * Batch::broadcast(corner) + Batch::load(at + x) * Batch::broadcast(center);
+    }
+};
+
+/// The largest lane of a batch
+template <typename Batch, typename Scalar>
+inline Scalar horizontalMax(Batch batch) {
+    alignas(simd::Alignment) Scalar lanes[Batch::Lanes];
+    batch.store(lanes);
+    return *std::max_element(lanes, lanes + Batch::Lanes);
+}
+
+/// The sum of the lanes of a batch
+template <typename Batch, typename Scalar>
+inline double horizontalSum(Batch batch) {
+    alignas(simd::Alignment) Scalar lanes[Batch::Lanes];
+    batch.store(lanes);
+    double sum = 0;
+    for(unsigned int lane = 0; lane < Batch::Lanes; ++lane) {
+        sum += static_cast<double>(lanes[lane]);
+    }
+    return sum;
+}
+
+/// The splitmix64 finaliser, which spreads every bit of its input over every bit of its output
+inline std::uint64_t mixBits(std::uint64_t bits) {
+    bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebULL;
+    return bits ^ (bits >> 31);
+}
+
+/**
+ * Hashes one chemical's concentration in a cell together with the cell's position. Summing it over every cell gives
+ * a hash of the grid that doesn't depend on the order the cells were visited in, so tiles and bands can be hashed
+ * apart and added up, while a pattern that has moved still hashes differently.
+ */
+template <typename Scalar>
+inline std::uint64_t hashCell(Scalar value, unsigned int chem, int x, int y) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, std::min(sizeof(value), sizeof(bits)));
+    const std::uint64_t position = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(y)) << 32) | static_cast<std::uint32_t>(x);
+    return mixBits(bits ^ mixBits(position + chem * 0x9e3779b97f4a7c15ULL));
+}
+
+/**
+ * Where stepRows and reduceRows add up the cells they visit. Both are optional, and a reduction with neither is the
+ * same as passing none.
+ */
+struct RowReduction {
+    /// Each chemical's concentrations are added to sums[chem]
+    double *sums = nullptr;
+    /// hashCell of every concentration is added to hash, at the cell's position in the planes offset by origin
+    std::uint64_t *hash = nullptr;
+    int originX = 0, originY = 0;
+};
+
+/**
+ * Noise stepRows adds to every concentration it writes: amplitude[chem] times a number uniform in [-1, 1) drawn from
+ * random at stream step and index y * width + x, lane chem, for the cell's position in the grid. Each cell gets the
+ * same noise in a step however the grid is split between threads, and a cell in the halo of a tile stepped ahead by
+ * temporal blocking gets the noise of the cell it is a copy of.
+ */
+struct RowNoise {
+    const CounterRandom *random = nullptr;
+    const double *amplitude = nullptr;
+    std::uint64_t step = 0;
+    /// The position in the grid of cell (0, 0) of the planes
+    int originX = 0, originY = 0;
+    /// Positions beyond the grid's edges wrap around it, or with mirror set are mirrored about them, as the halo is
+    unsigned int width = 0, height = 0;
+    bool mirror = false;
+};
+
+/**
+ * Adds noise to cells [xBegin, xEnd) of row y in the coordinates of the planes, rows[chem][0] being cell xBegin
+ * @tparam ChemicalCount at most 4, a lane of the generator each
+ */
+template <typename Scalar, unsigned int ChemicalCount>
+void addNoise(Scalar *const *rows, int y, int xBegin, int xEnd, const RowNoise &noise) {
+    static_assert(ChemicalCount <= 4, "each chemical takes one of the four lanes of a cell's random numbers");
+    const std::uint64_t rowIndex = static_cast<std::uint64_t>(foldCoordinate(noise.originY + y, noise.height, noise.mirror)) * noise.width;
+
+    thread_local std::vector<Scalar> drawn;
+    if(drawn.size() < static_cast<std::size_t>(xEnd - xBegin) * ChemicalCount) {
+        drawn.resize(static_cast<std::size_t>(xEnd - xBegin) * ChemicalCount);
+    }
+
+    int x = xBegin;
+    while(x < xEnd) {
+        const int gridX = noise.originX + x;
+        if(gridX < 0 || gridX >= static_cast<int>(noise.width)) {
+            // Beyond an edge, only ever a few cells of the halo
+            const std::uint64_t index = rowIndex + foldCoordinate(gridX, noise.width, noise.mirror);
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                const Scalar value = Scalar(2) * noise.random->uniform<Scalar>(noise.step, index, chem) - Scalar(1);
+                rows[chem][x - xBegin] += static_cast<Scalar>(noise.amplitude[chem]) * value;
+            }
+            ++x;
+            continue;
+        }
+
+        // The run of cells within the grid, drawn as a batch
+        const int runEnd = std::min(xEnd, static_cast<int>(noise.width) - noise.originX);
+        const std::size_t count = static_cast<std::size_t>(runEnd - x);
+        std::array<Scalar *, ChemicalCount> lanes;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            lanes[chem] = drawn.data() + chem * count;
+        }
+        noise.random->uniforms<Scalar, ChemicalCount>(noise.step, rowIndex + static_cast<std::uint64_t>(gridX), count, lanes.data());
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            const Scalar amplitude = static_cast<Scalar>(noise.amplitude[chem]);
+            Scalar *row = rows[chem] + (x - xBegin);
+            for(std::size_t i = 0; i < count; ++i) {
+                row[i] += amplitude * (Scalar(2) * lanes[chem][i] - Scalar(1));
+            }
+        }
+        x = runEnd;
+    }
+}
+
+/**
+ * Adds cells [xBegin, xEnd) of rows [yBegin, yEnd) of the planes to a reduction, decoded to Scalar when they are
+ * stored narrower so the reduction sees what a step reads
+ */
+template <typename Precision, unsigned int ChemicalCount>
+void reduceRows(const typename Precision::Storage *const *planes, std::size_t stride, int yBegin, int yEnd, int xBegin, int xEnd,
+                const RowReduction &reduction) {
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+    using Batch = simd::NativeBatch<Scalar>;
+    if(xEnd <= xBegin) {
+        return;
+    }
+
+    const std::size_t count = static_cast<std::size_t>(xEnd - xBegin);
+    thread_local std::vector<Scalar> decoded;
+    if constexpr(!std::is_same<Scalar, Storage>::value) {
+        if(decoded.size() < count) {
+            decoded.resize(count);
+        }
+    }
+
+    for(int y = yBegin; y < yEnd; ++y) {
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            const Storage *stored = planes[chem] + y * static_cast<std::ptrdiff_t>(stride) + xBegin;
+            const Scalar *values;
+            if constexpr(std::is_same<Scalar, Storage>::value) {
+                values = stored;
+            } else {
+                Precision::Codec::decodeRow(stored, decoded.data(), count);
+                values = decoded.data();
+            }
+
+            if(reduction.sums) {
+                Batch sum = Batch::broadcast(Scalar(0));
+                std::size_t x = 0;
+                for(; x + Batch::Lanes <= count; x += Batch::Lanes) {
+                    sum = sum + Batch::load(values + x);
+                }
+                double total = horizontalSum<Batch, Scalar>(sum);
+                for(; x < count; ++x) {
+                    total += static_cast<double>(values[x]);
+                }
+                reduction.sums[chem] += total;
+            }
+            if(reduction.hash) {
+                std::uint64_t hash = 0;
+                for(std::size_t x = 0; x < count; ++x) {
+                    hash += hashCell(values[x], chem, reduction.originX + xBegin + static_cast<int>(x), reduction.originY + y);
+                }
+                *reduction.hash += hash;
+            }
+        }
+    }
+}
+
+/**
+ * Fuses the classic stencil with a reaction (see Reactions.hpp) so each cell is read once and written once per step,
+ * a full register of cells at a time. The reaction is a template parameter so its arithmetic is inlined into the loop.
+ * Gives exactly the results of ClassicConvolution and the reaction's StaticReactionModel.
+ * @tparam Reaction the reaction to step
+ */
+template <typename Reaction>
+struct StencilKernel {
+    using Scalar = typename Reaction::Scalar;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+
+    ClassicStencil<Scalar> stencil;
+    Reaction reaction;
+
+    /**
+     * Steps cells [xBegin, xEnd) of row y. Coordinates may be negative to step cells in the halo of a tile.
+     * @param src the input planes, one per chemical, each with rows stride values apart
+     * @param dst the output planes, laid out like src
+     * @return the largest change of any concentration in the row
+     */
+    Scalar row(const Scalar *const *src, Scalar *const *dst, std::size_t stride, int y, int xBegin, int xEnd) const {
+        const std::ptrdiff_t offset = y * static_cast<std::ptrdiff_t>(stride);
+        const Scalar *above[ChemicalCount], *at[ChemicalCount], *below[ChemicalCount];
+        Scalar *out[ChemicalCount];
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            at[chem] = src[chem] + offset;
+            above[chem] = at[chem] - stride;
+            below[chem] = at[chem] + stride;
+            out[chem] = dst[chem] + offset;
+        }
+
+        return row(above, at, below, out, xBegin, xEnd);
+    }
+
+    /**
+     * Steps cells [xBegin, xEnd) of a row given the rows above, at and below it for each chemical
+     * @return the largest change of any concentration in the row
+     */
+    Scalar row(const Scalar *const *above, const Scalar *const *at, const Scalar *const *below, Scalar *const *out,
+               int xBegin, int xEnd) const {
+        using Batch = simd::NativeBatch<Scalar>;
+        using Single = simd::ScalarBatch<Scalar>;
+
+        Batch change = Batch::broadcast(Scalar(0));
+        int x = xBegin;
+        for(; x + static_cast<int>(Batch::Lanes) <= xEnd; x += Batch::Lanes) {
+            change = max(change, cells<Batch>(above, at, below, out, x));
+        }
+        Single remainder = Single::broadcast(Scalar(0));
+        for(; x < xEnd; ++x) {
+            remainder = max(remainder, cells<Single>(above, at, below, out, x));
+        }
+
+        return std::max(horizontalMax<Batch, Scalar>(change), remainder.v);
+    }
+
+private:
+    /// Steps a batch of cells and returns the largest change of any concentration in each lane
+    template <typename Batch>
+    inline Batch cells(const Scalar *const *above, const Scalar *const *at, const Scalar *const *below,
+                       Scalar *const *out, int x) const {
+        std::array<Batch, ChemicalCount> conc, conv, next;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            conv[chem] = stencil.template apply<Batch>(above[chem], at[chem], below[chem], x);
+            conc[chem] = Batch::load(at[chem] + x);
+        }
+
+        reaction.react(conc, conv, next);
+
+        Batch change = Batch::broadcast(Scalar(0));
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            next[chem].store(out[chem] + x);
+            change = max(change, max(next[chem] - conc[chem], conc[chem] - next[chem]));
+        }
+        return change;
+    }
+};
+
+/// The fused Gray-Scott kernel, mirroring GrayScottModel
+template <typename Scalar = double>
+using GrayScottKernel = StencilKernel<GrayScottReaction<Scalar>>;
+
+/**
+ * Steps rows [yBegin, yEnd), cells [xBegin, xEnd) of each, with a kernel computed in Scalar on planes stored as
+ * Storage. When the two differ each source row is decoded once into a rolling window of three rows, the kernel is run
+ * on the window and the result encoded back, so narrow storage costs a conversion per cell rather than per stencil tap.
+ * @tparam Precision the ScalarPrecision of the planes
+ * @tparam Kernel a kernel with row functions like GrayScottKernel
+ * @param reduction if not null, each row written is added to it while it is still in cache, see reduceRows
+ * @param noise if not null, added to each row before it is written, see RowNoise
+ * @return the largest change of any concentration in the rows, before any noise
+ */
+template <typename Precision, typename Kernel>
+typename Precision::Scalar stepRows(const Kernel &kernel, const typename Precision::Storage *const *src, typename Precision::Storage *const *dst,
+              std::size_t stride, int yBegin, int yEnd, int xBegin, int xEnd, const RowReduction *reduction = nullptr,
+              const RowNoise *noise = nullptr) {
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+    using Codec = typename Precision::Codec;
+    constexpr unsigned int ChemicalCount = Kernel::ChemicalCount;
+
+    Scalar change = 0;
+    if constexpr(std::is_same<Scalar, Storage>::value) {
+        for(int y = yBegin; y < yEnd; ++y) {
+            change = std::max(change, kernel.row(src, dst, stride, y, xBegin, xEnd));
+            if(noise) {
+                std::array<Scalar *, ChemicalCount> rows;
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    rows[chem] = dst[chem] + y * static_cast<std::ptrdiff_t>(stride) + xBegin;
+                }
+                addNoise<Scalar, ChemicalCount>(rows.data(), y, xBegin, xEnd, *noise);
+            }
+            if(reduction) {
+                reduceRows<Precision, ChemicalCount>(dst, stride, y, y + 1, xBegin, xEnd, *reduction);
+            }
+        }
+    } else {
+        if(yEnd <= yBegin || xEnd <= xBegin) {
+            return change;
+        }
+
+        // The window covers [xBegin - 1, xEnd + 1), so cell x of the row is at x - xBegin + 1 in it
+        const std::size_t count = static_cast<std::size_t>(xEnd - xBegin) + 2;
+        const std::size_t rowLength = simd::paddedLength<Scalar>(count);
+
+        // Only grows, so each thread allocates once for the largest row it steps
+        thread_local std::vector<Scalar> scratch;
+        if(scratch.size() < rowLength * 4 * ChemicalCount) {
+            scratch.resize(rowLength * 4 * ChemicalCount);
+        }
+
+        auto decode = [&](Scalar *window, unsigned int chem, int y) {
+            Codec::decodeRow(src[chem] + y * static_cast<std::ptrdiff_t>(stride) + xBegin - 1, window, count);
+        };
+
+        std::array<std::array<Scalar *, 3>, ChemicalCount> window;
+        std::array<Scalar *, ChemicalCount> out;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int row = 0; row < 3; ++row) {
+                window[chem][row] = scratch.data() + (chem * 4 + row) * rowLength;
+            }
+            out[chem] = scratch.data() + (chem * 4 + 3) * rowLength;
+            decode(window[chem][0], chem, yBegin - 1);
+            decode(window[chem][1], chem, yBegin);
+        }
+
+        for(int y = yBegin; y < yEnd; ++y) {
+            std::array<const Scalar *, ChemicalCount> above, at, below;
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                decode(window[chem][2], chem, y + 1);
+                above[chem] = window[chem][0];
+                at[chem] = window[chem][1];
+                below[chem] = window[chem][2];
+            }
+
+            change = std::max(change, kernel.row(above.data(), at.data(), below.data(), out.data(), 1, static_cast<int>(count) - 1));
+            if(noise) {
+                std::array<Scalar *, ChemicalCount> rows;
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    rows[chem] = out[chem] + 1;
+                }
+                addNoise<Scalar, ChemicalCount>(rows.data(), y, xBegin, xEnd, *noise);
+            }
+
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                Codec::encodeRow(out[chem] + 1, dst[chem] + y * static_cast<std::ptrdiff_t>(stride) + xBegin, count - 2);
+                // Slide the window down a row
+                std::swap(window[chem][0], window[chem][1]);
+                std::swap(window[chem][1], window[chem][2]);
+            }
+            if(reduction) {
+                reduceRows<Precision, ChemicalCount>(dst, stride, y, y + 1, xBegin, xEnd, *reduction);
+            }
+        }
+    }
+    return change;
+}
+
+/**
+ * Steps a band of rows of a tile, the unit ReactionDiffusion hands out to its threads. Dispatch is virtual once per
+ * band, and statically typed within it.
+ * @tparam Precision the ScalarPrecision of the planes
+ */
+template <typename Precision>
+class AbstractRowKernel {
+public:
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+
+    /// See stepRows
+    virtual Scalar stepRows(const Storage *const *src, Storage *const *dst, std::size_t stride,
+                            int yBegin, int yEnd, int xBegin, int xEnd, const RowReduction *reduction, const RowNoise *noise) const = 0;
+    virtual ~AbstractRowKernel()= default;
+};
+
+/**
+ * An AbstractRowKernel for a kernel like StencilKernel
+ * @tparam Precision the ScalarPrecision of the planes
+ * @tparam Kernel the kernel, computed in Precision::Scalar
+ */
+template <typename Precision, typename Kernel>
+class RowKernel : public AbstractRowKernel<Precision> {
+public:
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+
+    explicit RowKernel(const Kernel &kernel) : kernel(kernel) {}
+
+    Scalar stepRows(const Storage *const *src, Storage *const *dst, std::size_t stride,
+                    int yBegin, int yEnd, int xBegin, int xEnd, const RowReduction *reduction, const RowNoise *noise) const override {
+        return ::stepRows<Precision>(kernel, src, dst, stride, yBegin, yEnd, xBegin, xEnd, reduction, noise);
+    }
+
+private:
+    Kernel kernel;
+};
+
+#endif //REACTIONDIFFUSION2_KERNELS_HPP
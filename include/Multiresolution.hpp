@@ -0,0 +1,247 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_MULTIRESOLUTION_HPP
+#define REACTIONDIFFUSION2_MULTIRESOLUTION_HPP
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Convolution.hpp"
+#include "Profiler.hpp"
+#include "ReactionDiffusion.hpp"
+#include "ReactionModel.hpp"
+#include "Seeders.hpp"
+
+/// The layout of a grid with half the cells along each side of the given one, rounded up, tiled and bounded the same
+inline GridLayout coarsenedLayout(const GridLayout &layout) {
+    GridLayout coarse = layout;
+    coarse.width = (layout.width + 1) / 2;
+    coarse.height = (layout.height + 1) / 2;
+    return coarse;
+}
+
+/**
+ * Restricts a grid onto one with half the cells along each side (see coarsenedLayout), each coarse cell the mean of
+ * the 2x2 fine cells it covers, or of those of them within the grid at an odd edge
+ */
+template <unsigned int ChemicalCount, typename Precision>
+void restrictGrid(const ReactionState<ChemicalCount, Precision> &fine, ReactionState<ChemicalCount, Precision> &coarse) {
+    using Scalar = typename Precision::Scalar;
+    const unsigned int width = fine.getWidth();
+    std::vector<Scalar> upper(width), lower(width), out(coarse.getWidth());
+
+    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+        for(unsigned int y = 0; y < coarse.getHeight(); ++y) {
+            const unsigned int fineY = 2 * y;
+            fine.copyRow(chem, fineY, upper.data());
+            const bool pair = fineY + 1 < fine.getHeight();
+            if(pair) {
+                fine.copyRow(chem, fineY + 1, lower.data());
+            }
+
+            for(unsigned int x = 0; x < coarse.getWidth(); ++x) {
+                const unsigned int fineX = 2 * x;
+                const unsigned int right = std::min(fineX + 1, width - 1);
+                Scalar sum = upper[fineX] + upper[right];
+                if(pair) {
+                    sum += lower[fineX] + lower[right];
+                }
+                // A lone column at an odd edge is counted twice, which leaves its mean as it is
+                out[x] = sum / Scalar(pair ? 4 : 2);
+            }
+            coarse.setRow(chem, y, out.data());
+        }
+    }
+}
+
+/**
+ * Prolongs a grid onto one with twice the cells along each side (less one at an odd edge, see coarsenedLayout) by
+ * bilinear interpolation between the centres of the coarse cells, holding the edge cells' values beyond them
+ */
+template <unsigned int ChemicalCount, typename Precision>
+void prolongGrid(const ReactionState<ChemicalCount, Precision> &coarse, ReactionState<ChemicalCount, Precision> &fine) {
+    using Scalar = typename Precision::Scalar;
+    const unsigned int coarseWidth = coarse.getWidth();
+    const unsigned int coarseHeight = coarse.getHeight();
+    std::vector<Scalar> near(coarseWidth), far(coarseWidth), blended(coarseWidth), out(fine.getWidth());
+
+    // A fine cell lies a quarter of a coarse cell from the centre of the coarse cell it is in, towards the neighbour
+    // on its side, so it takes 3/4 of the one and 1/4 of the other
+    auto neighbour = [](unsigned int fineCoordinate, unsigned int size) {
+        const unsigned int coarseCoordinate = fineCoordinate / 2;
+        if(fineCoordinate % 2 == 0) {
+            return coarseCoordinate == 0 ? 0u : coarseCoordinate - 1;
+        }
+        return std::min(coarseCoordinate + 1, size - 1);
+    };
+
+    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+        for(unsigned int y = 0; y < fine.getHeight(); ++y) {
+            coarse.copyRow(chem, y / 2, near.data());
+            coarse.copyRow(chem, neighbour(y, coarseHeight), far.data());
+            for(unsigned int x = 0; x < coarseWidth; ++x) {
+                blended[x] = Scalar(0.75) * near[x] + Scalar(0.25) * far[x];
+            }
+            for(unsigned int x = 0; x < fine.getWidth(); ++x) {
+                out[x] = Scalar(0.75) * blended[x / 2] + Scalar(0.25) * blended[neighbour(x, coarseWidth)];
+            }
+            fine.setRow(chem, y, out.data());
+        }
+    }
+}
+
+/// Seeds a grid with a copy of another of the same size
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class StateCopySeeder : public AbstractSeeder<ChemicalCount, Precision> {
+public:
+    explicit StateCopySeeder(const ReactionState<ChemicalCount, Precision> &source) : source(source) {}
+
+    void seed(ReactionState<ChemicalCount, Precision> &state) override {
+        std::vector<typename Precision::Storage> row(state.getWidth());
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < state.getHeight(); ++y) {
+                source.copyStoredRow(chem, y, row.data());
+                state.setStoredRow(chem, y, row.data());
+            }
+        }
+    }
+
+private:
+    const ReactionState<ChemicalCount, Precision> &source;
+};
+
+/**
+ * Warms a freshly seeded ReactionDiffusion up on coarser grids before it takes a step at full resolution. The grid is
+ * restricted levels times, halving it along each side each time, then stepped at the coarsest level, prolonged up a
+ * level and stepped again, until it is prolonged back into the full grid.
+ *
+ * A stencil over cells twice as far apart sees four times the Laplacian, so each level's stencil weights are a quarter
+ * of the finer level's. That keeps the diffusion the same per unit of time, and the reaction is unchanged, so a step
+ * on any level advances the same time as a step of the full grid and the pattern grows as it would have there. It
+ * costs a quarter as much per level down. Features need a few cells of the coarsest level to be resolved at all, and
+ * the coarser a level the more slowly fronts advance across it, so one or two levels below the full grid are as many as
+ * pay off. The steps on finer levels sharpen what is blurred by the interpolation.
+ * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision of the simulation
+ */
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class MultiresolutionWarmStart {
+public:
+    using Scalar = typename Precision::Scalar;
+    using ModelFactory = std::function<std::unique_ptr<AbstractReactionModel<ChemicalCount, Scalar>>()>;
+
+    /// Levels stop coarsening before either side would be shorter than this
+    static constexpr unsigned int MinSide = 16;
+
+    /**
+     * @param stencil the weights of the classic stencil the full grid is stepped with
+     * @param makeModel makes a reaction model like the full grid's for each level
+     * @param levels how many times to halve the grid, fewer if it gets too small
+     * @param stepsPerLevel steps to take on each coarse level
+     */
+    MultiresolutionWarmStart(const ClassicStencil<Scalar> &stencil, ModelFactory makeModel, unsigned int levels,
+                             unsigned int stepsPerLevel)
+            : stencil(stencil), makeModel(std::move(makeModel)), levels(levels), stepsPerLevel(stepsPerLevel) {}
+
+    /**
+     * Warms up the current state of a simulation, leaving it at the warmed up state with its step count advanced by the
+     * steps taken on the coarse levels
+     * @return the number of coarse levels stepped
+     */
+    unsigned int warm(ReactionDiffusion<ChemicalCount, Precision> &simulation) const {
+        // The restricted grids, finest first
+        std::vector<std::unique_ptr<ReactionState<ChemicalCount, Precision>>> grids;
+        const ReactionState<ChemicalCount, Precision> *finer = &simulation.getState();
+        for(unsigned int level = 0; level < levels; ++level) {
+            const GridLayout layout = coarsenedLayout(finer->getLayout());
+            if(layout.width < MinSide || layout.height < MinSide) {
+                break;
+            }
+            grids.push_back(std::make_unique<ReactionState<ChemicalCount, Precision>>(layout));
+            grids.back()->setBoundaryValues(finer->getBoundaryValues());
+            {
+                REACTIONDIFFUSION2_PROFILE_SCOPE("restrict", static_cast<double>(finer->getWidth()) * finer->getHeight());
+                restrictGrid(*finer, *grids.back());
+            }
+            finer = grids.back().get();
+        }
+        if(grids.empty()) {
+            return 0;
+        }
+
+        const unsigned long long startingStep = simulation.getStepCount();
+        for(unsigned int level = static_cast<unsigned int>(grids.size()); level > 0; --level) {
+            ReactionState<ChemicalCount, Precision> &grid = *grids[level - 1];
+            const Scalar scale = Scalar(1) / static_cast<Scalar>(1u << (2 * level));
+            auto convolution = std::make_unique<ClassicConvolution<ChemicalCount, Precision>>(stencil.center * scale, stencil.edge * scale,
+                                                                                             stencil.corner * scale);
+            ReactionDiffusion<ChemicalCount, Precision> coarse(grid.getLayout(), std::move(convolution),
+                                                               std::make_unique<StateCopySeeder<ChemicalCount, Precision>>(grid),
+                                                               makeModel(), simulation.getThreadCount());
+            coarse.setBoundaryValues(grid.getBoundaryValues());
+            coarse.setActivityThreshold(simulation.getActivityThreshold());
+            coarse.update(stepsPerLevel);
+
+            REACTIONDIFFUSION2_PROFILE_SCOPE("prolong", static_cast<double>(grid.getWidth()) * grid.getHeight() * 4);
+            if(level > 1) {
+                prolongGrid(coarse.getState(), *grids[level - 2]);
+            } else {
+                // Straight into the full grid, which may be too large to hold a second copy of
+                simulation.seedReaction(std::make_unique<ProlongingSeeder>(coarse.getState(), simulation.getState()),
+                                        startingStep + grids.size() * stepsPerLevel);
+            }
+        }
+        return static_cast<unsigned int>(grids.size());
+    }
+
+private:
+    /// Prolongs a coarse grid into the grid it seeds, keeping the outer ring the grid had before if that is fixed
+    class ProlongingSeeder : public AbstractSeeder<ChemicalCount, Precision> {
+    public:
+        ProlongingSeeder(const ReactionState<ChemicalCount, Precision> &coarse, const ReactionState<ChemicalCount, Precision> &before)
+                : coarse(coarse) {
+            if(before.getLayout().boundary == BoundaryCondition::FixedRing) {
+                forRing(before, [&](unsigned int x, unsigned int y) {
+                    ring.push_back(before.getConcentration(x, y));
+                });
+            }
+        }
+
+        void seed(ReactionState<ChemicalCount, Precision> &state) override {
+            prolongGrid(coarse, state);
+            auto cell = ring.begin();
+            forRing(state, [&](unsigned int x, unsigned int y) {
+                if(cell != ring.end()) {
+                    state.setConcentration(x, y, *cell++);
+                }
+            });
+        }
+
+    private:
+        /// Calls visit(x, y) on each cell of the outer ring of a grid, the same order every time
+        template <typename Visit>
+        static void forRing(const ReactionState<ChemicalCount, Precision> &state, Visit visit) {
+            const unsigned int width = state.getWidth();
+            const unsigned int height = state.getHeight();
+            for(unsigned int x = 0; x < width; ++x) {
+                visit(x, 0u);
+                visit(x, height - 1);
+            }
+            for(unsigned int y = 1; y + 1 < height; ++y) {
+                visit(0u, y);
+                visit(width - 1, y);
+            }
+        }
+
+        const ReactionState<ChemicalCount, Precision> &coarse;
+        std::vector<CellConcentration<ChemicalCount, Scalar>> ring;
+    };
+
+    ClassicStencil<Scalar> stencil;
+    ModelFactory makeModel;
+    unsigned int levels;
+    unsigned int stepsPerLevel;
+};
+
+#endif //REACTIONDIFFUSION2_MULTIRESOLUTION_HPP
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_PALETTE_HPP
+#define REACTIONDIFFUSION2_PALETTE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "Util.hpp"
+
+/**
+ * Lookup table for the colouring of CellConcentration::toColor.
+ * Each chemical always has the same HSL colour and only its alpha follows the concentration. The colour of a cell is
+ * the sum of each chemical's packed RRGGBBAA colour with that alpha, divided by the chemical count, so it only depends
+ * on the sum of the alphas: a cell costs a multiply per chemical and one lookup of its pixel, rather than an HSL
+ * conversion per chemical. Rows are done a column of chemicals at a time so the alphas vectorise.
+ * @tparam ChemicalCount the number of chemicals
+ */
+template <unsigned int ChemicalCount>
+class Palette {
+public:
+    /// Alphas are bytes, so this is the most the alphas of a cell can add up to
+    static constexpr std::uint32_t MaxAlphaTotal = 255 * ChemicalCount;
+
+    Palette() {
+        unsigned long long base = 0;
+        for(unsigned int i = 0; i < ChemicalCount; ++i) {
+            unsigned int hue = ((i + 4) * 41);
+            Rgba col = colorFromHSL(hue, 0.70, 0.5);
+
+            alphas[i] = col.a;
+            multipliers[i] = i; // incorporating i can give cool effects
+            maxAlphas[i] = static_cast<double>(col.a) * i;
+
+            col.a = 0;
+            base += col.toInteger();
+        }
+
+        for(std::uint32_t total = 0; total <= MaxAlphaTotal; ++total) {
+            colors[total] = Rgba(static_cast<std::uint32_t>((base + total)/ChemicalCount));
+            const std::uint8_t bytes[4] = {colors[total].r, colors[total].g, colors[total].b, colors[total].a};
+            std::memcpy(&pixels[total], bytes, sizeof(bytes));
+        }
+    }
+
+    /// The palette shared by every grid with this many chemicals
+    static const Palette &get() {
+        static const Palette palette;
+        return palette;
+    }
+
+    /// The alpha chemical chem contributes at the given concentration
+    template <typename Scalar>
+    inline std::uint32_t alpha(unsigned int chem, Scalar conc) const {
+        return alpha(conc, alphas[chem], multipliers[chem], maxAlphas[chem]);
+    }
+
+    /// The colour of a cell
+    template <typename Scalar>
+    inline Rgba color(const std::array<Scalar, ChemicalCount> &conc) const {
+        std::uint32_t alphaTotal = 0;
+        for(unsigned int i = 0; i < ChemicalCount; ++i) {
+            alphaTotal += alpha(i, conc[i]);
+        }
+        return colors[alphaTotal];
+    }
+
+    /// Adds the alpha of chemical chem at each of count concentrations to alphaTotals
+    template <typename Scalar>
+    void addAlphas(unsigned int chem, const Scalar *conc, std::uint32_t *alphaTotals, std::size_t count) const {
+        const std::uint8_t alphaScale = alphas[chem];
+        const double multiplier = multipliers[chem];
+        const double maxAlpha = maxAlphas[chem];
+        for(std::size_t i = 0; i < count; ++i) {
+            alphaTotals[i] += alpha(conc[i], alphaScale, multiplier, maxAlpha);
+        }
+    }
+
+    /**
+     * Writes the RGBA pixel for each of count alpha totals to out.
+     * @return non-zero if any pixel differs from what was in out before
+     */
+    std::uint32_t writePixels(const std::uint32_t *alphaTotals, std::uint8_t *out, std::size_t count) const {
+        std::uint32_t changed = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            std::uint32_t previous;
+            std::memcpy(&previous, out + i * 4, sizeof(previous));
+            changed |= previous ^ pixels[alphaTotals[i]];
+            std::memcpy(out + i * 4, &pixels[alphaTotals[i]], sizeof(previous));
+        }
+        return changed;
+    }
+
+private:
+    template <typename Scalar>
+    static inline std::uint32_t alpha(Scalar conc, std::uint8_t alphaScale, double multiplier, double maxAlpha) {
+        // Same arithmetic as the original per cell colouring, clamped first so the conversion is always defined
+        // (NaN becomes 0). Alphas past 255 wrap around, as the narrowing conversion in the original colouring did
+        double value = conc * alphaScale * multiplier;
+        value = std::min(maxAlpha, std::max(0.0, value));
+        return static_cast<std::uint32_t>(value) & 0xFFu;
+    }
+
+    std::array<std::uint8_t, ChemicalCount> alphas;
+    std::array<double, ChemicalCount> multipliers;
+    std::array<double, ChemicalCount> maxAlphas;
+    std::array<Rgba, MaxAlphaTotal + 1> colors;
+    /// colors as they are laid out in an RGBA image
+    std::array<std::uint32_t, MaxAlphaTotal + 1> pixels;
+};
+
+#endif //REACTIONDIFFUSION2_PALETTE_HPP
@@ -0,0 +1,298 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_PARAMETERSWEEP_HPP
+#define REACTIONDIFFUSION2_PARAMETERSWEEP_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "GridArena.hpp"
+#include "Kernels.hpp"
+#include "Precision.hpp"
+#include "Profiler.hpp"
+#include "ReactionState.hpp"
+#include "Reactions.hpp"
+#include "Seeders.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+/// What one instance of a ParameterSweep looks like, over the interior cells of its grid
+struct SweepSummary {
+    double feed, kill, diffusionA, diffusionB;
+    double meanA, meanB;
+    double minB, maxB;
+    /// The standard deviation of B, near 0 when the instance is uniform and large when it holds a pattern
+    double deviationB;
+    /// The largest change of any concentration in the last step, 0 once the pattern has stopped moving
+    double change;
+};
+
+/**
+ * Steps many small Gray-Scott simulations of the same size together, each with its own parameters, to map pattern
+ * regimes. Instances are interleaved a register at a time: each cell of a group holds the same cell of Lanes instances
+ * side by side, so a vector operation steps one cell of every instance in the group and the parameters are vectors
+ * too. Groups are independent, so a thread takes a group through every step of an update without waiting on the
+ * others. Each instance does the arithmetic of a ReactionDiffusion with a ClassicConvolution and the same
+ * BasicGrayScottModel in the same order, so the two agree exactly unless the compiler fuses multiply-adds differently.
+ * @tparam ScalarType the type concentrations are computed and stored in
+ */
+template <typename ScalarType = double>
+class ParameterSweep {
+public:
+    using Scalar = ScalarType;
+    using Precision = ScalarPrecision<Scalar>;
+    using Batch = simd::NativeBatch<Scalar>;
+    static constexpr unsigned int Lanes = Batch::Lanes;
+
+    /**
+     * @param width cells across each instance's grid
+     * @param height cells down each instance's grid
+     * @param instances the parameters of each instance
+     * @param stencil the weights of the classic stencil, shared by every instance
+     */
+    ParameterSweep(unsigned int width, unsigned int height, const std::vector<GrayScottReaction<Scalar>> &instances,
+                   const ClassicStencil<Scalar> &stencil, std::unique_ptr<AbstractSeeder<2, Precision>> seeder,
+                   unsigned int threadCount = std::thread::hardware_concurrency())
+            : width(std::max(width, 3u)), height(std::max(height, 3u)), instances(instances), stencil(stencil),
+              groupCount((static_cast<unsigned int>(instances.size()) + Lanes - 1) / Lanes),
+              planeSize(static_cast<std::size_t>(this->width) * this->height * Lanes),
+              feed(groupCount * Lanes), kill(groupCount * Lanes), diffusionA(groupCount * Lanes),
+              diffusionB(groupCount * Lanes), change(groupCount * Lanes)
+    {
+        // Spare lanes of the last group repeat the last instance so they stay as well behaved as it is
+        for(std::size_t lane = 0; lane < feed.size(); ++lane) {
+            const GrayScottReaction<Scalar> &instance = instances.empty() ? GrayScottReaction<Scalar>()
+                                                        : instances[std::min(lane, instances.size() - 1)];
+            feed[lane] = instance.feed;
+            kill[lane] = instance.kill;
+            diffusionA[lane] = instance.dA;
+            diffusionB[lane] = instance.dB;
+        }
+
+        pool = std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount);
+        storage = static_cast<Scalar *>(GridArena::shared().allocate(storageBytes()));
+        seed(std::move(seeder));
+    }
+
+    ParameterSweep(const ParameterSweep &other)= delete;
+    ParameterSweep& operator=(const ParameterSweep &source)= delete;
+
+    ~ParameterSweep() {
+        GridArena::shared().release(storage, storageBytes());
+    }
+
+    /**
+     * Resets every instance to the background and seeds them all with the same pattern. Each group is written by a
+     * thread of the pool that steps them, so the first time its pages are touched is on that thread's NUMA node (see
+     * GridArena).
+     */
+    void seed(std::unique_ptr<AbstractSeeder<2, Precision>> seeder) {
+        ReactionState<2, Precision> pattern(GridLayout{width, height}, GrayScottReaction<Scalar>().background());
+        seeder->seed(pattern);
+
+        pool->parallelFor(groupCount, [&](unsigned int group) {
+            for(unsigned int y = 0; y < height; ++y) {
+                for(unsigned int x = 0; x < width; ++x) {
+                    const CellConcentration<2, Scalar> conc = pattern.getConcentration(x, y);
+                    for(unsigned int chem = 0; chem < 2; ++chem) {
+                        // Both buffers, so the fixed outer ring is right whichever is current
+                        std::fill_n(plane(group, 0, chem) + cell(x, y), Lanes, conc[chem]);
+                        std::fill_n(plane(group, 1, chem) + cell(x, y), Lanes, conc[chem]);
+                    }
+                }
+            }
+        });
+        std::fill(change.begin(), change.end(), Scalar(0));
+        current = 0;
+        stepCount = 0;
+    }
+
+    /// Advances every instance by the given number of steps
+    void update(unsigned int steps = 1) {
+        if(steps == 0) {
+            return;
+        }
+
+        REACTIONDIFFUSION2_PROFILE_SCOPE("sweep");
+        pool->parallelFor(groupCount, [&](unsigned int group) {
+            simd::FlushDenormals flush;
+            for(unsigned int step = 0; step < steps; ++step) {
+                const unsigned int src = (current + step) % 2;
+                // Only the last step measures its change, which is all the summary reports
+                if(step + 1 < steps) {
+                    stepGroup<false>(group, src);
+                } else {
+                    stepGroup<true>(group, src);
+                }
+            }
+        });
+        current = (current + steps) % 2;
+        stepCount += steps;
+    }
+
+    /// The concentrations of a cell of an instance
+    std::array<Scalar, 2> getConcentration(unsigned int instance, unsigned int x, unsigned int y) const {
+        const unsigned int group = instance / Lanes;
+        const std::size_t index = cell(x, y) + instance % Lanes;
+        return {plane(group, current, 0)[index], plane(group, current, 1)[index]};
+    }
+
+    /// Summarises every instance, in the order they were given
+    std::vector<SweepSummary> summarize() const {
+        std::vector<SweepSummary> summaries(instances.size());
+        pool->parallelFor(groupCount, [&](unsigned int group) {
+            const Scalar *a = plane(group, current, 0);
+            const Scalar *b = plane(group, current, 1);
+            const double cells = static_cast<double>(width - 2) * (height - 2);
+
+            for(unsigned int lane = 0; lane < Lanes && group * Lanes + lane < instances.size(); ++lane) {
+                const unsigned int instance = group * Lanes + lane;
+                double sumA = 0, sumB = 0, sumSquaresB = 0;
+                double minB = b[cell(1, 1) + lane], maxB = minB;
+                for(unsigned int y = 1; y < height - 1; ++y) {
+                    for(unsigned int x = 1; x < width - 1; ++x) {
+                        const double valueB = b[cell(x, y) + lane];
+                        sumA += a[cell(x, y) + lane];
+                        sumB += valueB;
+                        sumSquaresB += valueB * valueB;
+                        minB = std::min(minB, valueB);
+                        maxB = std::max(maxB, valueB);
+                    }
+                }
+
+                const double meanB = sumB / cells;
+                SweepSummary &summary = summaries[instance];
+                summary.feed = feed[instance];
+                summary.kill = kill[instance];
+                summary.diffusionA = diffusionA[instance];
+                summary.diffusionB = diffusionB[instance];
+                summary.meanA = sumA / cells;
+                summary.meanB = meanB;
+                summary.minB = minB;
+                summary.maxB = maxB;
+                summary.deviationB = std::sqrt(std::max(0.0, sumSquaresB / cells - meanB * meanB));
+                summary.change = change[instance];
+            }
+        });
+        return summaries;
+    }
+
+    unsigned int getInstanceCount() const {
+        return static_cast<unsigned int>(instances.size());
+    }
+
+    const GrayScottReaction<Scalar> &getInstance(unsigned int instance) const {
+        return instances[instance];
+    }
+
+    unsigned int getWidth() const {
+        return width;
+    }
+
+    unsigned int getHeight() const {
+        return height;
+    }
+
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+    /// The number of steps taken since the instances were last seeded
+    unsigned long long getStepCount() const {
+        return stepCount;
+    }
+
+private:
+    /// The offset of a cell's first lane within a plane
+    inline std::size_t cell(unsigned int x, unsigned int y) const {
+        return (static_cast<std::size_t>(y) * width + x) * Lanes;
+    }
+
+    /// Bytes of storage, both buffers of both chemicals for every group
+    inline std::size_t storageBytes() const {
+        return planeSize * 4 * groupCount * sizeof(Scalar);
+    }
+
+    inline Scalar *plane(unsigned int group, unsigned int buffer, unsigned int chem) const {
+        return storage + ((static_cast<std::size_t>(group) * 2 + buffer) * 2 + chem) * planeSize;
+    }
+
+    /**
+     * Steps the interior of every instance in a group from buffer src into the other one. The stencil and reaction
+     * are the arithmetic of ClassicStencil::apply and GrayScottReaction::react in the same order, with parameters
+     * loaded per lane rather than broadcast.
+     */
+    template <bool MeasureChange>
+    void stepGroup(unsigned int group, unsigned int src) {
+        const std::ptrdiff_t across = Lanes;
+        const std::ptrdiff_t down = static_cast<std::ptrdiff_t>(width) * Lanes;
+        const Scalar *inA = plane(group, src, 0);
+        const Scalar *inB = plane(group, src, 1);
+        Scalar *outA = plane(group, 1 - src, 0);
+        Scalar *outB = plane(group, 1 - src, 1);
+
+        const std::size_t lanes = static_cast<std::size_t>(group) * Lanes;
+        const Batch groupFeed = Batch::load(feed.data() + lanes);
+        const Batch groupKill = Batch::load(kill.data() + lanes);
+        const Batch groupDiffusionA = Batch::load(diffusionA.data() + lanes);
+        const Batch groupDiffusionB = Batch::load(diffusionB.data() + lanes);
+        const Batch killFeed = groupKill + groupFeed;
+        const Batch center = Batch::broadcast(stencil.center);
+        const Batch edge = Batch::broadcast(stencil.edge);
+        const Batch corner = Batch::broadcast(stencil.corner);
+        const Batch zero = Batch::broadcast(Scalar(0));
+        const Batch one = Batch::broadcast(Scalar(1));
+
+        auto convolve = [&](const Scalar *at) {
+            Batch edges = (Batch::load(at - across) + Batch::load(at + across)) + (Batch::load(at - down) + Batch::load(at + down));
+            Batch corners = (Batch::load(at - down - across) + Batch::load(at - down + across))
+                            + (Batch::load(at + down - across) + Batch::load(at + down + across));
+            return edges * edge + corners * corner + Batch::load(at) * center;
+        };
+
+        Batch largest = zero;
+        for(unsigned int y = 1; y < height - 1; ++y) {
+            for(std::size_t index = cell(1, y); index < cell(width - 1, y); index += Lanes) {
+                const Batch a = Batch::load(inA + index);
+                const Batch b = Batch::load(inB + index);
+                const Batch convA = convolve(inA + index);
+                const Batch convB = convolve(inB + index);
+                const Batch reaction = a * b * b;
+
+                const Batch newA = min(one, max(zero, a + (groupDiffusionA * convA - reaction + groupFeed * (one - a))));
+                const Batch newB = min(one, max(zero, b + (groupDiffusionB * convB + reaction - killFeed * b)));
+                newA.store(outA + index);
+                newB.store(outB + index);
+
+                if constexpr(MeasureChange) {
+                    largest = max(largest, max(max(newA - a, a - newA), max(newB - b, b - newB)));
+                }
+            }
+        }
+
+        if constexpr(MeasureChange) {
+            largest.store(change.data() + lanes);
+        }
+    }
+
+    unsigned int width, height;
+    std::vector<GrayScottReaction<Scalar>> instances;
+    ClassicStencil<Scalar> stencil;
+    unsigned int groupCount;
+    std::size_t planeSize;
+    /// Per instance parameters, padded to whole groups so each group loads them as a vector
+    std::vector<Scalar> feed, kill, diffusionA, diffusionB;
+    /// The largest change of each instance in the last step
+    std::vector<Scalar> change;
+    /// Two buffers of two planes per group
+    Scalar *storage = nullptr;
+    unsigned int current = 0;
+    unsigned long long stepCount = 0;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif //REACTIONDIFFUSION2_PARAMETERSWEEP_HPP
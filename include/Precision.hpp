@@ -0,0 +1,223 @@
+/**
+ * The scalar types the simulation can be built with. Values are computed in a Scalar type (double or float) and can be
+ * stored in a narrower Storage type to cut the memory each cell takes, which is what bounds the speed of the stencil.
+ * The storage types only cover [0, 1] sensibly (Fixed16) or to about three decimal digits (Half), which is enough for
+ * models that clamp their concentrations like Gray-Scott.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_PRECISION_HPP
+#define REACTIONDIFFUSION2_PRECISION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/// An IEEE 754 binary16 value, converted to and from float for arithmetic
+struct Half {
+    std::uint16_t bits;
+};
+
+/// A value in [0, 1] stored as a 16 bit fraction of 65535, values outside [0, 1] are clamped when stored
+struct Fixed16 {
+    std::uint16_t bits;
+};
+
+/**
+ * Converts between the storage type of a grid and the scalar type it is computed in.
+ * The general case is for storage that is itself a floating point type.
+ * @tparam Storage the type each value is stored as
+ */
+template <typename Storage>
+struct StorageCodec {
+    template <typename Scalar>
+    static inline Scalar decode(Storage value) {
+        return static_cast<Scalar>(value);
+    }
+
+    template <typename Scalar>
+    static inline Storage encode(Scalar value) {
+        return static_cast<Storage>(value);
+    }
+
+    template <typename Scalar>
+    static void decodeRow(const Storage *in, Scalar *out, std::size_t count) {
+        if constexpr(std::is_same<Scalar, Storage>::value) {
+            std::memcpy(out, in, count * sizeof(Scalar));
+        } else {
+            std::transform(in, in + count, out, [](Storage value) { return static_cast<Scalar>(value); });
+        }
+    }
+
+    template <typename Scalar>
+    static void encodeRow(const Scalar *in, Storage *out, std::size_t count) {
+        if constexpr(std::is_same<Scalar, Storage>::value) {
+            std::memcpy(out, in, count * sizeof(Scalar));
+        } else {
+            std::transform(in, in + count, out, [](Scalar value) { return static_cast<Storage>(value); });
+        }
+    }
+};
+
+template <>
+struct StorageCodec<Half> {
+    template <typename Scalar>
+    static inline Scalar decode(Half value) {
+#if defined(__F16C__)
+        return static_cast<Scalar>(_cvtsh_ss(value.bits));
+#else
+        return static_cast<Scalar>(toFloat(value.bits));
+#endif
+    }
+
+    template <typename Scalar>
+    static inline Half encode(Scalar value) {
+#if defined(__F16C__)
+        return {static_cast<std::uint16_t>(_cvtss_sh(static_cast<float>(value), _MM_FROUND_TO_NEAREST_INT))};
+#else
+        return {fromFloat(static_cast<float>(value))};
+#endif
+    }
+
+    template <typename Scalar>
+    static void decodeRow(const Half *in, Scalar *out, std::size_t count) {
+        std::size_t i = 0;
+#if defined(__F16C__)
+        if constexpr(std::is_same<Scalar, float>::value) {
+            for(; i + 8 <= count; i += 8) {
+                __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+                _mm256_storeu_ps(out + i, _mm256_cvtph_ps(packed));
+            }
+        }
+#endif
+        for(; i < count; ++i) {
+            out[i] = decode<Scalar>(in[i]);
+        }
+    }
+
+    template <typename Scalar>
+    static void encodeRow(const Scalar *in, Half *out, std::size_t count) {
+        std::size_t i = 0;
+#if defined(__F16C__)
+        if constexpr(std::is_same<Scalar, float>::value) {
+            for(; i + 8 <= count; i += 8) {
+                __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packed);
+            }
+        }
+#endif
+        for(; i < count; ++i) {
+            out[i] = encode(in[i]);
+        }
+    }
+
+    /// Software conversion for targets without F16C
+    static float toFloat(std::uint16_t bits) {
+        const std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000u) << 16;
+        const std::uint32_t exponent = (bits >> 10) & 0x1Fu;
+        const std::uint32_t mantissa = bits & 0x3FFu;
+
+        float magnitude;
+        if(exponent == 0) {
+            magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        } else if(exponent == 0x1F) {
+            magnitude = mantissa == 0 ? INFINITY : NAN;
+        } else {
+            magnitude = std::ldexp(static_cast<float>(mantissa | 0x400u), static_cast<int>(exponent) - 25);
+        }
+
+        std::uint32_t result;
+        std::memcpy(&result, &magnitude, sizeof(result));
+        result |= sign;
+        float value;
+        std::memcpy(&value, &result, sizeof(value));
+        return value;
+    }
+
+    /// Software conversion for targets without F16C, rounding to nearest even
+    static std::uint16_t fromFloat(float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+        const std::uint32_t magnitudeBits = bits & 0x7FFFFFFFu;
+
+        if(magnitudeBits == 0) {
+            return sign;
+        }
+        if(magnitudeBits >= 0x7F800000u) {
+            return static_cast<std::uint16_t>(sign | (magnitudeBits > 0x7F800000u ? 0x7E00u : 0x7C00u));
+        }
+        if(magnitudeBits >= 0x477FF000u) {
+            // Rounds to a value beyond the largest half
+            return static_cast<std::uint16_t>(sign | 0x7C00u);
+        }
+
+        // Scale so that the half's least significant bit has a value of one and let the FPU round to nearest even
+        float magnitude;
+        std::memcpy(&magnitude, &magnitudeBits, sizeof(magnitude));
+        int exponent;
+        std::frexp(magnitude, &exponent);
+        const int shift = std::max(exponent - 11, -24);
+        const std::uint32_t units = static_cast<std::uint32_t>(std::nearbyint(std::ldexp(magnitude, -shift)));
+
+        if(shift == -24) {
+            // Subnormal, which becomes normal if rounding carries into bit 10
+            return static_cast<std::uint16_t>(sign | units);
+        }
+        // units is in [2^10, 2^11], a carry to 2^11 moves up an exponent, which the addition handles
+        return static_cast<std::uint16_t>(sign | ((static_cast<std::uint32_t>(shift + 25) << 10) + units - 0x400u));
+    }
+};
+
+template <>
+struct StorageCodec<Fixed16> {
+    template <typename Scalar>
+    static inline Scalar decode(Fixed16 value) {
+        return static_cast<Scalar>(value.bits) * (Scalar(1) / Scalar(65535));
+    }
+
+    template <typename Scalar>
+    static inline Fixed16 encode(Scalar value) {
+        const Scalar clamped = std::min(Scalar(1), std::max(Scalar(0), value));
+        return {static_cast<std::uint16_t>(clamped * Scalar(65535) + Scalar(0.5))};
+    }
+
+    template <typename Scalar>
+    static void decodeRow(const Fixed16 *in, Scalar *out, std::size_t count) {
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i] = decode<Scalar>(in[i]);
+        }
+    }
+
+    template <typename Scalar>
+    static void encodeRow(const Scalar *in, Fixed16 *out, std::size_t count) {
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i] = encode(in[i]);
+        }
+    }
+};
+
+/**
+ * Picks the types a simulation is computed and stored in.
+ * @tparam ScalarType the type every value is computed in, double or float
+ * @tparam StorageType the type the grid stores each value as, the scalar type itself, Half or Fixed16
+ */
+template <typename ScalarType, typename StorageType = ScalarType>
+struct ScalarPrecision {
+    using Scalar = ScalarType;
+    using Storage = StorageType;
+    using Codec = StorageCodec<StorageType>;
+};
+
+using DoublePrecision = ScalarPrecision<double>;
+using SinglePrecision = ScalarPrecision<float>;
+using HalfPrecision = ScalarPrecision<float, Half>;
+using Fixed16Precision = ScalarPrecision<float, Fixed16>;
+
+#endif //REACTIONDIFFUSION2_PRECISION_HPP
@@ -0,0 +1,296 @@
+/**
+ * Scoped timers and counters on the hot paths, compiled in when REACTIONDIFFUSION2_PROFILING is defined (the
+ * REACTIONDIFFUSION_PROFILING CMake option) and to nothing otherwise. The Profiler always exists, so code that reads it
+ * builds either way and simply finds nothing recorded.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_PROFILER_HPP
+#define REACTIONDIFFUSION2_PROFILER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// The time spent in one named phase, over every thread, and the work done in it
+struct ProfilePhase {
+    const char *name = "";
+    unsigned long long calls = 0;
+    double seconds = 0;
+    /// Cells processed and the least bytes that had to be read and written for them, as each scope reported
+    double cells = 0;
+    double bytes = 0;
+};
+
+/**
+ * Collects the scopes and counters recorded by every thread. Each thread records into a log of its own, found through
+ * a thread local pointer and only locked against readers, so recording never contends with other threads. Phases are
+ * identified by the address of their name, which is always a string literal. Totals per phase are always kept; with
+ * tracing on, every scope is also kept as an event for a Chrome trace, up to a fixed number per thread.
+ */
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static Profiler &instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    /// Whether the scopes on the hot paths were compiled in
+    static constexpr bool isCompiledIn() {
+#ifdef REACTIONDIFFUSION2_PROFILING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    Profiler(const Profiler &other)= delete;
+    Profiler& operator=(const Profiler &source)= delete;
+
+    /**
+     * Starts or stops keeping events for writeChromeTrace
+     * @param eventsPerThread the most events kept for each thread, the buffer for them is allocated on the thread's
+     * first event so recording itself never allocates
+     */
+    void setTracing(bool tracing, std::size_t eventsPerThread = DefaultEventsPerThread) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->eventsPerThread = eventsPerThread;
+        this->tracing.store(tracing, std::memory_order_relaxed);
+    }
+
+    bool isTracing() const {
+        return tracing.load(std::memory_order_relaxed);
+    }
+
+    /// Names the calling thread in traces
+    void nameThread(const char *name) {
+        ThreadLog &log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.name = name;
+    }
+
+    /// Records a scope of the calling thread that ran from start to end
+    void record(const char *name, Clock::time_point start, Clock::time_point end, double cells, double bytes) {
+        ThreadLog &log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        ProfilePhase &phase = log.phase(name);
+        ++phase.calls;
+        phase.seconds += std::chrono::duration<double>(end - start).count();
+        phase.cells += cells;
+        phase.bytes += bytes;
+        if(isTracing()) {
+            log.add(Event{name, start, end - start, 0, cells, bytes, 'X'}, eventsPerThread);
+        }
+    }
+
+    /// Records the value of a counter at this moment, only kept while tracing
+    void counter(const char *name, double value) {
+        if(!isTracing()) {
+            return;
+        }
+        ThreadLog &log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.add(Event{name, Clock::now(), Clock::duration::zero(), value, 0, 0, 'C'}, eventsPerThread);
+    }
+
+    /// The totals of every phase so far, summed over the threads, in the order they were first recorded
+    std::vector<ProfilePhase> getPhases() const {
+        std::vector<ProfilePhase> phases;
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const auto &log : logs) {
+            std::lock_guard<std::mutex> logLock(log->mutex);
+            for(const ProfilePhase &phase : log->phases) {
+                auto found = std::find_if(phases.begin(), phases.end(), [&](const ProfilePhase &other) {
+                    return std::strcmp(other.name, phase.name) == 0;
+                });
+                if(found == phases.end()) {
+                    phases.push_back(phase);
+                } else {
+                    found->calls += phase.calls;
+                    found->seconds += phase.seconds;
+                    found->cells += phase.cells;
+                    found->bytes += phase.bytes;
+                }
+            }
+        }
+        return phases;
+    }
+
+    /// Events that didn't fit in their thread's buffer since tracing started
+    unsigned long long getDroppedEvents() const {
+        unsigned long long dropped = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const auto &log : logs) {
+            std::lock_guard<std::mutex> logLock(log->mutex);
+            dropped += log->dropped;
+        }
+        return dropped;
+    }
+
+    /// Forgets every total and event so far, threads keep their logs
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const auto &log : logs) {
+            std::lock_guard<std::mutex> logLock(log->mutex);
+            log->phases.clear();
+            log->events.clear();
+            log->dropped = 0;
+        }
+        epoch = Clock::now();
+    }
+
+    /**
+     * Writes the events kept so far as Chrome trace event JSON, which chrome://tracing and Perfetto open. Scopes are
+     * complete events with the cells and bytes they reported as arguments, counters are counter events.
+     * @param processId the pid events are written with, so the traces of several processes can be merged
+     * @return why it couldn't be written, or an empty string
+     */
+    std::string writeChromeTrace(const std::string &path, unsigned int processId = 0) const {
+        std::ofstream file(path);
+        if(!file) {
+            return "Could not open " + path + " for writing";
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        auto separate = [&]() {
+            file << (first ? "  " : ",\n  ");
+            first = false;
+        };
+        for(std::size_t thread = 0; thread < logs.size(); ++thread) {
+            const ThreadLog &log = *logs[thread];
+            std::lock_guard<std::mutex> logLock(log.mutex);
+            separate();
+            file << R"({"name": "thread_name", "ph": "M", "pid": )" << processId << ", \"tid\": " << thread
+                 << R"(, "args": {"name": ")" << log.name << "\"}}";
+
+            for(const Event &event : log.events) {
+                const double start = std::chrono::duration<double, std::micro>(event.start - epoch).count();
+                separate();
+                // Times in microseconds to the nanosecond, arguments to their full precision
+                file << "{\"name\": \"" << event.name << "\", \"ph\": \"" << event.type << "\", \"pid\": " << processId
+                     << ", \"tid\": " << thread << ", \"ts\": " << std::fixed << std::setprecision(3) << start;
+                if(event.type == 'C') {
+                    file << std::defaultfloat << std::setprecision(15) << ", \"args\": {\"value\": " << event.value << "}}";
+                } else {
+                    file << ", \"dur\": " << std::chrono::duration<double, std::micro>(event.duration).count()
+                         << std::defaultfloat << std::setprecision(15)
+                         << ", \"args\": {\"cells\": " << event.cells << ", \"bytes\": " << event.bytes << "}}";
+                }
+            }
+        }
+        file << "\n]}\n";
+
+        return file ? "" : "Could not write " + path;
+    }
+
+private:
+    /// Events are 56 bytes, so this is 14MiB a thread
+    static constexpr std::size_t DefaultEventsPerThread = 1 << 18;
+
+    struct Event {
+        const char *name;
+        Clock::time_point start;
+        Clock::duration duration;
+        double value, cells, bytes;
+        char type;
+    };
+
+    struct ThreadLog {
+        mutable std::mutex mutex;
+        const char *name = "thread";
+        std::vector<ProfilePhase> phases;
+        std::vector<Event> events;
+        unsigned long long dropped = 0;
+
+        /// Phases are few, so a linear search by name beats hashing it
+        ProfilePhase &phase(const char *name) {
+            for(ProfilePhase &phase : phases) {
+                if(phase.name == name) {
+                    return phase;
+                }
+            }
+            phases.emplace_back();
+            phases.back().name = name;
+            return phases.back();
+        }
+
+        void add(const Event &event, std::size_t capacity) {
+            if(events.capacity() < capacity) {
+                events.reserve(capacity);
+            }
+            if(events.size() < capacity) {
+                events.push_back(event);
+            } else {
+                ++dropped;
+            }
+        }
+    };
+
+    Profiler() : epoch(Clock::now()) {}
+
+    /// The calling thread's log, made on its first call. Logs outlive their threads so a trace still has their events
+    ThreadLog &threadLog() {
+        static thread_local ThreadLog *log = nullptr;
+        if(!log) {
+            std::lock_guard<std::mutex> lock(mutex);
+            logs.push_back(std::make_unique<ThreadLog>());
+            log = logs.back().get();
+        }
+        return *log;
+    }
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadLog>> logs;
+    std::atomic<bool> tracing{false};
+    std::size_t eventsPerThread = DefaultEventsPerThread;
+    /// Events are timed from here
+    Clock::time_point epoch;
+};
+
+/// Records the time from its construction to its destruction as a phase of the Profiler
+class ProfileScope {
+public:
+    ProfileScope(const char *name, double cells = 0, double bytes = 0)
+            : name(name), cells(cells), bytes(bytes), start(Profiler::Clock::now()) {}
+
+    ProfileScope(const ProfileScope &other)= delete;
+    ProfileScope& operator=(const ProfileScope &source)= delete;
+
+    ~ProfileScope() {
+        Profiler::instance().record(name, start, Profiler::Clock::now(), cells, bytes);
+    }
+
+private:
+    const char *name;
+    double cells, bytes;
+    Profiler::Clock::time_point start;
+};
+
+#define REACTIONDIFFUSION2_CONCATENATE_INNER(a, b) a##b
+#define REACTIONDIFFUSION2_CONCATENATE(a, b) REACTIONDIFFUSION2_CONCATENATE_INNER(a, b)
+
+#ifdef REACTIONDIFFUSION2_PROFILING
+/// Times the rest of the enclosing scope as the phase name, optionally with the cells and bytes it processes
+#define REACTIONDIFFUSION2_PROFILE_SCOPE(...) ProfileScope REACTIONDIFFUSION2_CONCATENATE(profileScope, __LINE__)(__VA_ARGS__)
+/// Records the value of a counter while tracing
+#define REACTIONDIFFUSION2_PROFILE_COUNTER(name, value) Profiler::instance().counter(name, static_cast<double>(value))
+/// Names the calling thread in traces
+#define REACTIONDIFFUSION2_PROFILE_THREAD(name) Profiler::instance().nameThread(name)
+#else
+#define REACTIONDIFFUSION2_PROFILE_SCOPE(...) do {} while(false)
+#define REACTIONDIFFUSION2_PROFILE_COUNTER(name, value) do {} while(false)
+#define REACTIONDIFFUSION2_PROFILE_THREAD(name) do {} while(false)
+#endif
+
+#endif //REACTIONDIFFUSION2_PROFILER_HPP
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_PROFILERHUD_HPP
+#define REACTIONDIFFUSION2_PROFILERHUD_HPP
+
+#include <SFML/Graphics/Font.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Text.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Profiler.hpp"
+#include "SimulationThread.hpp"
+
+/**
+ * An overlay of the simulation's live statistics and where the time goes, drawn over the grid with SFML. Each phase
+ * the Profiler has seen is shown as the milliseconds spent in it per second, summed over every thread, and the cells
+ * and bytes it processed per second of that time, all over the last refresh interval. Without profiling compiled in
+ * only the statistics are shown.
+ */
+class ProfilerHud : public sf::Drawable {
+public:
+    explicit ProfilerHud(const sf::Font &font, unsigned int characterSize = 12) : lastRefresh(std::chrono::steady_clock::now()) {
+        text.setFont(font);
+        text.setCharacterSize(characterSize);
+        text.setFillColor(sf::Color::White);
+        text.setOutlineColor(sf::Color::Black);
+        text.setOutlineThickness(1);
+        text.setPosition(4, 4);
+    }
+
+    void toggle() {
+        visible = !visible;
+    }
+
+    bool isVisible() const {
+        return visible;
+    }
+
+    /// Rebuilds the text from the stats and the Profiler, at most once per refresh interval, call before drawing
+    void update(const SimulationStats &stats) {
+        const auto now = std::chrono::steady_clock::now();
+        const double interval = std::chrono::duration<double>(now - lastRefresh).count();
+        if(!visible || interval < RefreshSeconds) {
+            return;
+        }
+
+        char line[128];
+        std::string contents;
+        std::snprintf(line, sizeof(line), "step %llu  %.0f steps/s  %.3g cells/s\nstep %.2f ms  colour %.2f ms\n",
+                      stats.stepCount, stats.stepsPerSecond, stats.cellsPerSecond, stats.stepMilliseconds, stats.colorMilliseconds);
+        contents += line;
+
+        if(!Profiler::isCompiledIn()) {
+            contents += "built without REACTIONDIFFUSION_PROFILING";
+        } else {
+            std::vector<ProfilePhase> phases = Profiler::instance().getPhases();
+            contents += "phase               ms/s    cells/s     GB/s\n";
+            for(const ProfilePhase &phase : phases) {
+                const ProfilePhase before = previous(phase.name);
+                const double seconds = phase.seconds - before.seconds;
+                const double cells = phase.cells - before.cells;
+                const double bytes = phase.bytes - before.bytes;
+                if(cells > 0 && seconds > 0) {
+                    std::snprintf(line, sizeof(line), "%-16s %7.1f %10.3g %8.2f\n", phase.name, 1e3 * seconds / interval,
+                                  cells / seconds, bytes / seconds / 1e9);
+                } else {
+                    std::snprintf(line, sizeof(line), "%-16s %7.1f\n", phase.name, 1e3 * seconds / interval);
+                }
+                contents += line;
+            }
+            last = std::move(phases);
+        }
+
+        text.setString(contents);
+        lastRefresh = now;
+    }
+
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override {
+        if(visible) {
+            target.draw(text, states);
+        }
+    }
+
+private:
+    static constexpr double RefreshSeconds = 0.5;
+
+    /// The totals of the phase as of the last refresh
+    ProfilePhase previous(const char *name) const {
+        for(const ProfilePhase &phase : last) {
+            if(std::string(phase.name) == name) {
+                return phase;
+            }
+        }
+        return ProfilePhase{};
+    }
+
+    sf::Text text;
+    bool visible = true;
+    std::chrono::steady_clock::time_point lastRefresh;
+    std::vector<ProfilePhase> last;
+};
+
+#endif //REACTIONDIFFUSION2_PROFILERHUD_HPP
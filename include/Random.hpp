@@ -2,37 +2,171 @@
 #ifndef REACTIONDIFFUSION_RANDOM_HPP
 #define REACTIONDIFFUSION_RANDOM_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 
 /**
- * Calling returns a random unsigned integer in the range from a to b non inclusive
+ * The Philox4x32-10 counter-based generator of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3". Its output
+ * is a pure function of a 128 bit counter and a 64 bit key, ten rounds of multiplies and xors, so any thread can draw
+ * any number in any order without sharing state, and the same counter always gives the same four words.
+ */
+struct Philox {
+    using Counter = std::array<std::uint32_t, 4>;
+    using Key = std::array<std::uint32_t, 2>;
+
+    static inline Counter generate(Counter counter, Key key) {
+        for(unsigned int round = 0; round < 10; ++round) {
+            if(round != 0) {
+                key[0] += 0x9E3779B9u;
+                key[1] += 0xBB67AE85u;
+            }
+            const std::uint64_t first = static_cast<std::uint64_t>(0xD2511F53u) * counter[0];
+            const std::uint64_t second = static_cast<std::uint64_t>(0xCD9E8D57u) * counter[2];
+            counter = {static_cast<std::uint32_t>(second >> 32) ^ counter[1] ^ key[0], static_cast<std::uint32_t>(second),
+                       static_cast<std::uint32_t>(first >> 32) ^ counter[3] ^ key[1], static_cast<std::uint32_t>(first)};
+        }
+        return counter;
+    }
+};
+
+/// A seed from the system's entropy source, for runs that needn't be reproducible
+inline std::uint64_t randomSeed() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device();
+}
+
+/// A word of random bits as a number in [0, 1), from as many of its top bits as Scalar holds exactly
+template <typename Scalar>
+inline Scalar unitInterval(std::uint32_t word) {
+    if constexpr(sizeof(Scalar) >= sizeof(double)) {
+        return static_cast<Scalar>(word) * Scalar(0x1p-32);
+    } else {
+        return static_cast<Scalar>(word >> 8) * Scalar(0x1p-24);
+    }
+}
+
+/**
+ * Random numbers addressed by a stream and an index within it, each drawn from Philox keyed on the seed, so a number
+ * depends only on the seed and where it is and never on which thread drew it or what was drawn before. A simulation
+ * keys numbers on (step, cell) so every cell of every step gets its own, reproducibly. Each index gives four words,
+ * lanes 0 to 3, one for each chemical of a cell.
+ */
+class CounterRandom {
+public:
+    explicit CounterRandom(std::uint64_t seed = 0)
+            : seed(seed), key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)} {}
+
+    std::uint64_t getSeed() const {
+        return seed;
+    }
+
+    /// The four words at index of stream
+    inline Philox::Counter words(std::uint64_t stream, std::uint64_t index) const {
+        return Philox::generate({static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(index >> 32),
+                                 static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)}, key);
+    }
+
+    /// A number in [0, 1) from one lane of index of stream
+    template <typename Scalar>
+    inline Scalar uniform(std::uint64_t stream, std::uint64_t index, unsigned int lane = 0) const {
+        return unitInterval<Scalar>(words(stream, index)[lane]);
+    }
+
+    /**
+     * Numbers in [0, 1) at count consecutive indices of stream from first, out[lane][i] from lane lane of index
+     * first + i, exactly as uniform would give them one at a time. Indices are generated a block at a time with each
+     * word of the counter in an array of its own, so every round is the same 32 bit multiplies and xors across the
+     * block and vectorises.
+     * @tparam Lanes how many lanes to write, from lane 0, at most 4
+     */
+    template <typename Scalar, unsigned int Lanes>
+    void uniforms(std::uint64_t stream, std::uint64_t first, std::size_t count, Scalar *const *out) const {
+        static_assert(Lanes >= 1 && Lanes <= 4, "Philox gives four words per index");
+        // Blocks much shorter than this are unrolled whole, and the rounds over them are left scalar
+        constexpr std::size_t Block = 64;
+        alignas(64) std::uint32_t words[4][Block];
+
+        for(std::size_t begin = 0; begin < count; begin += Block) {
+            const std::size_t size = std::min(Block, count - begin);
+            for(std::size_t i = 0; i < Block; ++i) {
+                const std::uint64_t index = first + begin + i;
+                words[0][i] = static_cast<std::uint32_t>(index);
+                words[1][i] = static_cast<std::uint32_t>(index >> 32);
+                words[2][i] = static_cast<std::uint32_t>(stream);
+                words[3][i] = static_cast<std::uint32_t>(stream >> 32);
+            }
+
+            Philox::Key roundKey = key;
+            for(unsigned int round = 0; round < 10; ++round) {
+                if(round != 0) {
+                    roundKey[0] += 0x9E3779B9u;
+                    roundKey[1] += 0xBB67AE85u;
+                }
+                for(std::size_t i = 0; i < Block; ++i) {
+                    // The high and low halves as separate multiplies, which vectorise where one 64 bit product doesn't
+                    const std::uint32_t high0 = static_cast<std::uint32_t>((static_cast<std::uint64_t>(0xD2511F53u) * words[0][i]) >> 32);
+                    const std::uint32_t high2 = static_cast<std::uint32_t>((static_cast<std::uint64_t>(0xCD9E8D57u) * words[2][i]) >> 32);
+                    const std::uint32_t low0 = 0xD2511F53u * words[0][i];
+                    const std::uint32_t low2 = 0xCD9E8D57u * words[2][i];
+                    words[0][i] = high2 ^ words[1][i] ^ roundKey[0];
+                    words[2][i] = high0 ^ words[3][i] ^ roundKey[1];
+                    words[1][i] = low2;
+                    words[3][i] = low0;
+                }
+            }
+
+            for(unsigned int lane = 0; lane < Lanes; ++lane) {
+                for(std::size_t i = 0; i < size; ++i) {
+                    out[lane][begin + i] = unitInterval<Scalar>(words[lane][i]);
+                }
+            }
+        }
+    }
+
+private:
+    std::uint64_t seed;
+    Philox::Key key;
+};
+
+/**
+ * Calling returns a random unsigned integer in the range from a to b non inclusive. The numbers are the successive
+ * indices of one stream of a CounterRandom, so the same seed and stream give the same numbers.
  */
 class RandomRange {
 public:
-    RandomRange(unsigned int a, unsigned int b) : rd(), mt(rd()), dist(a, b - 1) {}
+    RandomRange(unsigned int a, unsigned int b, std::uint64_t seed = randomSeed(), std::uint64_t stream = 0)
+            : random(seed), stream(stream), a(a), span(b - a) {}
 
     unsigned int operator()() {
-        return dist(mt);
+        // The top bits of the product scale the word onto the span without a division
+        const std::uint64_t word = random.words(stream, index++)[0];
+        return a + static_cast<unsigned int>((word * span) >> 32);
     }
 
 private:
-    std::random_device rd;
-    std::mt19937 mt;
-    std::uniform_int_distribution<unsigned int> dist;
+    CounterRandom random;
+    std::uint64_t stream, index = 0;
+    unsigned int a;
+    std::uint64_t span;
 };
 
+/// Calling returns a random double in [a, b), drawn as RandomRange draws integers
 class RandomFloatingRange {
 public:
-    RandomFloatingRange(double a, double b) : rd(), mt(rd()), dist(a, b) {}
+    RandomFloatingRange(double a, double b, std::uint64_t seed = randomSeed(), std::uint64_t stream = 0)
+            : random(seed), stream(stream), a(a), span(b - a) {}
 
     double operator()() {
-        return dist(mt);
+        return a + span * random.uniform<double>(stream, index++);
     }
 
 private:
-    std::random_device rd;
-    std::mt19937 mt;
-    std::uniform_real_distribution<double> dist;
+    CounterRandom random;
+    std::uint64_t stream, index = 0;
+    double a, span;
 };
 
 #endif //REACTIONDIFFUSION_RANDOM_HPP
@@ -1,80 +1,826 @@
 #ifndef REACTIONDIFFUSION2_REACTIONDIFFUSION_HPP
 #define REACTIONDIFFUSION2_REACTIONDIFFUSION_HPP
 
-#include <SFML/Graphics/RenderTarget.hpp>
-#include <SFML/Graphics/Image.hpp>
-#include <SFML/Graphics/Texture.hpp>
-#include <SFML/Graphics/Sprite.hpp>
-#include <SFML/System/Vector2.hpp>
-#include <SFML/Window/Event.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
 
 #include "ReactionState.hpp"
 #include "ReactionModel.hpp"
 #include "Convolution.hpp"
 #include "Seeders.hpp"
+#include "Kernels.hpp"
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
 
 /**
- * Controls the whole simulation.
- * @tparam CellDim the dimensions of the cell grid
+ * Keeps the top and bottom rows of a grid in step with copies held elsewhere, such as the neighbouring bands of a grid
+ * split across processes (see DistributedSimulation). The outermost row at each end is a ghost row: it is never
+ * stepped, which needs the fixed ring boundary, and receive overwrites it instead. The row inside each ghost row is
+ * the one sent. A step sends first, steps every row that doesn't read a ghost row while the rows are on their way,
+ * then receives and steps the two rows left, so the exchange overlaps with most of the step.
+ * @tparam ChemicalCount the number of chemicals in the grid
+ * @tparam Precision the ScalarPrecision of the grid
+ */
+template <unsigned int ChemicalCount, typename Precision>
+class AbstractRowExchange {
+public:
+    /// Starts sending rows 1 and height - 2 of the state, as they are at the start of the step
+    virtual void send(const ReactionState<ChemicalCount, Precision> &state)= 0;
+    /// Waits for the rows from elsewhere and writes them into rows 0 and height - 1 of the state
+    virtual void receive(ReactionState<ChemicalCount, Precision> &state)= 0;
+    virtual ~AbstractRowExchange()= default;
+};
+
+/**
+ * Reductions over every stepped cell of a ReactionDiffusion as of one step, see ReactionDiffusion::setReductionInterval.
+ * The stepped cells are all of them but the fixed outer ring, if there is one.
+ * @tparam ChemicalCount the number of chemicals in the grid
+ */
+template <unsigned int ChemicalCount>
+struct GridStatistics {
+    /// Whether there have been any statistics since the grid was seeded
+    bool valid = false;
+    /// The step count as of the statistics
+    unsigned long long step = 0;
+    /// The largest change of any concentration in the step before
+    double maxChange = 0;
+    /// Each chemical's mean concentration
+    std::array<double, ChemicalCount> mean{};
+    /// The sum of hashCell over every concentration, only if hashed
+    std::uint64_t hash = 0;
+    bool hashed = false;
+};
+
+/**
+ * Controls the whole simulation. Has no dependency on SFML, drawing is done by ReactionRenderer.
+ * Each step reads the current state and writes the next into a second buffer owned by the instance. The work is split
+ * by tile, and tiles into bands of rows when there are too few tiles to go round, and shared out over a thread pool.
+ * Only tiles near activity are stepped: a tile is skipped while neither it nor any tile within reach of its halo
+ * changed by more than the activity threshold in the previous step, so quiescent regions cost next to nothing.
  * @tparam CellSize the size of each cell in the cell grid
  * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision to compute and store the grid in, see Precision.hpp
  */
-template <unsigned int CellDim, unsigned int ChemicalCount>
-class ReactionDiffusion : public sf::Drawable {
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class ReactionDiffusion {
 public:
+    using Scalar = typename Precision::Scalar;
 
-    explicit ReactionDiffusion(std::unique_ptr<AbstractConvolution<CellDim, ChemicalCount>> convolution,
-            std::unique_ptr<AbstractSeeder<CellDim, ChemicalCount>> seeder,
-            std::unique_ptr<AbstractReactionModel<ChemicalCount>> reactionModel)
-            : convolution(std::move(convolution)), reactionModel(std::move(reactionModel))
+    explicit ReactionDiffusion(const GridLayout &layout,
+            std::unique_ptr<AbstractConvolution<ChemicalCount, Precision>> convolution,
+            std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder,
+            std::unique_ptr<AbstractReactionModel<ChemicalCount, Scalar>> reactionModel,
+            unsigned int threadCount = std::thread::hardware_concurrency())
+            : pool(makePool(threadCount)),
+              reactionState(layout, reactionModel->getBackground(), pool.get()),
+              nextState(layout, reactionModel->getBackground(), pool.get()),
+              convolution(std::move(convolution)), reactionModel(std::move(reactionModel)),
+              coloring(new std::uint8_t[static_cast<std::size_t>(layout.width) * layout.height * 4]()),
+              tileChangedRows(reactionState.getTileCount()),
+              tileActive(reactionState.getTileCount()), tileScheduled(reactionState.getTileCount()),
+              tileSettled(reactionState.getTileCount()), tileDirty(reactionState.getTileCount()),
+              tileSums(static_cast<std::size_t>(reactionState.getTileCount()) * ChemicalCount),
+              tileHashes(reactionState.getTileCount()), tileReduced(reactionState.getTileCount())
     {
+        selectKernel();
         seedReaction(std::move(seeder));
     }
 
+    /**
+     * Simulates a reaction policy (see Reactions.hpp) with the classic stencil, always on the fused kernel. This is
+     * the same as passing a ClassicConvolution and a StaticReactionModel, which select the same kernel.
+     * @tparam Reaction the reaction, computed in Scalar
+     */
+    template <typename Reaction>
+    ReactionDiffusion(const GridLayout &layout, const ClassicStencil<Scalar> &stencil, const Reaction &reaction,
+                      std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder,
+                      unsigned int threadCount = std::thread::hardware_concurrency())
+            : ReactionDiffusion(layout,
+                                std::make_unique<ClassicConvolution<ChemicalCount, Precision>>(stencil.center, stencil.edge, stencil.corner),
+                                std::move(seeder), std::make_unique<StaticReactionModel<Reaction>>(reaction), threadCount)
+    {
+        static_assert(Reaction::ChemicalCount == ChemicalCount, "the reaction must have the simulation's chemicals");
+        static_assert(std::is_same<typename Reaction::Scalar, Scalar>::value, "the reaction must compute in Scalar");
+        fusedKernel = std::make_unique<RowKernel<Precision, StencilKernel<Reaction>>>(StencilKernel<Reaction>{stencil, reaction});
+    }
+
     // TODO: Abstract this
-    void seedReaction(std::unique_ptr<AbstractSeeder<CellDim, ChemicalCount>> seeder) {
-        reactionState = ReactionState<CellDim, ChemicalCount>(std::array<double, ChemicalCount>{1, 0});
+    /// Resets the grid and seeds it, counting steps from startingStep (a restored checkpoint carries on its count)
+    void seedReaction(std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder, unsigned long long startingStep = 0) {
+        reactionState.fill(reactionModel->getBackground(), *pool);
 
         seeder->seed(reactionState);
+        stepCount = startingStep;
+        statistics = GridStatistics<ChemicalCount>();
 
-        image.create(CellDim, CellDim, reactionState.getColoring());
+        // Any cell may have changed
+        std::fill(tileSettled.begin(), tileSettled.end(), 0);
+        std::fill(tileDirty.begin(), tileDirty.end(), 1);
+        activateAll();
     }
 
-    void onEvent(sf::Event) {
+    /// Sets the concentrations held beyond the edges with BoundaryCondition::FixedValue, the reaction's background
+    /// unless set
+    void setBoundaryValues(const std::array<Scalar, ChemicalCount> &amounts) {
+        reactionState.setBoundaryValues(amounts);
+        nextState.setBoundaryValues(amounts);
+        // Blocked passes read the halo of the next state too
+        nextState.exchangeHalos();
+        activateAll();
+    }
 
+    /**
+     * Exchanges the top and bottom rows of the grid with copies held elsewhere every step, see AbstractRowExchange.
+     * The layout must have the fixed ring boundary, and steps are taken one at a time whatever its halo width.
+     */
+    void setRowExchange(std::unique_ptr<AbstractRowExchange<ChemicalCount, Precision>> exchange) {
+        rowExchange = std::move(exchange);
+        activateAll();
     }
 
-    void update(sf::Time) {
-        static ReactionState<CellDim, ChemicalCount> nextState = ReactionState<CellDim, ChemicalCount>(std::array<double, ChemicalCount> {1, 0});
+    /// Sets the number of threads used to step the simulation, 0 uses one per hardware thread. The grid's pages stay
+    /// on the NUMA nodes of the threads that first wrote them
+    void setThreadCount(unsigned int threadCount) {
+        pool = makePool(threadCount);
+    }
 
-        ;
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+    /**
+     * Sets how much a concentration in a tile must change in a step for the tile and its neighbours to be stepped
+     * next time. At 0, the default, only tiles that are at a fixed point are skipped, so the result is exactly that of
+     * stepping every tile. Above 0 regions that are merely settling down are frozen too, which is faster but inexact.
+     * A negative threshold steps every tile every step.
+     */
+    void setActivityThreshold(Scalar threshold) {
+        activityThreshold = threshold;
+        activateAll();
+    }
+
+    Scalar getActivityThreshold() const {
+        return activityThreshold;
+    }
 
-        for(unsigned int x = 1; x < CellDim - 1; ++x) {
-            for(unsigned int y = 1; y < CellDim - 1; ++y) {
-                std::array<double, ChemicalCount> convRes = (*convolution)(x, y, reactionState);
+    /// The number of tiles the next step will update
+    unsigned int getActiveTileCount() const {
+        return static_cast<unsigned int>(scheduled.size());
+    }
 
-                const CellConcentration<ChemicalCount> conc = reactionState.getConcentration(x, y);
+    /**
+     * Advances the simulation by the given number of steps.
+     * With the fused kernel the steps are taken in passes of up to haloWidth steps (see GridLayout): each tile is
+     * advanced that many steps in one go while it is in cache, recomputing the shrinking overlap with its neighbours
+     * from its own halo, so the grid only streams through memory once per pass.
+     */
+    void update(unsigned int steps = 1) {
+        while(steps > 0) {
+            // Rows from elsewhere arrive a step at a time, so a tile can't be taken further from its own halo
+            unsigned int passSteps = fusedKernel && !rowExchange ? std::min(steps, reactionState.getLayout().haloWidth) : 1;
+            // Passes end on the steps that are reduced, only the last step of a pass covers each tile exactly
+            bool reduce = false;
+            if(reductionInterval != 0) {
+                const unsigned long long untilReduction = reductionInterval - stepCount % reductionInterval;
+                passSteps = static_cast<unsigned int>(std::min<unsigned long long>(passSteps, untilReduction));
+                reduce = passSteps == untilReduction;
+            }
 
-                nextState.getConcentration(x, y).conc = reactionModel->update(conc, convRes);
+            if(passSteps == 1) {
+                step(reduce);
+            } else {
+                blockedPass(passSteps, reduce);
             }
+            steps -= passSteps;
         }
+    }
+
+    /**
+     * Reduces every stepped cell to GridStatistics after each step that is a multiple of interval, 0 (the default)
+     * never does. The reductions are fused into the step: each row is added up as it is written, while it is still in
+     * cache, and tiles that weren't stepped keep what they added up to when they last changed, so reducing takes no
+     * extra pass over the grid. Temporally blocked passes are shortened to end on the steps that are reduced.
+     * @param hash also hash the grid (see hashCell), which costs more than the rest of the reductions but tells apart
+     * grids with the same means, such as a pattern coming back to an earlier state
+     */
+    void setReductionInterval(unsigned int interval, bool hash = false) {
+        reductionInterval = interval;
+        reductionHashed = hash;
+        // The tiles' reductions may not have been hashed
+        std::fill(tileReduced.begin(), tileReduced.end(), 0);
+    }
+
+    unsigned int getReductionInterval() const {
+        return reductionInterval;
+    }
+
+    /**
+     * Adds noise to every concentration every step, amplitude[chem] times a number uniform in [-1, 1) for each chemical
+     * of each cell. The numbers come from a CounterRandom keyed on the seed at the step and the cell's position, so a
+     * run is reproducible from its seed and gives the same grid on any number of threads, tile size or temporal
+     * blocking, whatever the boundary (the determinism check in src/checks.cpp holds it to that). Every tile changes
+     * every step with noise, so none are skipped, and the largest change of a step leaves the noise out. All zero
+     * amplitudes turn it off.
+     */
+    void setNoise(const std::array<double, ChemicalCount> &amplitude, std::uint64_t seed) {
+        noiseAmplitude = amplitude;
+        noiseRandom = CounterRandom(seed);
+        noisy = std::any_of(amplitude.begin(), amplitude.end(), [](double value) { return value != 0; });
+        activateAll();
+    }
+
+    const std::array<double, ChemicalCount> &getNoiseAmplitude() const {
+        return noiseAmplitude;
+    }
+
+    /// The statistics of the last step that was reduced, see setReductionInterval
+    const GridStatistics<ChemicalCount> &getStatistics() const {
+        return statistics;
+    }
+
+    const ReactionState<ChemicalCount, Precision> &getState() const {
+        return reactionState;
+    }
+
+    const AbstractReactionModel<ChemicalCount, Scalar> &getReactionModel() const {
+        return *reactionModel;
+    }
+
+    /**
+     * Returns the RGBA colouring of the current state, width * height * 4 bytes. The same buffer is recoloured in
+     * place each call, tile by tile on the thread pool, skipping tiles that haven't changed since the last call.
+     */
+    std::uint8_t *getColoring() {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("colour", static_cast<double>(reactionState.getWidth()) * reactionState.getHeight(),
+                                         static_cast<double>(reactionState.getWidth()) * reactionState.getHeight() * (cellBytes() / 2 + 4));
+        pool->parallelFor(reactionState.getTileCount(), [&](unsigned int index) {
+            tileChangedRows[index] = tileDirty[index] ? reactionState.colorTile(index, coloring.get()) : RowRange{};
+        });
+        std::fill(tileDirty.begin(), tileDirty.end(), 0);
+
+        return coloring.get();
+    }
 
-        reactionState = std::move(nextState);
-        image.create(CellDim, CellDim, reactionState.getColoring());
+    /// The rows of the colouring that changed in the last call to getColoring, so only those need to be redrawn
+    RowRange getChangedRows() const {
+        RowRange changed{reactionState.getHeight(), 0};
+        for(const RowRange &rows : tileChangedRows) {
+            if(rows.first < rows.last) {
+                changed.first = std::min(changed.first, rows.first);
+                changed.last = std::max(changed.last, rows.last);
+            }
+        }
+        return changed.first < changed.last ? changed : RowRange{};
     }
 
-    void draw(sf::RenderTarget &target, sf::RenderStates states) const override {
-        sf::Texture tex;
-        tex.loadFromImage(image);
-        sf::Sprite sprite(tex);
-        target.draw(sprite, states);
+    /// The number of steps taken since the reaction was last seeded
+    unsigned long long getStepCount() const {
+        return stepCount;
     }
 
 private:
-    ReactionState<CellDim, ChemicalCount> reactionState;
-    sf::Image image;
-    std::unique_ptr<AbstractConvolution<CellDim, ChemicalCount>> convolution;
-    std::unique_ptr<AbstractReactionModel<ChemicalCount>> reactionModel;
+    /// Bands are kept at least this many rows tall so each one amortises the cost of being scheduled
+    static constexpr unsigned int MinBandRows = 8;
+    /// Splitting into a few tasks per thread gives idle threads something to steal
+    static constexpr unsigned int TasksPerThread = 4;
+
+    static std::unique_ptr<ThreadPool> makePool(unsigned int threadCount) {
+        return std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount);
+    }
+
+    /// Takes a single step of the scheduled tiles, splitting them into bands of rows, reducing them if reduce is set
+    void step(bool reduce) {
+        const unsigned int bands = bandsPerTile();
+        taskChange.assign(scheduled.size() * bands, 0);
+        prepareReduction(reduce ? scheduled.size() * bands : 0);
+
+        const unsigned int height = reactionState.getHeight();
+        REACTIONDIFFUSION2_PROFILE_COUNTER("scheduled tiles", scheduled.size());
+        if(rowExchange) {
+            {
+                REACTIONDIFFUSION2_PROFILE_SCOPE("send rows");
+                rowExchange->send(reactionState);
+            }
+            stepRows(bands, RowRange{2, height - 2});
+            {
+                REACTIONDIFFUSION2_PROFILE_SCOPE("receive rows");
+                rowExchange->receive(reactionState);
+            }
+            refreshGhostHalos();
+            stepRows(bands, RowRange{1, 2});
+            stepRows(bands, RowRange{height - 2, height - 1});
+        } else {
+            stepRows(bands, RowRange{0, height});
+        }
+        {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("activity");
+            settleSkippedTiles();
+            recordActivity(bands, reduce);
+            reactionState.swap(nextState);
+            if(reduce) {
+                finishReduction(stepCount + 1);
+            }
+            schedule();
+        }
+        exchangeHalos();
+        ++stepCount;
+    }
+
+    /// Steps the given rows of the scheduled tiles, each task keeping the largest change it has seen this step
+    void stepRows(unsigned int bands, RowRange rows) {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("stencil", scheduledCells(rows), scheduledCells(rows) * cellBytes());
+        pool->parallelFor(static_cast<unsigned int>(taskChange.size()), [&](unsigned int task) {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("stencil task");
+            simd::FlushDenormals flush;
+            taskChange[task] = std::max(taskChange[task], updateTile(scheduled[task / bands], task % bands, bands, rows, reduction(task)));
+        });
+    }
+
+    /// Refreshes the halos of the scheduled tiles that hold a cell of a ghost row just received, see AbstractRowExchange
+    void refreshGhostHalos() {
+        const int halo = static_cast<int>(reactionState.getLayout().haloWidth);
+        const int lastRow = static_cast<int>(reactionState.getHeight()) - 1;
+        pool->parallelFor(static_cast<unsigned int>(scheduled.size()), [&](unsigned int task) {
+            const auto &tile = reactionState.getTile(scheduled[task]);
+            const int top = static_cast<int>(tile.y) - halo;
+            const int bottom = static_cast<int>(tile.y + tile.height) + halo;
+            if(top <= 0 || bottom > lastRow) {
+                reactionState.exchangeHalo(scheduled[task]);
+            }
+        });
+    }
+
+    /// Takes passSteps steps with every scheduled tile advanced independently from its own halo, reducing the last if
+    /// reduce is set
+    void blockedPass(unsigned int passSteps, bool reduce) {
+        taskChange.assign(scheduled.size(), 0);
+        prepareReduction(reduce ? scheduled.size() : 0);
+        REACTIONDIFFUSION2_PROFILE_COUNTER("scheduled tiles", scheduled.size());
+
+        {
+            // Counted as every step reading and writing every cell, as the benchmarks count it
+            REACTIONDIFFUSION2_PROFILE_SCOPE("stencil", scheduledCells() * passSteps, scheduledCells() * passSteps * cellBytes());
+            pool->parallelFor(static_cast<unsigned int>(taskChange.size()), [&](unsigned int task) {
+                REACTIONDIFFUSION2_PROFILE_SCOPE("stencil task");
+                simd::FlushDenormals flush;
+                taskChange[task] = blockTile(scheduled[task], passSteps, reduction(task));
+            });
+        }
+
+        {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("activity");
+            recordActivity(1, reduce);
+            // The tiles ping-pong between the two states, so after an odd number of steps the result is in the next state
+            if(passSteps % 2 == 1) {
+                settleSkippedTiles();
+                reactionState.swap(nextState);
+            }
+            if(reduce) {
+                finishReduction(stepCount + passSteps);
+            }
+            schedule();
+        }
+        exchangeHalos();
+        stepCount += passSteps;
+    }
+
+    /// Refreshes the halos of the scheduled tiles, the only ones that will read them
+    void exchangeHalos() {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("halo exchange");
+        pool->parallelFor(static_cast<unsigned int>(scheduled.size()), [&](unsigned int task) {
+            reactionState.exchangeHalo(scheduled[task]);
+        });
+    }
+
+    /// Marks every tile as active, so they are all stepped next time
+    void activateAll() {
+        std::fill(tileActive.begin(), tileActive.end(), 1);
+        // Whatever changed the tiles hasn't been reduced
+        std::fill(tileReduced.begin(), tileReduced.end(), 0);
+        schedule();
+        exchangeHalos();
+    }
+
+    /**
+     * Schedules each tile that has an active tile close enough to reach into its halo. Tiles in the halo of an active
+     * tile are scheduled too, which is how activity spreads as fronts move.
+     */
+    void schedule() {
+        const GridLayout &layout = reactionState.getLayout();
+        const int tilesX = static_cast<int>((layout.width + layout.tileSize - 1) / layout.tileSize);
+        const int tilesY = static_cast<int>((layout.height + layout.tileSize - 1) / layout.tileSize);
+        const int reach = static_cast<int>(std::max(1u, (layout.haloWidth + layout.tileSize - 1) / layout.tileSize));
+        // Activity spreads across the edges of a periodic grid like any other
+        const bool wraps = layout.boundary == BoundaryCondition::Periodic;
+        // Ghost rows change every step whatever happened here, so the rows that read them are always stepped
+        const int ghostTop = static_cast<int>(1 / layout.tileSize);
+        const int ghostBottom = static_cast<int>((layout.height - 2) / layout.tileSize);
+
+        scheduled.clear();
+        for(int ty = 0; ty < tilesY; ++ty) {
+            for(int tx = 0; tx < tilesX; ++tx) {
+                bool active = rowExchange && (ty <= ghostTop || ty >= ghostBottom);
+                for(int dy = -reach; dy <= reach && !active; ++dy) {
+                    const int ny = wraps ? ((ty + dy) % tilesY + tilesY) % tilesY : ty + dy;
+                    for(int dx = -reach; dx <= reach && !active && ny >= 0 && ny < tilesY; ++dx) {
+                        const int nx = wraps ? ((tx + dx) % tilesX + tilesX) % tilesX : tx + dx;
+                        active = nx >= 0 && nx < tilesX && tileActive[ny * tilesX + nx] != 0;
+                    }
+                }
+
+                const unsigned int index = static_cast<unsigned int>(ty * tilesX + tx);
+                tileScheduled[index] = active;
+                if(active) {
+                    scheduled.push_back(index);
+                }
+            }
+        }
+    }
+
+    /**
+     * Updates the activity of each tile from the largest change of each of its tasks in the step just taken.
+     * A tile that didn't change at all holds the same cells in both states, which lets it be skipped cheaply later.
+     * @param reduced whether the tasks reduced their cells, which are then added up per tile
+     */
+    void recordActivity(unsigned int tasksPerTile, bool reduced) {
+        std::fill(tileActive.begin(), tileActive.end(), 0);
+        for(std::size_t i = 0; i < scheduled.size(); ++i) {
+            const auto first = taskChange.begin() + i * tasksPerTile;
+            const Scalar change = *std::max_element(first, first + tasksPerTile);
+            const unsigned int index = scheduled[i];
+
+            // Noise changes every cell that is stepped
+            tileActive[index] = change > activityThreshold || noisy;
+            tileSettled[index] = change == 0 && !noisy;
+            tileDirty[index] |= change > 0 || noisy;
+
+            if(reduced) {
+                std::fill_n(tileSums.begin() + index * ChemicalCount, ChemicalCount, 0.0);
+                tileHashes[index] = 0;
+                for(std::size_t task = i * tasksPerTile; task < (i + 1) * tasksPerTile; ++task) {
+                    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                        tileSums[index * ChemicalCount + chem] += taskSums[task * ChemicalCount + chem];
+                    }
+                    tileHashes[index] += taskHashes[task];
+                }
+                tileReduced[index] = 1;
+            } else if(change > 0 || noisy) {
+                tileReduced[index] = 0;
+            }
+        }
+    }
+
+    /// Clears the sums and hashes of the tasks of a step to be reduced, none if tasks is 0
+    void prepareReduction(std::size_t tasks) {
+        taskSums.assign(tasks * ChemicalCount, 0.0);
+        taskHashes.assign(tasks, 0);
+        taskReductions.resize(tasks);
+        for(std::size_t task = 0; task < tasks; ++task) {
+            taskReductions[task].sums = taskSums.data() + task * ChemicalCount;
+            taskReductions[task].hash = reductionHashed ? taskHashes.data() + task : nullptr;
+        }
+    }
+
+    /// Where a task of a step adds up its cells, nullptr if the step isn't reduced
+    const RowReduction *reduction(unsigned int task) const {
+        return taskReductions.empty() ? nullptr : &taskReductions[task];
+    }
+
+    /**
+     * Reduces the tiles that have changed since they were last reduced, without being stepped in the step just taken,
+     * and adds up every tile into the statistics
+     * @param step the step count as of the state, which the step just taken isn't counted in yet
+     */
+    void finishReduction(unsigned long long step) {
+        settling.clear();
+        for(unsigned int index = 0; index < reactionState.getTileCount(); ++index) {
+            if(!tileReduced[index]) {
+                settling.push_back(index);
+            }
+        }
+        pool->parallelFor(static_cast<unsigned int>(settling.size()), [&](unsigned int task) {
+            const unsigned int index = settling[task];
+            const auto &tile = reactionState.getTile(index);
+            const TileInterior interior = interiorOf(index);
+            std::fill_n(tileSums.begin() + index * ChemicalCount, ChemicalCount, 0.0);
+            tileHashes[index] = 0;
+            const RowReduction reduction{tileSums.data() + index * ChemicalCount, reductionHashed ? &tileHashes[index] : nullptr,
+                                         static_cast<int>(tile.x), static_cast<int>(tile.y)};
+            reduceRows<Precision, ChemicalCount>(tile.planes.data(), tile.stride, static_cast<int>(interior.yBegin),
+                                                 static_cast<int>(interior.yEnd), static_cast<int>(interior.xBegin),
+                                                 static_cast<int>(interior.xEnd), reduction);
+        });
+        for(unsigned int index : settling) {
+            tileReduced[index] = 1;
+        }
+
+        std::array<double, ChemicalCount> sums{};
+        std::uint64_t hash = 0;
+        double cells = 0;
+        for(unsigned int index = 0; index < reactionState.getTileCount(); ++index) {
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                sums[chem] += tileSums[index * ChemicalCount + chem];
+            }
+            hash += tileHashes[index];
+            const TileInterior interior = interiorOf(index);
+            cells += static_cast<double>(interior.xEnd - interior.xBegin) * (interior.yEnd - interior.yBegin);
+        }
+
+        statistics.valid = true;
+        statistics.step = step;
+        statistics.maxChange = taskChange.empty() ? 0.0 : static_cast<double>(*std::max_element(taskChange.begin(), taskChange.end()));
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            statistics.mean[chem] = cells > 0 ? sums[chem] / cells : 0.0;
+        }
+        statistics.hash = reductionHashed ? hash : 0;
+        statistics.hashed = reductionHashed;
+    }
+
+    /// Copies the cells of tiles that weren't stepped into the next state, unless it already holds the same cells
+    void settleSkippedTiles() {
+        settling.clear();
+        for(unsigned int index = 0; index < reactionState.getTileCount(); ++index) {
+            if(!tileScheduled[index] && !tileSettled[index]) {
+                settling.push_back(index);
+            }
+        }
+
+        pool->parallelFor(static_cast<unsigned int>(settling.size()), [&](unsigned int task) {
+            const unsigned int index = settling[task];
+            const TileInterior interior = interiorOf(index);
+            reactionState.copyTile(index, nextState, interior.xBegin, interior.yBegin, interior.xEnd, interior.yEnd);
+        });
+        for(unsigned int index : settling) {
+            tileSettled[index] = 1;
+        }
+    }
+
+    /**
+     * Advances one tile passSteps steps, alternating between its storage in the current and next states.
+     * Each step is taken over the tile plus however much of the halo later steps still depend on.
+     * @param reduction where the last step adds up the tile's cells, if not null
+     * @return the largest change of any concentration in the tile in the last step
+     */
+    Scalar blockTile(unsigned int index, unsigned int passSteps, const RowReduction *reduction) {
+        const auto &current = reactionState.getTile(index);
+        const auto &next = nextState.getTile(index);
+        const int tileX = static_cast<int>(current.x);
+        const int tileY = static_cast<int>(current.y);
+
+        // Steps stop short of the grid's edges by the inset, which is negative when the halo beyond them can be
+        // stepped like the halo between tiles
+        const int inset = edgeInset();
+        const int interiorLeft = inset - tileX;
+        const int interiorTop = inset - tileY;
+        const int interiorRight = static_cast<int>(reactionState.getWidth()) - inset - tileX;
+        const int interiorBottom = static_cast<int>(reactionState.getHeight()) - inset - tileY;
+
+        Scalar change = 0;
+        for(unsigned int stepIndex = 0; stepIndex < passSteps; ++stepIndex) {
+            const auto &src = stepIndex % 2 == 0 ? current : next;
+            const auto &dst = stepIndex % 2 == 0 ? next : current;
+            const int grow = static_cast<int>(passSteps - stepIndex - 1);
+
+            const int xBegin = std::max(-grow, interiorLeft);
+            const int xEnd = std::min(static_cast<int>(current.width) + grow, interiorRight);
+            const int yBegin = std::max(-grow, interiorTop);
+            const int yEnd = std::min(static_cast<int>(current.height) + grow, interiorBottom);
+
+            RowReduction tileReduction;
+            if(reduction && grow == 0) {
+                tileReduction = *reduction;
+                tileReduction.originX = tileX;
+                tileReduction.originY = tileY;
+            }
+            const RowNoise stepNoise = noiseAt(stepCount + stepIndex, current);
+            change = fusedKernel->stepRows(src.planes.data(), dst.planes.data(), src.stride, yBegin, yEnd, xBegin, xEnd,
+                                           reduction && grow == 0 ? &tileReduction : nullptr, noisy ? &stepNoise : nullptr);
+        }
+        return change;
+    }
+
+    /**
+     * How far in from the grid's edges cells are stepped: 1 leaves the fixed outer ring, 0 steps every cell. With
+     * boundaries that wrap or mirror the grid the halo beyond the edges holds copies of real cells, so temporal
+     * blocking may step into it as it does into the halo between tiles, which is what a negative inset allows.
+     */
+    int edgeInset() const {
+        switch(reactionState.getLayout().boundary) {
+            case BoundaryCondition::FixedRing:
+                return 1;
+            case BoundaryCondition::FixedValue:
+                return 0;
+            default:
+                return -static_cast<int>(reactionState.getLayout().haloWidth);
+        }
+    }
+
+    /// The cells of the given rows in the scheduled tiles, which is what a profiled step reports stepping
+    double scheduledCells(RowRange rows = RowRange{0, ~0u}) const {
+        double cells = 0;
+        for(unsigned int index : scheduled) {
+            const auto &tile = reactionState.getTile(index);
+            const unsigned int first = std::max(tile.y, rows.first);
+            const unsigned int last = std::min(tile.y + tile.height, rows.last);
+            cells += last > first ? static_cast<double>(tile.width) * (last - first) : 0.0;
+        }
+        return cells;
+    }
+
+    /// The bytes a step has to read and write for each cell at the least, every chemical as stored, read and written
+    static constexpr double cellBytes() {
+        return 2.0 * ChemicalCount * sizeof(typename Precision::Storage);
+    }
+
+    /// How many bands of rows to split each scheduled tile into so that every thread has a few tasks
+    unsigned int bandsPerTile() const {
+        const unsigned int tileCount = std::max(1u, static_cast<unsigned int>(scheduled.size()));
+        const unsigned int wanted = (pool->size() * TasksPerThread + tileCount - 1) / tileCount;
+        return std::max(1u, std::min(wanted, reactionState.getLayout().tileSize / MinBandRows));
+    }
+
+    /// The noise of the given step for a tile's planes, see RowNoise
+    template <typename Tile>
+    RowNoise noiseAt(unsigned long long step, const Tile &tile) const {
+        RowNoise noise;
+        noise.random = &noiseRandom;
+        noise.amplitude = noiseAmplitude.data();
+        noise.step = step;
+        noise.originX = static_cast<int>(tile.x);
+        noise.originY = static_cast<int>(tile.y);
+        noise.width = reactionState.getWidth();
+        noise.height = reactionState.getHeight();
+        noise.mirror = reactionState.getLayout().boundary != BoundaryCondition::Periodic;
+        return noise;
+    }
+
+    /// The cells of a tile that are stepped, relative to the tile
+    struct TileInterior {
+        unsigned int xBegin, xEnd, yBegin, yEnd;
+    };
+
+    /// Every cell of the tile, short of the fixed outer ring if there is one. Empty ranges have the end at the beginning
+    TileInterior interiorOf(unsigned int index) const {
+        const auto &tile = reactionState.getTile(index);
+        const unsigned int inset = static_cast<unsigned int>(std::max(0, edgeInset()));
+        TileInterior interior{tile.x == 0 ? inset : 0, std::min(tile.width, reactionState.getWidth() - inset - tile.x),
+                              tile.y == 0 ? inset : 0, std::min(tile.height, reactionState.getHeight() - inset - tile.y)};
+        interior.xEnd = std::max(interior.xEnd, interior.xBegin);
+        interior.yEnd = std::max(interior.yEnd, interior.yBegin);
+        return interior;
+    }
+
+    /**
+     * Steps one band of rows of a tile of the current state into the next state, only those of the given rows of the grid
+     * @param reduction where the band's cells are added up, if not null
+     * @return the largest change of any concentration in the band
+     */
+    Scalar updateTile(unsigned int index, unsigned int band, unsigned int bands, RowRange rows, const RowReduction *reduction) {
+        const auto &src = reactionState.getTile(index);
+        const auto &dst = nextState.getTile(index);
+
+        const TileInterior interior = interiorOf(index);
+        const unsigned int xBegin = interior.xBegin;
+        const unsigned int xEnd = interior.xEnd;
+        const unsigned int yFirst = interior.yBegin;
+        const unsigned int yLast = interior.yEnd;
+        if(xEnd <= xBegin || yLast <= yFirst) {
+            return 0;
+        }
+
+        // The band's rows are the same whichever rows are asked for, so stepping the grid in parts gives the same cells
+        const unsigned int yBegin = std::max(yFirst + ((yLast - yFirst) * band) / bands, rows.first > src.y ? rows.first - src.y : 0u);
+        const unsigned int yEnd = std::min(yFirst + ((yLast - yFirst) * (band + 1)) / bands, rows.last > src.y ? rows.last - src.y : 0u);
+        if(yEnd <= yBegin) {
+            return 0;
+        }
+
+        if(fusedKernel) {
+            RowReduction tileReduction;
+            if(reduction) {
+                tileReduction = *reduction;
+                tileReduction.originX = static_cast<int>(src.x);
+                tileReduction.originY = static_cast<int>(src.y);
+            }
+            const RowNoise stepNoise = noiseAt(stepCount, src);
+            return fusedKernel->stepRows(src.planes.data(), dst.planes.data(), src.stride, static_cast<int>(yBegin),
+                                         static_cast<int>(yEnd), static_cast<int>(xBegin), static_cast<int>(xEnd),
+                                         reduction ? &tileReduction : nullptr, noisy ? &stepNoise : nullptr);
+        }
+
+        Scalar change = 0;
+        for(unsigned int y = src.y + yBegin; y < src.y + yEnd; ++y) {
+            for(unsigned int x = src.x + xBegin; x < src.x + xEnd; ++x) {
+                std::array<Scalar, ChemicalCount> convRes = (*convolution)(x, y, reactionState);
+
+                const CellConcentration<ChemicalCount, Scalar> conc = reactionState.getConcentration(x, y);
+
+                std::array<Scalar, ChemicalCount> next = reactionModel->update(conc, convRes);
+                if(noisy) {
+                    // The change leaves the noise out, as the fused kernel's does
+                    const std::uint64_t index = static_cast<std::uint64_t>(y) * reactionState.getWidth() + x;
+                    for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                        change = std::max(change, std::abs(next[chem] - conc[chem]));
+                        const Scalar value = Scalar(2) * noiseRandom.uniform<Scalar>(stepCount, index, chem) - Scalar(1);
+                        next[chem] += static_cast<Scalar>(noiseAmplitude[chem]) * value;
+                    }
+                }
+                nextState.setConcentration(x, y, next);
+
+                // Measured on the stored values, which is what the next step sees
+                const CellConcentration<ChemicalCount, Scalar> updated = nextState.getConcentration(x, y);
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    if(!noisy) {
+                        change = std::max(change, std::abs(updated[chem] - conc[chem]));
+                    }
+                    if(reduction) {
+                        reduction->sums[chem] += static_cast<double>(updated[chem]);
+                        if(reduction->hash) {
+                            *reduction->hash += hashCell(updated[chem], chem, static_cast<int>(x), static_cast<int>(y));
+                        }
+                    }
+                }
+            }
+        }
+        return change;
+    }
+
+    /// Uses a fused kernel when the convolution and model are exactly ones it implements, otherwise falls back to the
+    /// virtual per cell path
+    void selectKernel() {
+        auto classic = dynamic_cast<ClassicConvolution<ChemicalCount, Precision>*>(convolution.get());
+        if(!classic || typeid(*classic) != typeid(ClassicConvolution<ChemicalCount, Precision>)) {
+            return;
+        }
+
+        const ClassicStencil<Scalar> stencil{classic->getCenterWeight(), classic->getEdgeWeight(), classic->getCornerWeight()};
+        selectKernel<BasicGrayScottModel<Scalar>, BrusselatorModel<Scalar>, FitzHughNagumoModel<Scalar>,
+                     SchnakenbergModel<Scalar>>(stencil);
+    }
+
+    /// Tries each model in turn, a subclass may override update so only the exact type is fused
+    template <typename Model, typename... Models>
+    void selectKernel(const ClassicStencil<Scalar> &stencil) {
+        if constexpr(Model::ChemicalCount == ChemicalCount) {
+            auto model = dynamic_cast<Model*>(reactionModel.get());
+            if(model && typeid(*model) == typeid(Model)) {
+                using Kernel = StencilKernel<typename Model::Reaction>;
+                fusedKernel = std::make_unique<RowKernel<Precision, Kernel>>(Kernel{stencil, model->getReaction()});
+                return;
+            }
+        }
+        if constexpr(sizeof...(Models) > 0) {
+            selectKernel<Models...>(stencil);
+        }
+    }
+
+    // Made before the states so they can be first written on its threads
+    std::unique_ptr<ThreadPool> pool;
+    ReactionState<ChemicalCount, Precision> reactionState;
+    ReactionState<ChemicalCount, Precision> nextState;
+    unsigned long long stepCount = 0;
+    std::unique_ptr<AbstractConvolution<ChemicalCount, Precision>> convolution;
+    std::unique_ptr<AbstractReactionModel<ChemicalCount, Scalar>> reactionModel;
+    std::unique_ptr<AbstractRowKernel<Precision>> fusedKernel;
+    std::unique_ptr<AbstractRowExchange<ChemicalCount, Precision>> rowExchange;
+    // Kept apart from the states, which swap every step, so each colouring can be compared with the last one
+    std::unique_ptr<std::uint8_t[]> coloring;
+    std::vector<RowRange> tileChangedRows;
+
+    Scalar activityThreshold = 0;
+    /// Per tile flags, bytes rather than bools so tasks can write neighbouring ones at once
+    std::vector<std::uint8_t> tileActive;
+    std::vector<std::uint8_t> tileScheduled;
+    /// Whether the current and next states hold the same cells for the tile, so it can be skipped without a copy
+    std::vector<std::uint8_t> tileSettled;
+    /// Whether the tile has changed since it was last coloured
+    std::vector<std::uint8_t> tileDirty;
+    std::vector<unsigned int> scheduled;
+    std::vector<unsigned int> settling;
+    /// The largest change in each task of the last step
+    std::vector<Scalar> taskChange;
+
+    unsigned int reductionInterval = 0;
+    bool reductionHashed = false;
+    GridStatistics<ChemicalCount> statistics;
+    /// Each tile's sums and hash as of the last time it was reduced, and whether it has changed since
+    std::vector<double> tileSums;
+    std::vector<std::uint64_t> tileHashes;
+    std::vector<std::uint8_t> tileReduced;
+    /// The sums and hash of each task of a step being reduced, empty otherwise
+    std::vector<double> taskSums;
+    std::vector<std::uint64_t> taskHashes;
+    std::vector<RowReduction> taskReductions;
+
+    std::array<double, ChemicalCount> noiseAmplitude{};
+    CounterRandom noiseRandom;
+    bool noisy = false;
 };
 
 #endif //REACTIONDIFFUSION2_REACTIONDIFFUSION_HPP
@@ -2,42 +2,152 @@
 #ifndef REACTIONDIFFUSION2_REACTIONMODEL_HPP
 #define REACTIONDIFFUSION2_REACTIONMODEL_HPP
 
+#include <algorithm>
 #include <array>
+#include <string>
+#include <vector>
 
 #include "CellConcentration.hpp"
+#include "Reactions.hpp"
+#include "Simd.hpp"
 
-template <unsigned int ChemicalCount>
+/**
+ * Computes the new concentration of a cell from its current concentration and the convolution around it.
+ * @tparam ChemicalCount the number of chemicals
+ * @tparam Scalar the type concentrations are computed in
+ */
+template <unsigned int ChemicalCount, typename Scalar = double>
 class AbstractReactionModel {
 public:
-    virtual std::array<double, ChemicalCount> update(CellConcentration<ChemicalCount> conc,  std::array<double, ChemicalCount> conv)= 0;
+    virtual std::array<Scalar, ChemicalCount> update(CellConcentration<ChemicalCount, Scalar> conc,  std::array<Scalar, ChemicalCount> conv)= 0;
+
+    /// The parameters of the model in a fixed order, saved alongside the grid in checkpoints
+    virtual std::vector<double> getParameters() const {
+        return {};
+    }
+
+    /// The name checkpoints identify the model by, empty if it has none
+    virtual std::string getName() const {
+        return {};
+    }
+
+    /// The uniform state the grid starts from before seeding, and what lies beyond its edges with
+    /// BoundaryCondition::FixedValue
+    virtual std::array<Scalar, ChemicalCount> getBackground() const {
+        return std::array<Scalar, ChemicalCount>{1};
+    }
+
     virtual ~AbstractReactionModel()= default;
 };
 
-class GrayScottModel : public AbstractReactionModel<2> {
+/**
+ * A reaction model made from one of the reactions of Reactions.hpp. As a virtual model it steps a cell at a time,
+ * but ReactionDiffusion recognises the models below and runs their reaction in its vectorised kernel instead.
+ * @tparam ReactionType the reaction, see Reactions.hpp
+ */
+template <typename ReactionType>
+class StaticReactionModel : public AbstractReactionModel<ReactionType::ChemicalCount, typename ReactionType::Scalar> {
 public:
-    explicit GrayScottModel(double feed=0.055, double kill=0.062, double dA=1.0, double dB=0.5)
-    : dA(dA), dB(dB), feed(feed), kill(kill) {}
+    using Reaction = ReactionType;
+    using Scalar = typename Reaction::Scalar;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+
+    explicit StaticReactionModel(const Reaction &reaction = Reaction()) : reaction(reaction) {}
+
+    std::array<Scalar, ChemicalCount> update(CellConcentration<ChemicalCount, Scalar> conc,  std::array<Scalar, ChemicalCount> conv) override {
+        using Single = simd::ScalarBatch<Scalar>;
+        std::array<Single, ChemicalCount> concBatch, convBatch, result;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            concBatch[chem] = Single::broadcast(conc[chem]);
+            convBatch[chem] = Single::broadcast(conv[chem]);
+        }
+
+        reaction.react(concBatch, convBatch, result);
+
+        std::array<Scalar, ChemicalCount> next;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            next[chem] = result[chem].v;
+        }
+        return next;
+    }
+
+    std::vector<double> getParameters() const override {
+        return reaction.parameters();
+    }
+
+    std::string getName() const override {
+        return Reaction::Name;
+    }
 
-    static GrayScottModel* coral() {
-        return new GrayScottModel();
+    std::array<Scalar, ChemicalCount> getBackground() const override {
+        return reaction.background();
     }
 
-    static GrayScottModel* mitosis() {
-        return new GrayScottModel(0.0367, 0.0649);
+    const Reaction &getReaction() const {
+        return reaction;
     }
 
-    std::array<double, 2> update(CellConcentration<2> conc,  std::array<double, 2> conv) override {
-        double newConcA = conc[0] + (dA*conv[0] - conc[0]*conc[1]*conc[1] + feed*(1-conc[0]))*1;
-        newConcA = std::min(1.0, std::max(0.0, newConcA));
+protected:
+    Reaction reaction;
+};
+
+/**
+ * The Gray-Scott model of two chemicals, A feeding the reaction A + 2B -> 3B with B killed off.
+ * @tparam Scalar the type concentrations are computed in
+ */
+template <typename Scalar = double>
+class BasicGrayScottModel : public StaticReactionModel<GrayScottReaction<Scalar>> {
+public:
+    explicit BasicGrayScottModel(Scalar feed=0.055, Scalar kill=0.062, Scalar dA=1.0, Scalar dB=0.5)
+    : StaticReactionModel<GrayScottReaction<Scalar>>({feed, kill, dA, dB}) {}
 
-        double newConcB = conc[1] + (dB*conv[1] + conc[0]*conc[1]*conc[1] - (kill+feed)*conc[1])*1;
-        newConcB = std::min(1.0, std::max(0.0, newConcB));
+    static BasicGrayScottModel* coral() {
+        return new BasicGrayScottModel();
+    }
 
-        return std::array<double, 2>{newConcA, newConcB};
+    static BasicGrayScottModel* mitosis() {
+        return new BasicGrayScottModel(0.0367, 0.0649);
     }
 
-private:
-    double dA=1.0, dB=0.5, feed=0.055, kill=0.062;
+    Scalar getFeed() const { return this->reaction.feed; }
+    Scalar getKill() const { return this->reaction.kill; }
+    Scalar getDiffusionA() const { return this->reaction.dA; }
+    Scalar getDiffusionB() const { return this->reaction.dB; }
+};
+
+using GrayScottModel = BasicGrayScottModel<double>;
+
+/**
+ * The Brusselator, see BrusselatorReaction. The defaults give stripes and spots.
+ * @tparam Scalar the type concentrations are computed in
+ */
+template <typename Scalar = double>
+class BrusselatorModel : public StaticReactionModel<BrusselatorReaction<Scalar>> {
+public:
+    explicit BrusselatorModel(Scalar a=3, Scalar b=6, Scalar dU=0.5, Scalar dV=4, Scalar dt=0.1)
+    : StaticReactionModel<BrusselatorReaction<Scalar>>({a, b, dU, dV, dt}) {}
+};
+
+/**
+ * FitzHugh-Nagumo, see FitzHughNagumoReaction. The defaults give labyrinths.
+ * @tparam Scalar the type concentrations are computed in
+ */
+template <typename Scalar = double>
+class FitzHughNagumoModel : public StaticReactionModel<FitzHughNagumoReaction<Scalar>> {
+public:
+    explicit FitzHughNagumoModel(Scalar a0=0, Scalar a1=0.5, Scalar epsilon=3, Scalar dU=0.5, Scalar dV=6, Scalar dt=0.1)
+    : StaticReactionModel<FitzHughNagumoReaction<Scalar>>({a0, a1, epsilon, dU, dV, dt}) {}
+};
+
+/**
+ * Schnakenberg, see SchnakenbergReaction. The defaults give spots.
+ * @tparam Scalar the type concentrations are computed in
+ */
+template <typename Scalar = double>
+class SchnakenbergModel : public StaticReactionModel<SchnakenbergReaction<Scalar>> {
+public:
+    explicit SchnakenbergModel(Scalar a=0.1, Scalar b=0.9, Scalar dU=0.25, Scalar dV=5, Scalar dt=0.1)
+    : StaticReactionModel<SchnakenbergReaction<Scalar>>({a, b, dU, dV, dt}) {}
 };
 
 #endif //REACTIONDIFFUSION2_REACTIONMODEL_HPP
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_REACTIONRENDERER_HPP
+#define REACTIONDIFFUSION2_REACTIONRENDERER_HPP
+
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Window/Event.hpp>
+
+#include "SimulationThread.hpp"
+
+/**
+ * Draws the snapshots a SimulationThread publishes with SFML. Kept apart from the simulation so the core builds
+ * without SFML. The texture lives as long as the renderer and only the rows whose colour changed are uploaded to it,
+ * so drawing a frame allocates nothing.
+ * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision of the simulation
+ */
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class ReactionRenderer : public sf::Drawable {
+public:
+    explicit ReactionRenderer(SimulationThread<ChemicalCount, Precision> &simulation, unsigned int width, unsigned int height)
+            : simulation(simulation), width(width) {
+        texture.create(width, height);
+        sprite.setTexture(texture, true);
+    }
+
+    /// Turns input into messages to the simulation thread
+    void onEvent(sf::Event event) {
+        if(event.type != sf::Event::KeyPressed) {
+            return;
+        }
+
+        switch(event.key.code) {
+            case sf::Keyboard::Space: simulation.togglePaused(); break;
+            case sf::Keyboard::S: simulation.step(); break;
+            case sf::Keyboard::T: simulation.toggleThrottle(); break;
+            case sf::Keyboard::Add:
+            case sf::Keyboard::Equal: simulation.scaleStepsPerFrame(2, 1); break;
+            case sf::Keyboard::Subtract:
+            case sf::Keyboard::Hyphen: simulation.scaleStepsPerFrame(1, 2); break;
+            default: break;
+        }
+    }
+
+    /// Uploads the latest snapshot from the simulation, if there is a new one, call before drawing
+    void refresh() {
+        const SimulationFrame *frame = simulation.acquireFrame();
+        if(!frame) {
+            return;
+        }
+
+        const RowRange &changed = frame->changedRows;
+        if(changed.first < changed.last) {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("texture upload", static_cast<double>(changed.last - changed.first) * width,
+                                             static_cast<double>(changed.last - changed.first) * width * 4);
+            texture.update(frame->pixels.data() + static_cast<std::size_t>(changed.first) * width * 4, width,
+                           changed.last - changed.first, 0, changed.first);
+        }
+        stats = frame->stats;
+    }
+
+    /// The statistics of the snapshot on display
+    const SimulationStats &getStats() const {
+        return stats;
+    }
+
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override {
+        target.draw(sprite, states);
+    }
+
+private:
+    SimulationThread<ChemicalCount, Precision> &simulation;
+    unsigned int width;
+    sf::Texture texture;
+    sf::Sprite sprite;
+    SimulationStats stats;
+};
+
+#endif //REACTIONDIFFUSION2_REACTIONRENDERER_HPP
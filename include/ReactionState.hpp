@@ -2,74 +2,477 @@
 #ifndef REACTIONDIFFUSION2_REACTIONSTATE_HPP
 #define REACTIONDIFFUSION2_REACTIONSTATE_HPP
 
-#include <SFML/Graphics/Color.hpp>
-
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <array>
 #include <iostream>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
 
 #include "CellConcentration.hpp"
+#include "GridArena.hpp"
+#include "Palette.hpp"
+#include "Precision.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * What lies beyond the edges of the grid, which is what the halo cells outside it are filled with. Other than with
+ * FixedRing every cell of the grid is stepped, reading its neighbours beyond the edge from the halo like any other.
+ */
+enum class BoundaryCondition : std::uint32_t {
+    /// The outermost ring of cells is never stepped and keeps whatever it was seeded with
+    FixedRing = 0,
+    /// The grid wraps around, each edge continues from the opposite one
+    Periodic = 1,
+    /// Nothing flows across the edges: the halo mirrors the cells just inside them
+    ZeroFlux = 2,
+    /// The halo holds fixed concentrations, see ReactionState::setBoundaryValues
+    FixedValue = 3,
+};
+
+/**
+ * The size of a grid, how its storage is split into tiles and what lies beyond its edges.
+ */
+struct GridLayout {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    /// Cells along each side of a tile, rounded up to a power of two. The default keeps the planes of a tile and its
+    /// next state within a typical L2 cache
+    unsigned int tileSize = 128;
+    /// How many cells of the neighbouring tiles are copied around the edge of each tile. This is also how many steps
+    /// the fused kernel advances a tile per pass over memory (temporal blocking), at the cost of recomputing the halo
+    unsigned int haloWidth = 1;
+    BoundaryCondition boundary = BoundaryCondition::FixedRing;
+};
+
+/// A span of rows [first, last), empty when first == last
+struct RowRange {
+    unsigned int first = 0;
+    unsigned int last = 0;
+};
 
 /**
  * The current state of each cell in the cell grid.
- * @tparam CellDim the number of cells along each side
+ * The grid is sized at runtime and stored in square tiles so that stepping one tile only touches memory close
+ * together, however large the grid is. Each tile holds a structure of arrays: one plane per chemical, with rows a fixed stride
+ * apart that start on a simd::Alignment boundary, surrounded by a halo of cells copied from the neighbouring
+ * tiles so a stencil can be applied to every cell of the tile without looking anywhere else.
+ * Values are read and written as Precision::Scalar and held in the planes as Precision::Storage. The tiles share one
+ * block from the GridArena.
  * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision the grid is computed and stored in
  */
-template <unsigned int CellDim, unsigned int ChemicalCount>
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
 class ReactionState {
 public:
-    static constexpr unsigned int NumCells = CellDim * CellDim;
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+    using Codec = typename Precision::Codec;
+
+    /**
+     * A view of one tile of the grid. The planes point at the tile's cell (0, 0) and extend haloWidth cells beyond
+     * every edge of the tile.
+     */
+    struct Tile {
+        unsigned int x, y;
+        unsigned int width, height;
+        std::size_t stride;
+        std::array<Storage *, ChemicalCount> planes;
+
+        /// Returns the first value of local row y in the plane of the given chemical
+        inline Storage *row(unsigned int chem, int y) const {
+            return planes[chem] + static_cast<std::ptrdiff_t>(y) * static_cast<std::ptrdiff_t>(stride);
+        }
+    };
 
     ReactionState()= default;
 
-    /// Construct a new randomised reaction state
-    explicit ReactionState(std::array<double, ChemicalCount> initialAmounts) {
-        for(unsigned int i = 0; i < NumCells; ++i) {
-            cells[i] = CellConcentration<ChemicalCount>(initialAmounts);
+    /**
+     * Construct a new reaction state with every cell, halos included, set to initialAmounts, which are also the
+     * values held beyond the edges with BoundaryCondition::FixedValue
+     * @param pool the pool the grid will be stepped on, if given the tiles are first written on its threads, see fill
+     */
+    ReactionState(const GridLayout &layout, const std::array<Scalar, ChemicalCount> &initialAmounts, ThreadPool *pool = nullptr)
+            : layout(layout), boundaryValues(initialAmounts) {
+        allocate();
+        if(pool != nullptr) {
+            fill(initialAmounts, *pool);
+        } else {
+            fill(initialAmounts);
+        }
+    }
+
+    explicit ReactionState(const GridLayout &layout) : ReactionState(layout, std::array<Scalar, ChemicalCount>{}) {}
+
+    unsigned int getWidth() const {
+        return layout.width;
+    }
+
+    unsigned int getHeight() const {
+        return layout.height;
+    }
+
+    const GridLayout &getLayout() const {
+        return layout;
+    }
+
+    /// Sets every cell, halos included, to amounts
+    void fill(const std::array<Scalar, ChemicalCount> &amounts) {
+        for(unsigned int index = 0; index < tiles.size(); ++index) {
+            fillTile(index, amounts);
+        }
+    }
+
+    /**
+     * Sets every cell, halos included, to amounts, each tile on whichever thread of pool takes its index. A tile's
+     * pages are placed on the NUMA node of the thread that first writes them, and the pool hands a step's tiles out
+     * between its threads in the same shares, so filling a fresh grid this way keeps each tile near the thread that
+     * will mostly step it.
+     */
+    void fill(const std::array<Scalar, ChemicalCount> &amounts, ThreadPool &pool) {
+        pool.parallelFor(getTileCount(), [&](unsigned int index) {
+            fillTile(index, amounts);
+        });
+    }
+
+    /// Sets every cell of one tile, halo included, to amounts
+    void fillTile(unsigned int index, const std::array<Scalar, ChemicalCount> &amounts) {
+        const Tile &tile = tiles[index];
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            Storage *first = tile.row(chem, -static_cast<int>(layout.haloWidth)) - leftPadding;
+            std::fill(first, first + tilePlaneSize, Codec::encode(amounts[chem]));
+        }
+    }
+
+    /// The concentrations held beyond the edges with BoundaryCondition::FixedValue, written on the next halo exchange
+    void setBoundaryValues(const std::array<Scalar, ChemicalCount> &amounts) {
+        boundaryValues = amounts;
+    }
+
+    const std::array<Scalar, ChemicalCount> &getBoundaryValues() const {
+        return boundaryValues;
+    }
+
+    inline CellConcentration<ChemicalCount, Scalar> getConcentration(unsigned int x, unsigned int y) const {
+        return getNeighbour(x, y, 0, 0);
+    }
+
+    /**
+     * Returns the concentrations of the cell (dx, dy) away from cell (x, y), read from the halo of (x, y)'s tile when
+     * it lies in another tile or beyond the edge, so it is only as fresh as the last halo exchange. dx and dy must be
+     * within haloWidth.
+     */
+    inline CellConcentration<ChemicalCount, Scalar> getNeighbour(unsigned int x, unsigned int y, int dx, int dy) const {
+        const Tile &tile = tileAt(x, y);
+        CellConcentration<ChemicalCount, Scalar> result;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            result[chem] = Codec::template decode<Scalar>(tile.row(chem, static_cast<int>(y & tileMask) + dy)[static_cast<int>(x & tileMask) + dx]);
+        }
+        return result;
+    }
+
+    inline void setConcentration(unsigned int x, unsigned int y, const std::array<Scalar, ChemicalCount> &conc) {
+        const Tile &tile = tileAt(x, y);
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            tile.row(chem, y & tileMask)[x & tileMask] = Codec::encode(conc[chem]);
+        }
+    }
+
+    inline void setConcentration(unsigned int x, unsigned int y, const CellConcentration<ChemicalCount, Scalar> &conc) {
+        setConcentration(x, y, conc.conc);
+    }
+
+    unsigned int getTileCount() const {
+        return static_cast<unsigned int>(tiles.size());
+    }
+
+    const Tile &getTile(unsigned int index) const {
+        return tiles[index];
+    }
+
+    /// Returns the tile holding cell (x, y)
+    inline const Tile &tileAt(unsigned int x, unsigned int y) const {
+        return tiles[(y >> tileShift) * tilesX + (x >> tileShift)];
+    }
+
+    /// Copies row y of the given chemical, width values, into out
+    void copyRow(unsigned int chem, unsigned int y, Scalar *out) const {
+        for(unsigned int x = 0; x < layout.width; x += layout.tileSize) {
+            const Tile &tile = tileAt(x, y);
+            Codec::decodeRow(tile.row(chem, y & tileMask), out + x, tile.width);
+        }
+    }
+
+    /// Overwrites row y of the given chemical with width values from in
+    void setRow(unsigned int chem, unsigned int y, const Scalar *in) {
+        for(unsigned int x = 0; x < layout.width; x += layout.tileSize) {
+            const Tile &tile = tileAt(x, y);
+            Codec::encodeRow(in + x, tile.row(chem, y & tileMask), tile.width);
+        }
+    }
+
+    /// Copies row y of the given chemical, width values, into out as they are stored
+    void copyStoredRow(unsigned int chem, unsigned int y, Storage *out) const {
+        copyRun(chem, y, 0, layout.width, out);
+    }
+
+    /// Overwrites row y of the given chemical with width values from in, already in the storage type
+    void setStoredRow(unsigned int chem, unsigned int y, const Storage *in) {
+        for(unsigned int x = 0; x < layout.width; x += layout.tileSize) {
+            const Tile &tile = tileAt(x, y);
+            std::memcpy(tile.row(chem, y & tileMask), in + x, tile.width * sizeof(Storage));
+        }
+    }
+
+    /**
+     * Refreshes the halo of one tile from its neighbours, and the part of it beyond the grid's edges as the layout's
+     * BoundaryCondition says. Only writes to the given tile so every tile can be refreshed in parallel.
+     */
+    void exchangeHalo(unsigned int index) {
+        const Tile &tile = tiles[index];
+        const int halo = static_cast<int>(layout.haloWidth);
+        const int tileX = static_cast<int>(tile.x);
+        const int width = static_cast<int>(layout.width);
+        const BoundaryCondition boundary = layout.boundary;
+
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            const Storage boundaryValue = Codec::encode(boundaryValues[chem]);
+
+            for(int y = -halo; y < static_cast<int>(tile.height) + halo; ++y) {
+                const int globalY = static_cast<int>(tile.y) + y;
+                const bool beyond = globalY < 0 || globalY >= static_cast<int>(layout.height);
+                Storage *row = tile.row(chem, y);
+                if(beyond && boundary == BoundaryCondition::FixedRing) {
+                    continue;
+                }
+                if(beyond && boundary == BoundaryCondition::FixedValue) {
+                    std::fill(row - halo, row + tile.width + halo, boundaryValue);
+                    continue;
+                }
+
+                // A row beyond the top or bottom edge is a copy of the row it wraps or mirrors to
+                const unsigned int sourceY = beyond ? boundaryCoordinate(globalY, layout.height) : static_cast<unsigned int>(globalY);
+                const bool haloRow = y < 0 || y >= static_cast<int>(tile.height);
+                const int left = std::max(0, tileX - halo);
+                const int right = std::min(width, tileX + static_cast<int>(tile.width) + halo);
+
+                if(haloRow) {
+                    copyRun(chem, sourceY, left, right, row + (left - tileX));
+                } else {
+                    copyRun(chem, sourceY, left, tile.x, row + (left - tileX));
+                    copyRun(chem, sourceY, tile.x + tile.width, right, row + tile.width);
+                }
+
+                if(boundary == BoundaryCondition::FixedRing) {
+                    continue;
+                }
+                // Then the cells beyond the left and right edges
+                for(int x = tileX - halo; x < 0; ++x) {
+                    row[x - tileX] = beyondValue(chem, sourceY, x, boundaryValue);
+                }
+                for(int x = width; x < tileX + static_cast<int>(tile.width) + halo; ++x) {
+                    row[x - tileX] = beyondValue(chem, sourceY, x, boundaryValue);
+                }
+            }
         }
     }
 
-    inline CellConcentration<ChemicalCount> getConcentration(unsigned int x, unsigned int y) const {
-        return cells[(y * CellDim) + x];
+    void exchangeHalos() {
+        for(unsigned int index = 0; index < tiles.size(); ++index) {
+            exchangeHalo(index);
+        }
     }
 
-    inline CellConcentration<ChemicalCount> &getConcentration(unsigned int x, unsigned int y) {
-        return cells[(y * CellDim) + x];
+    /**
+     * Copies cells [xBegin, xEnd) of rows [yBegin, yEnd) of one tile, in tile coordinates, to the same tile of target,
+     * which must have the same layout
+     */
+    void copyTile(unsigned int index, ReactionState &target, unsigned int xBegin, unsigned int yBegin,
+                  unsigned int xEnd, unsigned int yEnd) const {
+        if(xEnd <= xBegin) {
+            return;
+        }
+
+        const Tile &from = tiles[index];
+        const Tile &to = target.tiles[index];
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = yBegin; y < yEnd; ++y) {
+                std::memcpy(to.row(chem, y) + xBegin, from.row(chem, y) + xBegin, (xEnd - xBegin) * sizeof(Storage));
+            }
+        }
+    }
+
+    /// Returns a vector of colours that can be used to draw the reaction state, row by row. The colours are only
+    /// allocated the first time, most grids are coloured by their simulation into a buffer of its own
+    std::uint8_t *getColoring() {
+        if(!coloring) {
+            coloring.reset(new std::uint8_t[static_cast<std::size_t>(layout.width) * layout.height * 4]());
+        }
+        for(unsigned int index = 0; index < tiles.size(); ++index) {
+            colorTile(index, coloring.get());
+        }
+
+        return coloring.get();
     }
 
-    /// Returns a vector of colours that can be used to draw the reaction state
-    sf::Uint8 *getColoring() {
-        unsigned int i = 0;
-        for(unsigned int index = 0; index < NumCells; ++index) {
-            sf::Color col = cells[index].toColor();
-            coloring[i++] = col.r;
-            coloring[i++] = col.g;
-            coloring[i++] = col.b;
-            coloring[i++] = col.a;
+    /**
+     * Writes the colours of the cells of one tile (see CellConcentration::toColor) into pixels, an RGBA image of the
+     * whole grid row by row. Only writes the tile's own pixels so every tile can be coloured in parallel.
+     * @return the rows of the tile, in grid coordinates, where any pixel changed
+     */
+    RowRange colorTile(unsigned int index, std::uint8_t *pixels) const {
+        const Tile &tile = tiles[index];
+        const Palette<ChemicalCount> &palette = Palette<ChemicalCount>::get();
+        RowRange changed{tile.y + tile.height, tile.y};
+
+        // Rows are coloured in chunks small enough to keep on the stack
+        constexpr unsigned int Chunk = 256;
+        std::array<std::uint32_t, Chunk> alphaTotals;
+        std::array<Scalar, Chunk> decoded;
+
+        for(unsigned int y = 0; y < tile.height; ++y) {
+            std::uint8_t *out = pixels + ((tile.y + y) * static_cast<std::size_t>(layout.width) + tile.x) * 4;
+            std::uint32_t rowChanged = 0;
+
+            for(unsigned int x = 0; x < tile.width; x += Chunk) {
+                const unsigned int count = std::min(Chunk, tile.width - x);
+                std::fill(alphaTotals.begin(), alphaTotals.begin() + count, 0u);
+
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    const Storage *row = tile.row(chem, static_cast<int>(y)) + x;
+                    if constexpr(std::is_same<Scalar, Storage>::value) {
+                        palette.addAlphas(chem, row, alphaTotals.data(), count);
+                    } else {
+                        Codec::decodeRow(row, decoded.data(), count);
+                        palette.addAlphas(chem, decoded.data(), alphaTotals.data(), count);
+                    }
+                }
+
+                rowChanged |= palette.writePixels(alphaTotals.data(), out + x * 4, count);
+            }
+
+            if(rowChanged != 0) {
+                changed.first = std::min(changed.first, tile.y + y);
+                changed.last = tile.y + y + 1;
+            }
         }
 
-        return &coloring[0];
+        return changed.first < changed.last ? changed : RowRange{};
     }
 
     // Non-copyable
     ReactionState(ReactionState &other)= delete;
     ReactionState& operator=(ReactionState &source)= delete;
 
-    // Move semantics
-    ReactionState(ReactionState &&source) noexcept : cells(std::move(source.cells)) {}
+    // Move semantics, a moved from state holds what the one it was moved into held before
+    ReactionState(ReactionState &&source) noexcept {
+        swap(source);
+    }
     ReactionState& operator=(ReactionState &&source) noexcept {
-        std::swap(cells, source.cells);
+        swap(source);
         return *this;
     }
 
     ~ReactionState() {
-        delete [] cells;
-        delete [] coloring;
+        GridArena::shared().release(storage, storageBytes);
     };
 
+    /// Exchanges everything with another state, the cells of each included, without copying any
+    void swap(ReactionState &other) noexcept {
+        std::swap(layout, other.layout);
+        std::swap(boundaryValues, other.boundaryValues);
+        std::swap(tileShift, other.tileShift);
+        std::swap(tileMask, other.tileMask);
+        std::swap(tilesX, other.tilesX);
+        std::swap(leftPadding, other.leftPadding);
+        std::swap(tilePlaneSize, other.tilePlaneSize);
+        std::swap(storage, other.storage);
+        std::swap(storageBytes, other.storageBytes);
+        std::swap(tiles, other.tiles);
+        std::swap(coloring, other.coloring);
+    }
+
 private:
-    CellConcentration<ChemicalCount> *cells = new CellConcentration<ChemicalCount>[NumCells];
-    sf::Uint8 *coloring = new sf::Uint8[NumCells*4];
+
+    /// Lays out the tiles and allocates one block of memory for all of them, left unwritten until it is filled
+    void allocate() {
+        tileShift = 0;
+        while((1u << tileShift) < std::max(layout.tileSize, 1u)) {
+            ++tileShift;
+        }
+        layout.tileSize = 1u << tileShift;
+        layout.haloWidth = std::max(layout.haloWidth, 1u);
+        tileMask = layout.tileSize - 1;
+
+        tilesX = (layout.width + layout.tileSize - 1) >> tileShift;
+        unsigned int tilesY = (layout.height + layout.tileSize - 1) >> tileShift;
+
+        // Rows start with enough padding for the halo that the tile's first cell sits on an alignment boundary
+        leftPadding = simd::paddedLength<Storage>(layout.haloWidth);
+        std::size_t stride = simd::paddedLength<Storage>(leftPadding + layout.tileSize + layout.haloWidth);
+        tilePlaneSize = stride * (layout.tileSize + 2 * layout.haloWidth);
+
+        storageBytes = tilePlaneSize * ChemicalCount * tilesX * tilesY * sizeof(Storage);
+        storage = static_cast<Storage *>(GridArena::shared().allocate(storageBytes));
+
+        tiles.clear();
+        Storage *next = storage;
+        for(unsigned int ty = 0; ty < tilesY; ++ty) {
+            for(unsigned int tx = 0; tx < tilesX; ++tx) {
+                Tile tile{};
+                tile.x = tx << tileShift;
+                tile.y = ty << tileShift;
+                tile.width = std::min(layout.tileSize, layout.width - tile.x);
+                tile.height = std::min(layout.tileSize, layout.height - tile.y);
+                tile.stride = stride;
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    tile.planes[chem] = next + layout.haloWidth * stride + leftPadding;
+                    next += tilePlaneSize;
+                }
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    /// The coordinate within [0, size) that a coordinate beyond an edge wraps or mirrors to
+    inline unsigned int boundaryCoordinate(int coordinate, unsigned int size) const {
+        return foldCoordinate(coordinate, size, layout.boundary != BoundaryCondition::Periodic);
+    }
+
+    /// The stored value of cell x of row y (which is within the grid) beyond the left or right edge
+    inline Storage beyondValue(unsigned int chem, unsigned int y, int x, Storage boundaryValue) const {
+        if(layout.boundary == BoundaryCondition::FixedValue) {
+            return boundaryValue;
+        }
+        const unsigned int sourceX = boundaryCoordinate(x, layout.width);
+        return tileAt(sourceX, y).row(chem, y & tileMask)[sourceX & tileMask];
+    }
+
+    /// Copies the stored cells [begin, end) of row y of the given chemical into out, from however many tiles they span
+    void copyRun(unsigned int chem, unsigned int y, unsigned int begin, unsigned int end, Storage *out) const {
+        for(unsigned int x = begin; x < end;) {
+            const Tile &owner = tileAt(x, y);
+            unsigned int count = std::min(end, owner.x + owner.width) - x;
+            std::memcpy(out + (x - begin), owner.row(chem, y & tileMask) + (x & tileMask), count * sizeof(Storage));
+            x += count;
+        }
+    }
+
+    GridLayout layout;
+    std::array<Scalar, ChemicalCount> boundaryValues{};
+    unsigned int tileShift = 0;
+    unsigned int tileMask = 0;
+    unsigned int tilesX = 0;
+    std::size_t leftPadding = 0;
+    std::size_t tilePlaneSize = 0;
+    Storage *storage = nullptr;
+    std::size_t storageBytes = 0;
+    std::vector<Tile> tiles;
+    std::unique_ptr<std::uint8_t[]> coloring;
 };
 
 #endif //REACTIONDIFFUSION2_REACTIONSTATE_HPP
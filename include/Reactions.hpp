@@ -0,0 +1,245 @@
+/**
+ * The local kinetics of each reaction model, written once over simd batches so the same code serves the vectorised
+ * kernels (see StencilKernel) and, one cell at a time, the virtual models (see StaticReactionModel).
+ *
+ * A reaction is a small struct of parameters with
+ *  - Scalar and ChemicalCount,
+ *  - Name, which identifies it in checkpoints,
+ *  - react<Batch>(conc, conv, out), the concentrations after one step given the current ones and their convolution,
+ *  - background(), the uniform state the grid starts from and its edges are held at,
+ *  - parameters(), its parameters in a fixed order for checkpoints,
+ *  - diffusion() and timeStep(), each chemical's diffusion rate and the time react() advances by,
+ *  - linear() and nonlinear<Batch>(conc, out), the kinetics without diffusion split into a diagonal linear part and
+ *    the rest, for integrators that step the linear part exactly (see SpectralSolver).
+ * Every react() is an explicit Euler step: diffusion is the convolution scaled by each chemical's rate.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_REACTIONS_HPP
+#define REACTIONDIFFUSION2_REACTIONS_HPP
+
+#include <array>
+#include <vector>
+
+#include "Simd.hpp"
+
+/**
+ * Gray-Scott: A feeds the reaction A + 2B -> 3B and B is killed off. Both concentrations are clamped to [0, 1] and
+ * the step is a whole time unit, as the model has always been run.
+ * @tparam ScalarType the type concentrations are computed in
+ */
+template <typename ScalarType = double>
+struct GrayScottReaction {
+    using Scalar = ScalarType;
+    static constexpr unsigned int ChemicalCount = 2;
+    static constexpr const char *Name = "gray-scott";
+
+    Scalar feed = 0.055, kill = 0.062, dA = 1.0, dB = 0.5;
+
+    template <typename Batch>
+    inline void react(const std::array<Batch, 2> &conc, const std::array<Batch, 2> &conv, std::array<Batch, 2> &out) const {
+        const Batch zero = Batch::broadcast(Scalar(0));
+        const Batch one = Batch::broadcast(Scalar(1));
+        const Batch reaction = conc[0] * conc[1] * conc[1];
+
+        const Batch newA = conc[0] + (Batch::broadcast(dA) * conv[0] - reaction + Batch::broadcast(feed) * (one - conc[0]));
+        const Batch newB = conc[1] + (Batch::broadcast(dB) * conv[1] + reaction - Batch::broadcast(kill + feed) * conc[1]);
+
+        out[0] = min(one, max(zero, newA));
+        out[1] = min(one, max(zero, newB));
+    }
+
+    std::array<Scalar, 2> background() const {
+        return {1, 0};
+    }
+
+    std::vector<double> parameters() const {
+        return {feed, kill, dA, dB};
+    }
+
+    std::array<Scalar, 2> diffusion() const {
+        return {dA, dB};
+    }
+
+    Scalar timeStep() const {
+        return 1;
+    }
+
+    std::array<Scalar, 2> linear() const {
+        return {-feed, -(kill + feed)};
+    }
+
+    template <typename Batch>
+    inline void nonlinear(const std::array<Batch, 2> &conc, std::array<Batch, 2> &out) const {
+        const Batch reaction = conc[0] * conc[1] * conc[1];
+        out[0] = Batch::broadcast(feed) - reaction;
+        out[1] = reaction;
+    }
+};
+
+/**
+ * The Brusselator, u' = a - (b + 1)u + u^2 v and v' = bu - u^2 v, which settles to u = a, v = b / a and forms Turing
+ * patterns about it when b > (1 + a sqrt(dU / dV))^2 (and b < 1 + a^2 keeps it from oscillating).
+ * @tparam ScalarType the type concentrations are computed in
+ */
+template <typename ScalarType = double>
+struct BrusselatorReaction {
+    using Scalar = ScalarType;
+    static constexpr unsigned int ChemicalCount = 2;
+    static constexpr const char *Name = "brusselator";
+
+    Scalar a = 3, b = 6, dU = 0.5, dV = 4, dt = 0.1;
+
+    template <typename Batch>
+    inline void react(const std::array<Batch, 2> &conc, const std::array<Batch, 2> &conv, std::array<Batch, 2> &out) const {
+        const Batch zero = Batch::broadcast(Scalar(0));
+        const Batch step = Batch::broadcast(dt);
+        const Batch u = conc[0], v = conc[1];
+        const Batch uuv = u * u * v;
+
+        const Batch du = Batch::broadcast(dU) * conv[0] + Batch::broadcast(a) - Batch::broadcast(b + 1) * u + uuv;
+        const Batch dv = Batch::broadcast(dV) * conv[1] + Batch::broadcast(b) * u - uuv;
+
+        out[0] = max(zero, u + step * du);
+        out[1] = max(zero, v + step * dv);
+    }
+
+    std::array<Scalar, 2> background() const {
+        return {a, b / a};
+    }
+
+    std::vector<double> parameters() const {
+        return {a, b, dU, dV, dt};
+    }
+
+    std::array<Scalar, 2> diffusion() const {
+        return {dU, dV};
+    }
+
+    Scalar timeStep() const {
+        return dt;
+    }
+
+    std::array<Scalar, 2> linear() const {
+        return {-(b + 1), 0};
+    }
+
+    template <typename Batch>
+    inline void nonlinear(const std::array<Batch, 2> &conc, std::array<Batch, 2> &out) const {
+        const Batch uuv = conc[0] * conc[0] * conc[1];
+        out[0] = Batch::broadcast(a) + uuv;
+        out[1] = Batch::broadcast(b) * conc[0] - uuv;
+    }
+};
+
+/**
+ * FitzHugh-Nagumo, an activator u' = u - u^3 - v with a slower inhibitor v' = epsilon (u - a1 v - a0). With the
+ * inhibitor diffusing faster and epsilon a1 > 1 > a1 the rest state is stable but Turing unstable, giving labyrinths.
+ * Concentrations are signed and unbounded.
+ * @tparam ScalarType the type concentrations are computed in
+ */
+template <typename ScalarType = double>
+struct FitzHughNagumoReaction {
+    using Scalar = ScalarType;
+    static constexpr unsigned int ChemicalCount = 2;
+    static constexpr const char *Name = "fitzhugh-nagumo";
+
+    Scalar a0 = 0, a1 = 0.5, epsilon = 3, dU = 0.5, dV = 6, dt = 0.1;
+
+    template <typename Batch>
+    inline void react(const std::array<Batch, 2> &conc, const std::array<Batch, 2> &conv, std::array<Batch, 2> &out) const {
+        const Batch step = Batch::broadcast(dt);
+        const Batch u = conc[0], v = conc[1];
+
+        const Batch du = Batch::broadcast(dU) * conv[0] + u - u * u * u - v;
+        const Batch dv = Batch::broadcast(dV) * conv[1] + Batch::broadcast(epsilon) * (u - Batch::broadcast(a1) * v - Batch::broadcast(a0));
+
+        out[0] = u + step * du;
+        out[1] = v + step * dv;
+    }
+
+    std::array<Scalar, 2> background() const {
+        // The rest state for a0 = 0, otherwise the grid relaxes to it from here
+        return {0, 0};
+    }
+
+    std::vector<double> parameters() const {
+        return {a0, a1, epsilon, dU, dV, dt};
+    }
+
+    std::array<Scalar, 2> diffusion() const {
+        return {dU, dV};
+    }
+
+    Scalar timeStep() const {
+        return dt;
+    }
+
+    std::array<Scalar, 2> linear() const {
+        // The activator's linear growth is left explicit, stepping it exactly would only amplify the cubic term
+        return {0, -epsilon * a1};
+    }
+
+    template <typename Batch>
+    inline void nonlinear(const std::array<Batch, 2> &conc, std::array<Batch, 2> &out) const {
+        const Batch u = conc[0], v = conc[1];
+        out[0] = u - u * u * u - v;
+        out[1] = Batch::broadcast(epsilon) * (u - Batch::broadcast(a0));
+    }
+};
+
+/**
+ * Schnakenberg, u' = a - u + u^2 v and v' = b - u^2 v, which settles to u = a + b, v = b / (a + b)^2 and forms spots
+ * when the substrate v diffuses much faster than u.
+ * @tparam ScalarType the type concentrations are computed in
+ */
+template <typename ScalarType = double>
+struct SchnakenbergReaction {
+    using Scalar = ScalarType;
+    static constexpr unsigned int ChemicalCount = 2;
+    static constexpr const char *Name = "schnakenberg";
+
+    Scalar a = 0.1, b = 0.9, dU = 0.25, dV = 5, dt = 0.1;
+
+    template <typename Batch>
+    inline void react(const std::array<Batch, 2> &conc, const std::array<Batch, 2> &conv, std::array<Batch, 2> &out) const {
+        const Batch zero = Batch::broadcast(Scalar(0));
+        const Batch step = Batch::broadcast(dt);
+        const Batch u = conc[0], v = conc[1];
+        const Batch uuv = u * u * v;
+
+        const Batch du = Batch::broadcast(dU) * conv[0] + Batch::broadcast(a) - u + uuv;
+        const Batch dv = Batch::broadcast(dV) * conv[1] + Batch::broadcast(b) - uuv;
+
+        out[0] = max(zero, u + step * du);
+        out[1] = max(zero, v + step * dv);
+    }
+
+    std::array<Scalar, 2> background() const {
+        return {a + b, b / ((a + b) * (a + b))};
+    }
+
+    std::vector<double> parameters() const {
+        return {a, b, dU, dV, dt};
+    }
+
+    std::array<Scalar, 2> diffusion() const {
+        return {dU, dV};
+    }
+
+    Scalar timeStep() const {
+        return dt;
+    }
+
+    std::array<Scalar, 2> linear() const {
+        return {-1, 0};
+    }
+
+    template <typename Batch>
+    inline void nonlinear(const std::array<Batch, 2> &conc, std::array<Batch, 2> &out) const {
+        const Batch uuv = conc[0] * conc[0] * conc[1];
+        out[0] = Batch::broadcast(a) + uuv;
+        out[1] = Batch::broadcast(b) - uuv;
+    }
+};
+
+#endif //REACTIONDIFFUSION2_REACTIONS_HPP
@@ -0,0 +1,636 @@
+/**
+ * Recording a simulation as it runs, for looking at later. A recording is a stream of frames, each either the RGBA
+ * colouring of the grid or its chemical planes as stored, and each one compressed by
+ *  - XORing it with the frame before, so the cells that didn't change become zero bytes (every keyframeInterval
+ *    frames is a keyframe that isn't, so reading can start there),
+ *  - shuffling the bytes so byte 0 of every value comes first, then byte 1 and so on, which groups the bytes that
+ *    rarely change (high bytes of floats, colour channels) into long runs,
+ *  - and run length encoding the result.
+ * Frames are written as they come and indexed at the end, so a recording cut short is still readable up to its last
+ * complete frame.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_RECORDING_HPP
+#define REACTIONDIFFUSION2_RECORDING_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Checkpoint.hpp"
+#include "ReactionDiffusion.hpp"
+
+/// What each frame of a recording holds
+enum class RecordingContent : std::uint32_t {
+    /// The RGBA colouring of ReactionDiffusion::getColoring
+    Coloring = 1,
+    /// Each chemical plane in turn, row by row, as the grid stores it
+    State = 2
+};
+
+namespace recording {
+
+/**
+ * Moves byte b of each of count values of valueSize bytes to out[b * count + i], so the same byte of every value
+ * ends up together
+ */
+inline void shuffle(const std::uint8_t *in, std::uint8_t *out, std::size_t count, std::size_t valueSize) {
+    for(std::size_t b = 0; b < valueSize; ++b) {
+        std::uint8_t *plane = out + b * count;
+        for(std::size_t i = 0; i < count; ++i) {
+            plane[i] = in[i * valueSize + b];
+        }
+    }
+}
+
+/// Undoes shuffle
+inline void unshuffle(const std::uint8_t *in, std::uint8_t *out, std::size_t count, std::size_t valueSize) {
+    for(std::size_t b = 0; b < valueSize; ++b) {
+        const std::uint8_t *plane = in + b * count;
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i * valueSize + b] = plane[i];
+        }
+    }
+}
+
+/*
+ * Run length encoding. Each control byte c is followed by
+ *  - c in [0, 127]: c + 1 literal bytes,
+ *  - c in [128, 254]: one byte repeated c - 125 times (3 to 129),
+ *  - c == 255: a LEB128 count and one byte repeated that many times, for the long runs of zeros a delta is mostly made of.
+ */
+constexpr std::size_t MaxLiteral = 128;
+constexpr std::size_t MinRun = 3;
+constexpr std::size_t MaxShortRun = 129;
+constexpr std::uint8_t LongRun = 255;
+
+/// Appends the run length encoding of size bytes to out
+inline void encodeRuns(const std::uint8_t *in, std::size_t size, std::vector<std::uint8_t> &out) {
+    std::size_t literalStart = 0;
+    auto flushLiterals = [&](std::size_t end) {
+        while(literalStart < end) {
+            const std::size_t count = std::min(MaxLiteral, end - literalStart);
+            out.push_back(static_cast<std::uint8_t>(count - 1));
+            out.insert(out.end(), in + literalStart, in + literalStart + count);
+            literalStart += count;
+        }
+    };
+
+    std::size_t i = 0;
+    while(i < size) {
+        const std::uint8_t value = in[i];
+        std::size_t run = 1;
+        // Long runs are compared a word at a time
+        const std::uint64_t pattern = value * 0x0101010101010101ull;
+        while(i + run + sizeof(pattern) <= size) {
+            std::uint64_t word;
+            std::memcpy(&word, in + i + run, sizeof(word));
+            if(word != pattern) {
+                break;
+            }
+            run += sizeof(pattern);
+        }
+        while(i + run < size && in[i + run] == value) {
+            ++run;
+        }
+
+        if(run < MinRun) {
+            i += run;
+            continue;
+        }
+
+        flushLiterals(i);
+        if(run <= MaxShortRun) {
+            out.push_back(static_cast<std::uint8_t>(run + 125));
+        } else {
+            out.push_back(LongRun);
+            for(std::size_t remaining = run; ; remaining >>= 7) {
+                out.push_back(static_cast<std::uint8_t>((remaining & 0x7F) | (remaining > 0x7F ? 0x80 : 0)));
+                if(remaining <= 0x7F) {
+                    break;
+                }
+            }
+        }
+        out.push_back(value);
+        i += run;
+        literalStart = i;
+    }
+    flushLiterals(size);
+}
+
+/**
+ * Decodes runs from in into exactly size bytes of out.
+ * @return false if the encoding is corrupt or doesn't decode to size bytes
+ */
+inline bool decodeRuns(const std::uint8_t *in, std::size_t inSize, std::uint8_t *out, std::size_t size) {
+    std::size_t read = 0, written = 0;
+    while(read < inSize) {
+        const std::uint8_t control = in[read++];
+        if(control < MaxLiteral) {
+            const std::size_t count = control + 1u;
+            if(read + count > inSize || written + count > size) {
+                return false;
+            }
+            std::memcpy(out + written, in + read, count);
+            read += count;
+            written += count;
+            continue;
+        }
+
+        std::size_t count = 0;
+        if(control == LongRun) {
+            for(unsigned int shift = 0; ; shift += 7) {
+                if(read >= inSize || shift >= 64) {
+                    return false;
+                }
+                const std::uint8_t byte = in[read++];
+                count |= static_cast<std::size_t>(byte & 0x7F) << shift;
+                if((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+        } else {
+            count = control - 125u;
+        }
+
+        if(read >= inSize || count > size - written) {
+            return false;
+        }
+        std::memset(out + written, in[read++], count);
+        written += count;
+    }
+    return written == size;
+}
+
+/// The start of every recording, integers in the byte order of the machine that wrote it as for checkpoints
+struct Header {
+    static constexpr char Magic[8] = {'R', 'D', 'R', 'E', 'C', '\r', '\n', '\0'};
+    static constexpr std::uint32_t CurrentVersion = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t width;
+    std::uint32_t height;
+    /// A RecordingContent
+    std::uint32_t content;
+    /// Frames hold planeCount planes of width * height values of valueSize bytes
+    std::uint32_t planeCount;
+    std::uint32_t valueSize;
+    /// The CheckpointType of the values of a State recording, 0 for a Coloring one
+    std::uint32_t storageType;
+    std::uint32_t keyframeInterval;
+    std::uint32_t reserved;
+
+    std::uint64_t frameBytes() const {
+        return static_cast<std::uint64_t>(width) * height * planeCount * valueSize;
+    }
+
+    std::uint64_t valueCount() const {
+        return static_cast<std::uint64_t>(width) * height * planeCount;
+    }
+};
+
+/// Precedes each frame in the stream
+struct FrameHeader {
+    static constexpr std::uint32_t Magic = 0x4D415246; // "FRAM"
+    static constexpr std::uint32_t Keyframe = 1;
+
+    std::uint32_t magic;
+    std::uint32_t flags;
+    std::uint64_t stepCount;
+    std::uint64_t encodedSize;
+};
+
+/// One entry of the index at the end of a recording
+struct IndexEntry {
+    std::uint64_t offset;
+    std::uint64_t stepCount;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+};
+
+/// The last bytes of a complete recording
+struct Footer {
+    static constexpr char Magic[8] = {'R', 'D', 'R', 'I', 'N', 'D', 'E', 'X'};
+
+    std::uint64_t indexOffset;
+    std::uint64_t frameCount;
+    char magic[8];
+};
+
+} // namespace recording
+
+/**
+ * Records frames of a simulation to a file. Taking a frame only costs the stepping thread one copy of it, compressing
+ * and writing it happen on a thread of the recorder's own. At most queueLength frames wait to be written: a frame
+ * that arrives while they are all taken is dropped (and counted) rather than holding up the simulation.
+ */
+class FrameRecorder {
+public:
+    explicit FrameRecorder(unsigned int keyframeInterval = 32, unsigned int queueLength = 4)
+            : keyframeInterval(std::max(1u, keyframeInterval)), queueLength(std::max(1u, queueLength)) {}
+
+    ~FrameRecorder() {
+        close();
+    }
+
+    // Non-copyable
+    FrameRecorder(const FrameRecorder &other)= delete;
+    FrameRecorder& operator=(const FrameRecorder &source)= delete;
+
+    /**
+     * Starts a recording of model at path, replacing any file there.
+     * @return an empty string on success, otherwise why it failed
+     */
+    template <unsigned int ChemicalCount, typename Precision>
+    std::string open(const std::string &path, const ReactionDiffusion<ChemicalCount, Precision> &model, RecordingContent content) {
+        close();
+
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if(!file) {
+            return "Could not open " + path + " for writing";
+        }
+
+        header = recording::Header{};
+        std::memcpy(header.magic, recording::Header::Magic, sizeof(header.magic));
+        header.version = recording::Header::CurrentVersion;
+        header.byteOrder = CheckpointHeader::ByteOrderMark;
+        header.width = model.getState().getWidth();
+        header.height = model.getState().getHeight();
+        header.content = static_cast<std::uint32_t>(content);
+        if(content == RecordingContent::Coloring) {
+            header.planeCount = 1;
+            header.valueSize = 4;
+            header.storageType = 0;
+        } else {
+            header.planeCount = ChemicalCount;
+            header.valueSize = sizeof(typename Precision::Storage);
+            header.storageType = static_cast<std::uint32_t>(CheckpointTypeOf<typename Precision::Storage>::value);
+        }
+        header.keyframeInterval = keyframeInterval;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        this->path = path;
+        index.clear();
+        error.clear();
+        dropped = 0;
+        recorded = 0;
+        stopping = false;
+        freeFrames.assign(queueLength, std::vector<std::uint8_t>(header.frameBytes()));
+        thread = std::thread([this]() { run(); });
+        return {};
+    }
+
+    bool isOpen() const {
+        return thread.joinable();
+    }
+
+    /**
+     * Queues the current frame of model, which must be the one the recording was opened with. Colouring a Coloring
+     * recording uses model.getColoring(), which also resets the rows getChangedRows reports.
+     * @return false if the frame was dropped because the queue was full
+     */
+    template <unsigned int ChemicalCount, typename Precision>
+    bool record(ReactionDiffusion<ChemicalCount, Precision> &model) {
+        std::vector<std::uint8_t> frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(freeFrames.empty()) {
+                ++dropped;
+                return false;
+            }
+            frame = std::move(freeFrames.back());
+            freeFrames.pop_back();
+        }
+        REACTIONDIFFUSION2_PROFILE_SCOPE("record capture");
+
+        if(static_cast<RecordingContent>(header.content) == RecordingContent::Coloring) {
+            std::memcpy(frame.data(), model.getColoring(), frame.size());
+        } else {
+            using Storage = typename Precision::Storage;
+            auto out = reinterpret_cast<Storage *>(frame.data());
+            for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                for(unsigned int y = 0; y < header.height; ++y) {
+                    model.getState().copyStoredRow(chem, y, out);
+                    out += header.width;
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back({model.getStepCount(), std::move(frame)});
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    /**
+     * Writes every queued frame and the index and closes the file.
+     * @return the first error writing the recording hit, or an empty string
+     */
+    std::string close() {
+        if(!thread.joinable()) {
+            return {};
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+
+        const std::uint64_t indexOffset = static_cast<std::uint64_t>(file.tellp());
+        file.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(recording::IndexEntry)));
+        recording::Footer footer{indexOffset, index.size(), {}};
+        std::memcpy(footer.magic, recording::Footer::Magic, sizeof(footer.magic));
+        file.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+        file.close();
+
+        if(!file && error.empty()) {
+            error = "Could not write " + path;
+        }
+        return error;
+    }
+
+    /// The frames dropped because the writer fell behind
+    unsigned long long getDroppedFrames() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    unsigned long long getRecordedFrames() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recorded;
+    }
+
+private:
+    struct QueuedFrame {
+        unsigned long long stepCount;
+        std::vector<std::uint8_t> bytes;
+    };
+
+    void run() {
+        REACTIONDIFFUSION2_PROFILE_THREAD("recorder");
+        std::vector<std::uint8_t> previous(header.frameBytes());
+        std::vector<std::uint8_t> delta(header.frameBytes());
+        std::vector<std::uint8_t> shuffled(header.frameBytes());
+        std::vector<std::uint8_t> encoded;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+            if(queued.empty()) {
+                return;
+            }
+            QueuedFrame frame = std::move(queued.front());
+            queued.pop_front();
+            const bool keyframe = recorded % keyframeInterval == 0;
+            lock.unlock();
+            REACTIONDIFFUSION2_PROFILE_SCOPE("record encode", 0, static_cast<double>(frame.bytes.size()));
+
+            const std::uint8_t *source = frame.bytes.data();
+            if(!keyframe) {
+                for(std::size_t i = 0; i < delta.size(); ++i) {
+                    delta[i] = frame.bytes[i] ^ previous[i];
+                }
+                source = delta.data();
+            }
+            recording::shuffle(source, shuffled.data(), header.valueCount(), header.valueSize);
+            encoded.clear();
+            recording::encodeRuns(shuffled.data(), shuffled.size(), encoded);
+
+            recording::FrameHeader frameHeader{recording::FrameHeader::Magic, keyframe ? recording::FrameHeader::Keyframe : 0,
+                                               frame.stepCount, encoded.size()};
+            index.push_back({static_cast<std::uint64_t>(file.tellp()), frame.stepCount, frameHeader.flags, 0});
+            file.write(reinterpret_cast<const char *>(&frameHeader), sizeof(frameHeader));
+            file.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+            std::swap(previous, frame.bytes);
+
+            lock.lock();
+            if(!file && error.empty()) {
+                error = "Could not write " + path;
+            }
+            ++recorded;
+            freeFrames.push_back(std::move(frame.bytes));
+        }
+    }
+
+    const unsigned int keyframeInterval;
+    const unsigned int queueLength;
+
+    // Only touched by the writer thread while it runs
+    std::ofstream file;
+    std::string path;
+    recording::Header header{};
+    std::vector<recording::IndexEntry> index;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<QueuedFrame> queued;
+    std::vector<std::vector<std::uint8_t>> freeFrames;
+    std::string error;
+    unsigned long long dropped = 0;
+    unsigned long long recorded = 0;
+    bool stopping = false;
+
+    std::thread thread;
+};
+
+/**
+ * Reads frames back from a recording in any order. Reading a frame decodes forward from the keyframe before it, or
+ * from the frame read last when that is closer, so reading in order costs one decode per frame.
+ */
+class RecordingReader {
+public:
+    /**
+     * Opens the recording at path and loads its index, rebuilding it from the frames if the recording was cut short.
+     * @return an empty string on success, otherwise why it can't be read
+     */
+    std::string open(const std::string &path) {
+        file.close();
+        file.clear();
+        index.clear();
+        current = NoFrame;
+
+        file.open(path, std::ios::binary);
+        if(!file) {
+            return "Could not open " + path;
+        }
+        if(!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+           || std::memcmp(header.magic, recording::Header::Magic, sizeof(header.magic)) != 0) {
+            return path + " is not a recording";
+        }
+        if(header.byteOrder != CheckpointHeader::ByteOrderMark) {
+            return path + " was written on a machine of a different byte order";
+        }
+        if(header.version != recording::Header::CurrentVersion) {
+            return path + " is recording version " + std::to_string(header.version) + ", only version "
+                   + std::to_string(recording::Header::CurrentVersion) + " is supported";
+        }
+        if(header.valueSize == 0 || header.planeCount == 0) {
+            return path + " has a corrupt header";
+        }
+
+        if(!readIndex()) {
+            scanFrames();
+        }
+        if(!index.empty() && (index.front().flags & recording::FrameHeader::Keyframe) == 0) {
+            return path + " does not start with a keyframe";
+        }
+
+        frame.assign(header.frameBytes(), 0);
+        return {};
+    }
+
+    const recording::Header &getHeader() const {
+        return header;
+    }
+
+    RecordingContent getContent() const {
+        return static_cast<RecordingContent>(header.content);
+    }
+
+    std::size_t getFrameCount() const {
+        return index.size();
+    }
+
+    /// The step the simulation was at when frame was recorded
+    unsigned long long getStepCount(std::size_t frame) const {
+        return index[frame].stepCount;
+    }
+
+    /// The first frame recorded at or after stepCount, getFrameCount() if there is none
+    std::size_t findStep(unsigned long long stepCount) const {
+        auto found = std::lower_bound(index.begin(), index.end(), stepCount, [](const recording::IndexEntry &entry, unsigned long long step) {
+            return entry.stepCount < step;
+        });
+        return static_cast<std::size_t>(found - index.begin());
+    }
+
+    /**
+     * Decodes a frame, header.frameBytes() bytes laid out as described by RecordingContent.
+     * @return the frame, or nullptr if it is out of range or corrupt. Valid until the next call
+     */
+    const std::uint8_t *readFrame(std::size_t target) {
+        if(target >= index.size()) {
+            return nullptr;
+        }
+
+        // Carry on from the frame already decoded if no keyframe lies between it and the target
+        std::size_t next = target;
+        while((index[next].flags & recording::FrameHeader::Keyframe) == 0 && next != current + 1 && next != current) {
+            --next;
+        }
+        if(next == current) {
+            return frame.data();
+        }
+
+        for(; next <= target; ++next) {
+            if(!decodeFrame(next)) {
+                current = NoFrame;
+                return nullptr;
+            }
+            current = next;
+        }
+        return frame.data();
+    }
+
+private:
+    static constexpr std::size_t NoFrame = static_cast<std::size_t>(-2);
+
+    /// Loads the index from the footer of a complete recording
+    bool readIndex() {
+        recording::Footer footer{};
+        file.seekg(0, std::ios::end);
+        const std::streamoff size = file.tellg();
+        if(size < static_cast<std::streamoff>(sizeof(recording::Header) + sizeof(footer))) {
+            return false;
+        }
+        file.seekg(size - static_cast<std::streamoff>(sizeof(footer)));
+        if(!file.read(reinterpret_cast<char *>(&footer), sizeof(footer))
+           || std::memcmp(footer.magic, recording::Footer::Magic, sizeof(footer.magic)) != 0
+           || footer.indexOffset + footer.frameCount * sizeof(recording::IndexEntry) + sizeof(footer) != static_cast<std::uint64_t>(size)) {
+            file.clear();
+            return false;
+        }
+
+        index.resize(footer.frameCount);
+        file.seekg(static_cast<std::streamoff>(footer.indexOffset));
+        file.read(reinterpret_cast<char *>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(recording::IndexEntry)));
+        if(!file) {
+            file.clear();
+            index.clear();
+            return false;
+        }
+        return true;
+    }
+
+    /// Rebuilds the index by walking the frames, stopping at the first incomplete one
+    void scanFrames() {
+        file.seekg(0, std::ios::end);
+        const std::uint64_t size = static_cast<std::uint64_t>(file.tellg());
+        std::uint64_t offset = sizeof(recording::Header);
+
+        while(offset + sizeof(recording::FrameHeader) <= size) {
+            recording::FrameHeader frameHeader{};
+            file.seekg(static_cast<std::streamoff>(offset));
+            if(!file.read(reinterpret_cast<char *>(&frameHeader), sizeof(frameHeader)) || frameHeader.magic != recording::FrameHeader::Magic
+               || offset + sizeof(frameHeader) + frameHeader.encodedSize > size) {
+                break;
+            }
+            index.push_back({offset, frameHeader.stepCount, frameHeader.flags, 0});
+            offset += sizeof(frameHeader) + frameHeader.encodedSize;
+        }
+        file.clear();
+    }
+
+    /// Decodes frame number position on top of the frame before it, which must be in frame unless it is a keyframe
+    bool decodeFrame(std::size_t position) {
+        const recording::IndexEntry &entry = index[position];
+        recording::FrameHeader frameHeader{};
+        file.seekg(static_cast<std::streamoff>(entry.offset));
+        if(!file.read(reinterpret_cast<char *>(&frameHeader), sizeof(frameHeader)) || frameHeader.magic != recording::FrameHeader::Magic) {
+            file.clear();
+            return false;
+        }
+
+        encoded.resize(frameHeader.encodedSize);
+        shuffled.resize(frame.size());
+        if(!file.read(reinterpret_cast<char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()))
+           || !recording::decodeRuns(encoded.data(), encoded.size(), shuffled.data(), shuffled.size())) {
+            file.clear();
+            return false;
+        }
+
+        if(frameHeader.flags & recording::FrameHeader::Keyframe) {
+            recording::unshuffle(shuffled.data(), frame.data(), header.valueCount(), header.valueSize);
+        } else {
+            delta.resize(frame.size());
+            recording::unshuffle(shuffled.data(), delta.data(), header.valueCount(), header.valueSize);
+            for(std::size_t i = 0; i < frame.size(); ++i) {
+                frame[i] ^= delta[i];
+            }
+        }
+        return true;
+    }
+
+    std::ifstream file;
+    recording::Header header{};
+    std::vector<recording::IndexEntry> index;
+
+    std::vector<std::uint8_t> frame, delta, shuffled, encoded;
+    /// The frame held in frame, NoFrame if none
+    std::size_t current = NoFrame;
+};
+
+#endif //REACTIONDIFFUSION2_RECORDING_HPP
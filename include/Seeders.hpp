@@ -2,52 +2,72 @@
 #ifndef REACTIONDIFFUSION2_SEEDERS_HPP
 #define REACTIONDIFFUSION2_SEEDERS_HPP
 
+#include <algorithm>
+#include <cstdint>
+
+#include "Random.hpp"
 #include "ReactionState.hpp"
+#include "VolumeState.hpp"
 
-template <unsigned int CellDim, unsigned int ChemicalCount>
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
 class AbstractSeeder {
 public:
-    virtual void seed(ReactionState<CellDim, ChemicalCount> &state)= 0;
+    virtual void seed(ReactionState<ChemicalCount, Precision> &state)= 0;
     virtual ~AbstractSeeder()= default;
 };
 
 /**
  * Seeds a square in the center
- * @tparam CellDim the number of cells along an edge
  * @tparam ChemicalCount the number of chemicals
+ * @tparam Precision the ScalarPrecision of the state
  */
-template <unsigned int CellDim, unsigned int ChemicalCount>
-class SquareCenterSeed : public AbstractSeeder<CellDim, ChemicalCount> {
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class SquareCenterSeed : public AbstractSeeder<ChemicalCount, Precision> {
 public:
-    SquareCenterSeed(unsigned int size, const std::array<double, ChemicalCount> &setTo) : size(size/2), setTo(setTo) {};
+    using Scalar = typename Precision::Scalar;
+
+    SquareCenterSeed(unsigned int size, const std::array<Scalar, ChemicalCount> &setTo) : size(size/2), setTo(setTo) {};
+
+    void seed(ReactionState<ChemicalCount, Precision> &state) override {
+        unsigned int centerX = state.getWidth()/2;
+        unsigned int centerY = state.getHeight()/2;
 
-    void seed(ReactionState<CellDim, ChemicalCount> &state) override {
-        for(unsigned int x = CellDim/2 - size; x < (CellDim/2)+size; ++x) {
-            for(unsigned int y = CellDim/2 - size; y < (CellDim/2)+size; ++y) {
-                state.getConcentration(x, y).conc = setTo;
+        for(unsigned int x = centerX - std::min(size, centerX); x < std::min(centerX + size, state.getWidth()); ++x) {
+            for(unsigned int y = centerY - std::min(size, centerY); y < std::min(centerY + size, state.getHeight()); ++y) {
+                state.setConcentration(x, y, setTo);
             }
         }
     }
 
 private:
     const unsigned int size;
-    const std::array<double, ChemicalCount> setTo;
+    const std::array<Scalar, ChemicalCount> setTo;
 };
 
-template <unsigned int CellDim, unsigned int ChemicalCount>
-class SpotSeeder : public AbstractSeeder<CellDim, ChemicalCount> {
+/**
+ * Seeds spots of random sizes at random places
+ * @tparam ChemicalCount the number of chemicals
+ * @tparam Precision the ScalarPrecision of the state
+ */
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class SpotSeeder : public AbstractSeeder<ChemicalCount, Precision> {
 public:
-    SpotSeeder(unsigned int numSpots, unsigned int minSize, unsigned int maxSize, const std::array<double, ChemicalCount> &setTo)
-    : numSpots(numSpots), minSize(minSize), maxSize(maxSize), setTo(setTo) {}
+    using Scalar = typename Precision::Scalar;
 
-    void seed(ReactionState<CellDim, ChemicalCount> &state) override {
-        static RandomRange randSpot(0, CellDim);
-        static RandomRange randSize(minSize, maxSize);
+    /// @param randomSeed the same seed places the same spots every time
+    SpotSeeder(unsigned int numSpots, unsigned int minSize, unsigned int maxSize, const std::array<Scalar, ChemicalCount> &setTo,
+               std::uint64_t randomSeed = ::randomSeed())
+    : numSpots(numSpots), minSize(minSize), maxSize(maxSize), setTo(setTo), randomSeed(randomSeed) {}
+
+    void seed(ReactionState<ChemicalCount, Precision> &state) override {
+        RandomRange randX(0, state.getWidth(), randomSeed, 0);
+        RandomRange randY(0, state.getHeight(), randomSeed, 1);
+        RandomRange randSize(minSize, maxSize, randomSeed, 2);
 
         for(unsigned int i = 0; i < numSpots; ++i) {
             unsigned int size = randSize()/2;
-            unsigned int x = randSpot();
-            unsigned int y = randSpot();
+            unsigned int x = randX();
+            unsigned int y = randY();
 
             // Start within bounds
             x = size >= x ? 0 : x;
@@ -56,12 +76,12 @@ public:
             unsigned int endX = x + size;
             unsigned int endY = y + size;
 
-            endX = x + size >= CellDim ? CellDim - 1 : endX;
-            endY = y + size >= CellDim ? CellDim - 1 : endY;
+            endX = x + size >= state.getWidth() ? state.getWidth() - 1 : endX;
+            endY = y + size >= state.getHeight() ? state.getHeight() - 1 : endY;
 
             for(; x < endX; ++x) {
                 for(; y < endY; ++y) {
-                    state.getConcentration(x, y).conc = setTo;
+                    state.setConcentration(x, y, setTo);
                 }
             }
         }
@@ -69,6 +89,93 @@ public:
 
 private:
     const unsigned int numSpots, minSize, maxSize;
-    const std::array<double, ChemicalCount> setTo;
+    const std::array<Scalar, ChemicalCount> setTo;
+    const std::uint64_t randomSeed;
+};
+
+template <unsigned int ChemicalCount, typename Scalar = double>
+class AbstractVolumeSeeder {
+public:
+    virtual void seed(VolumeState<ChemicalCount, Scalar> &state)= 0;
+    virtual ~AbstractVolumeSeeder()= default;
+};
+
+/**
+ * Seeds a cube in the center of a volume, as SquareCenterSeed does a square
+ * @tparam ChemicalCount the number of chemicals
+ * @tparam Scalar the type of the volume's concentrations
+ */
+template <unsigned int ChemicalCount, typename Scalar = double>
+class CubeCenterSeed : public AbstractVolumeSeeder<ChemicalCount, Scalar> {
+public:
+    CubeCenterSeed(unsigned int size, const std::array<Scalar, ChemicalCount> &setTo) : size(size/2), setTo(setTo) {}
+
+    void seed(VolumeState<ChemicalCount, Scalar> &state) override {
+        const unsigned int center[3] = {state.getWidth()/2, state.getHeight()/2, state.getDepth()/2};
+        const unsigned int extent[3] = {state.getWidth(), state.getHeight(), state.getDepth()};
+        unsigned int begin[3], end[3];
+        for(unsigned int axis = 0; axis < 3; ++axis) {
+            begin[axis] = center[axis] - std::min(size, center[axis]);
+            end[axis] = std::min(center[axis] + size, extent[axis]);
+        }
+
+        for(unsigned int z = begin[2]; z < end[2]; ++z) {
+            for(unsigned int y = begin[1]; y < end[1]; ++y) {
+                for(unsigned int x = begin[0]; x < end[0]; ++x) {
+                    state.setConcentration(x, y, z, setTo);
+                }
+            }
+        }
+    }
+
+private:
+    const unsigned int size;
+    const std::array<Scalar, ChemicalCount> setTo;
+};
+
+/**
+ * Seeds balls of random sizes at random places in a volume, as SpotSeeder does spots
+ * @tparam ChemicalCount the number of chemicals
+ * @tparam Scalar the type of the volume's concentrations
+ */
+template <unsigned int ChemicalCount, typename Scalar = double>
+class BallSeeder : public AbstractVolumeSeeder<ChemicalCount, Scalar> {
+public:
+    /// @param randomSeed the same seed places the same balls every time
+    BallSeeder(unsigned int numBalls, unsigned int minSize, unsigned int maxSize, const std::array<Scalar, ChemicalCount> &setTo,
+               std::uint64_t randomSeed = ::randomSeed())
+    : numBalls(numBalls), minSize(minSize), maxSize(maxSize), setTo(setTo), randomSeed(randomSeed) {}
+
+    void seed(VolumeState<ChemicalCount, Scalar> &state) override {
+        RandomRange randX(0, state.getWidth(), randomSeed, 0);
+        RandomRange randY(0, state.getHeight(), randomSeed, 1);
+        RandomRange randZ(0, state.getDepth(), randomSeed, 3);
+        RandomRange randSize(minSize, maxSize, randomSeed, 2);
+
+        for(unsigned int i = 0; i < numBalls; ++i) {
+            const int radius = static_cast<int>(randSize() / 2);
+            const int centerX = static_cast<int>(randX());
+            const int centerY = static_cast<int>(randY());
+            const int centerZ = static_cast<int>(randZ());
+
+            // Clipped to the volume
+            for(int z = std::max(0, centerZ - radius); z <= std::min(static_cast<int>(state.getDepth()) - 1, centerZ + radius); ++z) {
+                for(int y = std::max(0, centerY - radius); y <= std::min(static_cast<int>(state.getHeight()) - 1, centerY + radius); ++y) {
+                    for(int x = std::max(0, centerX - radius); x <= std::min(static_cast<int>(state.getWidth()) - 1, centerX + radius); ++x) {
+                        const int dx = x - centerX, dy = y - centerY, dz = z - centerZ;
+                        if(dx * dx + dy * dy + dz * dz <= radius * radius) {
+                            state.setConcentration(static_cast<unsigned int>(x), static_cast<unsigned int>(y),
+                                                   static_cast<unsigned int>(z), setTo);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const unsigned int numBalls, minSize, maxSize;
+    const std::array<Scalar, ChemicalCount> setTo;
+    const std::uint64_t randomSeed;
 };
 #endif //REACTIONDIFFUSION2_SEEDERS_HPP
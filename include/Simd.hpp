@@ -0,0 +1,216 @@
+/**
+ * Thin wrappers over the SIMD registers of the target so kernels can be written once and instantiated for
+ * AVX-512, AVX2, SSE2 or plain scalars, in double or float. The widest instruction set enabled at compile time is used.
+ */
+#pragma once
+#ifndef REACTIONDIFFUSION2_SIMD_HPP
+#define REACTIONDIFFUSION2_SIMD_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+/// Alignment in bytes used for every plane so that each row starts on a cache line (and any vector register)
+constexpr std::size_t Alignment = 64;
+
+/**
+ * A pack of Width values of type T that supports the arithmetic the kernels need.
+ * Only the specialisations below are defined.
+ */
+template <typename T, unsigned int Width>
+struct Batch;
+
+/// Scalar fallback, also used for the remainder of a row that doesn't fill a full register
+template <typename T>
+struct Batch<T, 1> {
+    static constexpr unsigned int Lanes = 1;
+    T v;
+
+    static Batch load(const T *ptr) { return {*ptr}; }
+    static Batch broadcast(T value) { return {value}; }
+    void store(T *ptr) const { *ptr = v; }
+
+    friend Batch operator+(Batch a, Batch b) { return {a.v + b.v}; }
+    friend Batch operator-(Batch a, Batch b) { return {a.v - b.v}; }
+    friend Batch operator*(Batch a, Batch b) { return {a.v * b.v}; }
+    friend Batch min(Batch a, Batch b) { return {std::min(a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {std::max(a.v, b.v)}; }
+};
+
+#if defined(__AVX512F__)
+template <>
+struct Batch<double, 8> {
+    static constexpr unsigned int Lanes = 8;
+    __m512d v;
+
+    static Batch load(const double *ptr) { return {_mm512_loadu_pd(ptr)}; }
+    static Batch broadcast(double value) { return {_mm512_set1_pd(value)}; }
+    void store(double *ptr) const { _mm512_storeu_pd(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm512_add_pd(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm512_sub_pd(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm512_mul_pd(a.v, b.v)}; }
+    // The zero-masked forms avoid a spurious -Wmaybe-uninitialized from _mm512_undefined_pd in GCC 12
+    friend Batch min(Batch a, Batch b) { return {_mm512_maskz_min_pd(0xFF, a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm512_maskz_max_pd(0xFF, a.v, b.v)}; }
+};
+
+template <>
+struct Batch<float, 16> {
+    static constexpr unsigned int Lanes = 16;
+    __m512 v;
+
+    static Batch load(const float *ptr) { return {_mm512_loadu_ps(ptr)}; }
+    static Batch broadcast(float value) { return {_mm512_set1_ps(value)}; }
+    void store(float *ptr) const { _mm512_storeu_ps(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm512_add_ps(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm512_sub_ps(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm512_mul_ps(a.v, b.v)}; }
+    friend Batch min(Batch a, Batch b) { return {_mm512_maskz_min_ps(0xFFFF, a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm512_maskz_max_ps(0xFFFF, a.v, b.v)}; }
+};
+#endif
+
+#if defined(__AVX__)
+template <>
+struct Batch<double, 4> {
+    static constexpr unsigned int Lanes = 4;
+    __m256d v;
+
+    static Batch load(const double *ptr) { return {_mm256_loadu_pd(ptr)}; }
+    static Batch broadcast(double value) { return {_mm256_set1_pd(value)}; }
+    void store(double *ptr) const { _mm256_storeu_pd(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm256_add_pd(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm256_sub_pd(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm256_mul_pd(a.v, b.v)}; }
+    friend Batch min(Batch a, Batch b) { return {_mm256_min_pd(a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm256_max_pd(a.v, b.v)}; }
+};
+
+template <>
+struct Batch<float, 8> {
+    static constexpr unsigned int Lanes = 8;
+    __m256 v;
+
+    static Batch load(const float *ptr) { return {_mm256_loadu_ps(ptr)}; }
+    static Batch broadcast(float value) { return {_mm256_set1_ps(value)}; }
+    void store(float *ptr) const { _mm256_storeu_ps(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Batch min(Batch a, Batch b) { return {_mm256_min_ps(a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm256_max_ps(a.v, b.v)}; }
+};
+#endif
+
+#if defined(__SSE2__)
+template <>
+struct Batch<double, 2> {
+    static constexpr unsigned int Lanes = 2;
+    __m128d v;
+
+    static Batch load(const double *ptr) { return {_mm_loadu_pd(ptr)}; }
+    static Batch broadcast(double value) { return {_mm_set1_pd(value)}; }
+    void store(double *ptr) const { _mm_storeu_pd(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm_add_pd(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm_sub_pd(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm_mul_pd(a.v, b.v)}; }
+    friend Batch min(Batch a, Batch b) { return {_mm_min_pd(a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm_max_pd(a.v, b.v)}; }
+};
+
+template <>
+struct Batch<float, 4> {
+    static constexpr unsigned int Lanes = 4;
+    __m128 v;
+
+    static Batch load(const float *ptr) { return {_mm_loadu_ps(ptr)}; }
+    static Batch broadcast(float value) { return {_mm_set1_ps(value)}; }
+    void store(float *ptr) const { _mm_storeu_ps(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Batch operator-(Batch a, Batch b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend Batch operator*(Batch a, Batch b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Batch min(Batch a, Batch b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Batch max(Batch a, Batch b) { return {_mm_max_ps(a.v, b.v)}; }
+};
+#endif
+
+/// The number of lanes of T in the widest register the target supports
+template <typename T>
+struct NativeWidth {
+    static constexpr unsigned int value = 1;
+};
+
+template <>
+struct NativeWidth<double> {
+#if defined(__AVX512F__)
+    static constexpr unsigned int value = 8;
+#elif defined(__AVX__)
+    static constexpr unsigned int value = 4;
+#elif defined(__SSE2__)
+    static constexpr unsigned int value = 2;
+#else
+    static constexpr unsigned int value = 1;
+#endif
+};
+
+template <>
+struct NativeWidth<float> {
+#if defined(__AVX512F__)
+    static constexpr unsigned int value = 16;
+#elif defined(__AVX__)
+    static constexpr unsigned int value = 8;
+#elif defined(__SSE2__)
+    static constexpr unsigned int value = 4;
+#else
+    static constexpr unsigned int value = 1;
+#endif
+};
+
+template <typename T>
+using NativeBatch = Batch<T, NativeWidth<T>::value>;
+
+template <typename T>
+using ScalarBatch = Batch<T, 1>;
+
+/**
+ * Flushes denormal inputs and results to zero on the calling thread while in scope. Concentrations that decay towards
+ * zero otherwise spend long stretches as denormals, which are many times slower to compute with, most of all in float.
+ */
+class FlushDenormals {
+public:
+#if defined(__SSE2__)
+    FlushDenormals() : saved(_mm_getcsr()) {
+        // Flush to zero (bit 15) and denormals are zero (bit 6)
+        _mm_setcsr(saved | 0x8040u);
+    }
+
+    ~FlushDenormals() {
+        _mm_setcsr(saved);
+    }
+
+private:
+    unsigned int saved;
+#endif
+};
+
+/// Rounds count up so that count elements of T fill a whole number of Alignment sized blocks
+template <typename T>
+constexpr std::size_t paddedLength(std::size_t count) {
+    constexpr std::size_t perBlock = Alignment / sizeof(T);
+    return ((count + perBlock - 1) / perBlock) * perBlock;
+}
+
+} // namespace simd
+
+#endif //REACTIONDIFFUSION2_SIMD_HPP
@@ -0,0 +1,300 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_SIMULATIONTHREAD_HPP
+#define REACTIONDIFFUSION2_SIMULATIONTHREAD_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ReactionDiffusion.hpp"
+#include "TripleBuffer.hpp"
+
+/// How a SimulationThread paces itself
+struct SimulationSettings {
+    /// Steps taken between each snapshot published to the renderer
+    unsigned int stepsPerFrame = 2;
+    /// Wait for the renderer to take each snapshot before stepping again, so the simulation advances stepsPerFrame
+    /// steps per displayed frame. Otherwise the simulation runs as fast as it can and the renderer shows the latest
+    bool throttle = true;
+    bool paused = false;
+};
+
+/// Live statistics of a SimulationThread, as of a published snapshot
+struct SimulationStats {
+    unsigned long long stepCount = 0;
+    /// Averaged over roughly the last half a second of stepping
+    double stepsPerSecond = 0;
+    double cellsPerSecond = 0;
+    /// Time taken to step and to colour the last snapshot
+    double stepMilliseconds = 0;
+    double colorMilliseconds = 0;
+    unsigned long long framesPublished = 0;
+    SimulationSettings settings;
+};
+
+/// A snapshot of the simulation for the renderer
+struct SimulationFrame {
+    /// RGBA colouring of the whole grid, row by row
+    std::vector<std::uint8_t> pixels;
+    /// The rows that changed since the last snapshot the renderer took (or possibly a few more)
+    RowRange changedRows;
+    /// Increases by one for each snapshot published, 0 for a buffer that has never been written
+    unsigned long long sequence = 0;
+    SimulationStats stats;
+};
+
+/**
+ * Steps a ReactionDiffusion simulation on a thread of its own (and its thread pool), so that stepping and drawing
+ * don't hold each other up. Snapshots of the colouring are published through a TripleBuffer that the render thread
+ * reads at display rate. Everything that changes the simulation is a message, run on the simulation thread between
+ * steps, so the model is never touched by two threads at once.
+ * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam Precision the ScalarPrecision of the simulation
+ */
+template <unsigned int ChemicalCount, typename Precision = DoublePrecision>
+class SimulationThread {
+public:
+    using Model = ReactionDiffusion<ChemicalCount, Precision>;
+
+    /// Starts stepping model, which must not be used by anything else until this is destroyed
+    explicit SimulationThread(Model &model, const SimulationSettings &settings = SimulationSettings())
+            : model(model), settings(settings), frames(makeFrame(model)) {
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~SimulationThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        frameTaken.notify_one();
+        thread.join();
+    }
+
+    // Non-copyable
+    SimulationThread(const SimulationThread &other)= delete;
+    SimulationThread& operator=(const SimulationThread &source)= delete;
+
+    void setPaused(bool paused) {
+        post([paused](Model &, SimulationSettings &settings) { settings.paused = paused; });
+    }
+
+    void togglePaused() {
+        post([](Model &, SimulationSettings &settings) { settings.paused = !settings.paused; });
+    }
+
+    void setStepsPerFrame(unsigned int stepsPerFrame) {
+        post([stepsPerFrame](Model &, SimulationSettings &settings) { settings.stepsPerFrame = std::max(1u, stepsPerFrame); });
+    }
+
+    /// Multiplies the steps per frame by numerator / denominator, keeping at least one
+    void scaleStepsPerFrame(unsigned int numerator, unsigned int denominator) {
+        post([numerator, denominator](Model &, SimulationSettings &settings) {
+            settings.stepsPerFrame = std::max(1u, settings.stepsPerFrame * numerator / denominator);
+        });
+    }
+
+    void setThrottle(bool throttle) {
+        post([throttle](Model &, SimulationSettings &settings) { settings.throttle = throttle; });
+    }
+
+    void toggleThrottle() {
+        post([](Model &, SimulationSettings &settings) { settings.throttle = !settings.throttle; });
+    }
+
+    /// Takes steps steps even while paused
+    void step(unsigned int steps = 1) {
+        post([steps](Model &model, SimulationSettings &) { model.update(steps); });
+    }
+
+    /// Runs change on the simulation thread before the next step, for anything the other messages don't cover
+    void post(std::function<void(Model &, SimulationSettings &)> change) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages.push_back(std::move(change));
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * Takes the latest snapshot for the render thread, if one has been published since the last call.
+     * Only to be called from one thread.
+     * @return the new snapshot, or nullptr if there isn't one. Valid until the next call
+     */
+    const SimulationFrame *acquireFrame() {
+        if(!frames.update()) {
+            return nullptr;
+        }
+
+        const SimulationFrame &frame = frames.readBuffer();
+        readerSequence.store(frame.sequence, std::memory_order_release);
+        // A throttled simulation waits for this. It also waits with a timeout, which covers the notification being
+        // missed for want of holding the lock
+        frameTaken.notify_one();
+        return &frame;
+    }
+
+private:
+    /// How many snapshots back the rows each one changed are remembered, beyond that a snapshot is copied whole
+    static constexpr unsigned int HistoryLength = 64;
+    /// The longest a throttled simulation waits for the renderer before checking its messages again
+    static constexpr std::chrono::milliseconds ThrottleTimeout{50};
+
+    static SimulationFrame makeFrame(Model &model) {
+        SimulationFrame frame;
+        frame.pixels.resize(static_cast<std::size_t>(model.getState().getWidth()) * model.getState().getHeight() * 4);
+        return frame;
+    }
+
+    void run() {
+        REACTIONDIFFUSION2_PROFILE_THREAD("simulation");
+        publish(0, 0);
+
+        auto windowStart = std::chrono::steady_clock::now();
+        unsigned long long windowSteps = model.getStepCount();
+        double stepsPerSecond = 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            // Sleep while there is nothing to do
+            wake.wait(lock, [this]() { return stopping || !messages.empty() || !settings.paused; });
+            if(stopping) {
+                return;
+            }
+
+            // Apply every waiting message, with the lock released so posting never waits on them
+            while(!messages.empty()) {
+                auto message = std::move(messages.front());
+                messages.pop_front();
+                lock.unlock();
+                message(model, settings);
+                lock.lock();
+            }
+            lock.unlock();
+
+            double stepMilliseconds = 0;
+            if(!settings.paused) {
+                auto start = std::chrono::steady_clock::now();
+                model.update(settings.stepsPerFrame);
+                stepMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            // Refresh the rate every half a second or so, and drop it while paused
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> window = now - windowStart;
+            if(settings.paused) {
+                stepsPerSecond = 0;
+                windowStart = now;
+                windowSteps = model.getStepCount();
+            } else if(window.count() >= 0.5) {
+                stepsPerSecond = (model.getStepCount() - windowSteps) / window.count();
+                REACTIONDIFFUSION2_PROFILE_COUNTER("steps per second", stepsPerSecond);
+                windowStart = now;
+                windowSteps = model.getStepCount();
+            }
+
+            // Messages alone are still published, they may have changed the state or the statistics
+            publish(stepMilliseconds, stepsPerSecond);
+
+            lock.lock();
+            if(settings.throttle && !settings.paused) {
+                // Wait for the renderer to take this snapshot before stepping again
+                const unsigned long long published = sequence;
+                lock.unlock();
+                std::unique_lock<std::mutex> frameLock(frameMutex);
+                frameTaken.wait_for(frameLock, ThrottleTimeout, [this, published]() {
+                    return readerSequence.load(std::memory_order_acquire) >= published || hasWork();
+                });
+                frameLock.unlock();
+                lock.lock();
+            }
+        }
+    }
+
+    /// Whether there are messages waiting or the thread should stop, takes the lock
+    bool hasWork() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stopping || !messages.empty();
+    }
+
+    /// Colours the current state and publishes it as the next snapshot
+    void publish(double stepMilliseconds, double stepsPerSecond) {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("publish");
+        auto start = std::chrono::steady_clock::now();
+        const std::uint8_t *pixels = model.getColoring();
+        ++sequence;
+        history[sequence % HistoryLength] = model.getChangedRows();
+
+        // The write buffer holds an older snapshot, so only the rows that changed since then need copying
+        SimulationFrame &frame = frames.writeBuffer();
+        const std::size_t rowBytes = static_cast<std::size_t>(model.getState().getWidth()) * 4;
+        const RowRange copy = changedSince(frame.sequence);
+        if(copy.first < copy.last) {
+            std::memcpy(frame.pixels.data() + copy.first * rowBytes, pixels + copy.first * rowBytes, (copy.last - copy.first) * rowBytes);
+        }
+        const double colorMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // The renderer may take a newer snapshot before this one, which only means it uploads a few rows too many
+        frame.changedRows = changedSince(readerSequence.load(std::memory_order_acquire));
+        frame.sequence = sequence;
+
+        SimulationStats &stats = frame.stats;
+        stats.stepCount = model.getStepCount();
+        stats.stepsPerSecond = stepsPerSecond;
+        stats.cellsPerSecond = stepsPerSecond * model.getState().getWidth() * model.getState().getHeight();
+        stats.stepMilliseconds = stepMilliseconds;
+        stats.colorMilliseconds = colorMilliseconds;
+        stats.framesPublished = sequence;
+        stats.settings = settings;
+
+        frames.publish();
+    }
+
+    /// The rows that changed after snapshot since up to the latest one
+    RowRange changedSince(unsigned long long since) const {
+        if(since == 0 || sequence - since >= HistoryLength) {
+            return RowRange{0, model.getState().getHeight()};
+        }
+
+        RowRange changed{model.getState().getHeight(), 0};
+        for(unsigned long long next = since + 1; next <= sequence; ++next) {
+            const RowRange &rows = history[next % HistoryLength];
+            if(rows.first < rows.last) {
+                changed.first = std::min(changed.first, rows.first);
+                changed.last = std::max(changed.last, rows.last);
+            }
+        }
+        return changed.first < changed.last ? changed : RowRange{};
+    }
+
+    Model &model;
+    // Only touched by the simulation thread once it has started
+    SimulationSettings settings;
+    unsigned long long sequence = 0;
+    std::array<RowRange, HistoryLength> history;
+
+    TripleBuffer<SimulationFrame> frames;
+    std::atomic<unsigned long long> readerSequence{0};
+    std::mutex frameMutex;
+    std::condition_variable frameTaken;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void(Model &, SimulationSettings &)>> messages;
+    bool stopping = false;
+
+    // Started last, once everything it uses has been constructed
+    std::thread thread;
+};
+
+#endif //REACTIONDIFFUSION2_SIMULATIONTHREAD_HPP
@@ -0,0 +1,344 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_SPECTRALSOLVER_HPP
+#define REACTIONDIFFUSION2_SPECTRALSOLVER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "FFT.hpp"
+#include "Kernels.hpp"
+#include "Precision.hpp"
+#include "Profiler.hpp"
+#include "ReactionState.hpp"
+#include "Reactions.hpp"
+#include "Seeders.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * Integrates a reaction (see Reactions.hpp) on a periodic grid with second order exponential time differencing: the
+ * diffusion and the linear part of the kinetics are stepped exactly in Fourier space, and only the nonlinear part of
+ * the kinetics explicitly, as a predictor and corrector. Diffusion no longer limits the time step as it does for
+ * ReactionDiffusion's explicit steps, only the nonlinear kinetics do, so the gain is largest when diffusion is stiff:
+ * fast diffusing chemicals such as the inhibitors of Schnakenberg and Brusselator. A step costs four FFTs of the grid,
+ * far more than an explicit step, so it only pays when it covers many of the reaction's own (see Reaction::timeStep).
+ *
+ * Diffusion is the operator of the classic stencil, so the patterns match the ones ReactionDiffusion forms, except
+ * that the grid wraps around rather than having a fixed outer ring. Values aren't clamped as react() clamps them.
+ * The chemicals are transformed in pairs, one as the real and one as the imaginary part of a single complex FFT,
+ * which is enough to recover both as they are real.
+ * @tparam Reaction the reaction to integrate
+ */
+template <typename Reaction>
+class SpectralSolver {
+public:
+    using Scalar = typename Reaction::Scalar;
+    using Precision = ScalarPrecision<Scalar>;
+    using Complex = std::complex<Scalar>;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+
+    /// The grid must be a power of two along each side
+    static bool supportsSize(unsigned int width, unsigned int height) {
+        return FFT2D<Scalar>::supportsSize(width, height);
+    }
+
+    /**
+     * @param width cells across the grid, a power of two
+     * @param height cells down the grid, a power of two
+     * @param timeStep how far each step advances, in the same units as Reaction::timeStep
+     */
+    SpectralSolver(unsigned int width, unsigned int height, const ClassicStencil<Scalar> &stencil, const Reaction &reaction,
+                   Scalar timeStep, std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder,
+                   unsigned int threadCount = std::thread::hardware_concurrency())
+            : width(width), height(height), cellCount(static_cast<std::size_t>(width) * height), reaction(reaction),
+              timeStep(timeStep), fft(width, height), state(GridLayout{width, height}, reaction.background())
+    {
+        pool = std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount);
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            grid[chem].resize(cellCount);
+            stage[chem].resize(cellCount);
+            nonlinear[chem].resize(cellCount);
+        }
+        for(unsigned int pair = 0; pair < PairCount; ++pair) {
+            spectrum[pair].resize(cellCount);
+            predicted[pair].resize(cellCount);
+            forcing[pair].resize(cellCount);
+            stageForcing[pair].resize(cellCount);
+        }
+        scratch.resize(cellCount);
+        computeFactors(stencil);
+        seed(std::move(seeder));
+    }
+
+    /// Resets the grid to the reaction's background and seeds it
+    void seed(std::unique_ptr<AbstractSeeder<ChemicalCount, Precision>> seeder) {
+        state.fill(reaction.background());
+        seeder->seed(state);
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < height; ++y) {
+                state.copyRow(chem, y, grid[chem].data() + static_cast<std::size_t>(y) * width);
+            }
+        }
+
+        for(unsigned int pair = 0; pair < PairCount; ++pair) {
+            pack(pair, spectrum[pair].data(), grid);
+            fft.transform(spectrum[pair].data(), false, *pool);
+        }
+        stepCount = 0;
+    }
+
+    /// Advances the simulation by the given number of steps of getTimeStep each
+    void update(unsigned int steps = 1) {
+        for(unsigned int i = 0; i < steps; ++i) {
+            step();
+        }
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < height; ++y) {
+                state.setRow(chem, y, grid[chem].data() + static_cast<std::size_t>(y) * width);
+            }
+        }
+    }
+
+    /// The grid as of the last update
+    const ReactionState<ChemicalCount, Precision> &getState() const {
+        return state;
+    }
+
+    /// The RGBA colouring of the grid as of the last update, see ReactionState::getColoring
+    std::uint8_t *getColoring() {
+        return state.getColoring();
+    }
+
+    const Reaction &getReaction() const {
+        return reaction;
+    }
+
+    Scalar getTimeStep() const {
+        return timeStep;
+    }
+
+    /// The number of steps taken since the grid was last seeded
+    unsigned long long getStepCount() const {
+        return stepCount;
+    }
+
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+private:
+    static constexpr unsigned int PairCount = (ChemicalCount + 1) / 2;
+
+    /// Packs chemicals 2 * pair and 2 * pair + 1 of planes into the real and imaginary parts of out
+    void pack(unsigned int pair, Complex *out, const std::array<std::vector<Scalar>, ChemicalCount> &planes) const {
+        const Scalar *real = planes[2 * pair].data();
+        const Scalar *imag = 2 * pair + 1 < ChemicalCount ? planes[2 * pair + 1].data() : nullptr;
+        for(std::size_t i = 0; i < cellCount; ++i) {
+            out[i] = Complex(real[i], imag ? imag[i] : Scalar(0));
+        }
+    }
+
+    /// A factor of the step for a pair of chemicals, see step()
+    struct PairFactor {
+        Scalar sum, difference;
+
+        /// The factor applied to a pair's spectrum Z at k, given Z(k) and Z(-k)
+        inline Complex apply(Complex value, Complex mirror) const {
+            return sum * value + difference * std::conj(mirror);
+        }
+    };
+
+    /// The factors of a pair of chemicals at one wavenumber, see computeFactors
+    struct Factors {
+        PairFactor decay, forcing, correction;
+    };
+
+    /**
+     * Works out, for each wavenumber and chemical, the factors of the second order exponential time differencing step
+     * (Cox and Matthews' ETD2RK)
+     *   a(k) = exp(c dt) u(k) + (exp(c dt) - 1) / c N(u)(k)
+     *   u'(k) = a(k) + (exp(c dt) - 1 - c dt) / (c^2 dt) (N(a)(k) - N(u)(k))
+     * where c is the chemical's diffusion rate times the stencil's eigenvalue at k plus its linear rate.
+     */
+    void computeFactors(const ClassicStencil<Scalar> &stencil) {
+        const double pi = std::acos(-1.0);
+        const std::array<Scalar, ChemicalCount> diffusion = reaction.diffusion();
+        const std::array<Scalar, ChemicalCount> linear = reaction.linear();
+        const double dt = timeStep;
+
+        for(unsigned int pair = 0; pair < PairCount; ++pair) {
+            factors[pair].resize(cellCount);
+        }
+
+        for(unsigned int ky = 0; ky < height; ++ky) {
+            const double cosY = std::cos(2 * pi * ky / height);
+            for(unsigned int kx = 0; kx < width; ++kx) {
+                const double cosX = std::cos(2 * pi * kx / width);
+                // The stencil applied to exp(i k.x), summed in no particular order as it is only evaluated once
+                const double eigenvalue = stencil.center + 2 * stencil.edge * (cosX + cosY) + 4 * stencil.corner * cosX * cosY;
+
+                std::array<double, ChemicalCount> decay, forcing, correction;
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    const double rate = diffusion[chem] * eigenvalue + linear[chem];
+                    const double x = rate * dt;
+                    decay[chem] = std::exp(x);
+                    if(std::abs(x) < 1e-3) {
+                        // The series, as the closed forms cancel catastrophically near 0
+                        forcing[chem] = dt * (1 + x / 2 + x * x / 6);
+                        correction[chem] = dt * (0.5 + x / 6 + x * x / 24);
+                    } else {
+                        forcing[chem] = std::expm1(x) / rate;
+                        correction[chem] = (std::expm1(x) - x) / (rate * x);
+                    }
+                }
+
+                for(unsigned int pair = 0; pair < PairCount; ++pair) {
+                    const unsigned int first = 2 * pair;
+                    const unsigned int second = first + 1 < ChemicalCount ? first + 1 : first;
+                    auto combine = [&](const std::array<double, ChemicalCount> &factor) {
+                        return PairFactor{static_cast<Scalar>((factor[first] + factor[second]) / 2),
+                                          static_cast<Scalar>((factor[first] - factor[second]) / 2)};
+                    };
+                    Factors &mode = factors[pair][static_cast<std::size_t>(ky) * width + kx];
+                    mode.decay = combine(decay);
+                    mode.forcing = combine(forcing);
+                    mode.correction = combine(correction);
+                }
+            }
+        }
+    }
+
+    /**
+     * Takes one ETD2RK step (see computeFactors) of every pair of chemicals. With Z = A + iB the spectrum of a pair,
+     * A(k) = (Z(k) + conj Z(-k)) / 2 and iB(k) = (Z(k) - conj Z(-k)) / 2. Each chemical's factors are symmetric in k,
+     * so a factor f applies to the pair as
+     *   fZ(k) = (fA + fB) / 2 Z(k) + (fA - fB) / 2 conj Z(-k)
+     * which is PairFactor::apply.
+     */
+    void step() {
+        REACTIONDIFFUSION2_PROFILE_SCOPE("spectral step", static_cast<double>(cellCount));
+        // The predictor, an exponential Euler step
+        evaluateNonlinear(grid);
+        for(unsigned int pair = 0; pair < PairCount; ++pair) {
+            transformNonlinear(pair, forcing[pair].data());
+
+            const Complex *values = spectrum[pair].data();
+            const Complex *force = forcing[pair].data();
+            Complex *out = predicted[pair].data();
+            forEachMode(pair, [&](const Factors &mode, std::size_t k, std::size_t mirror) {
+                out[k] = mode.decay.apply(values[k], values[mirror]) + mode.forcing.apply(force[k], force[mirror]);
+            });
+            toRealSpace(pair, predicted[pair].data(), stage);
+        }
+
+        // The corrector, from the change in the nonlinear kinetics over the predicted step
+        evaluateNonlinear(stage);
+        for(unsigned int pair = 0; pair < PairCount; ++pair) {
+            transformNonlinear(pair, stageForcing[pair].data());
+
+            const Complex *prediction = predicted[pair].data();
+            const Complex *force = forcing[pair].data();
+            const Complex *stageForce = stageForcing[pair].data();
+            Complex *out = spectrum[pair].data();
+            forEachMode(pair, [&](const Factors &mode, std::size_t k, std::size_t mirror) {
+                out[k] = prediction[k] + mode.correction.apply(stageForce[k] - force[k], stageForce[mirror] - force[mirror]);
+            });
+            toRealSpace(pair, spectrum[pair].data(), grid);
+        }
+        ++stepCount;
+    }
+
+    /// Calls update with each wavenumber k of a pair and the index of -k, a row of wavenumbers per task
+    template <typename Update>
+    void forEachMode(unsigned int pair, Update &&update) {
+        const Factors *modes = factors[pair].data();
+        pool->parallelFor(height, [&](unsigned int ky) {
+            const std::size_t row = static_cast<std::size_t>(ky) * width;
+            const std::size_t mirrorRow = static_cast<std::size_t>((height - ky) % height) * width;
+            for(unsigned int kx = 0; kx < width; ++kx) {
+                update(modes[row + kx], row + kx, mirrorRow + (width - kx) % width);
+            }
+        });
+    }
+
+    /// The nonlinear part of the kinetics of every cell of planes, into nonlinear
+    void evaluateNonlinear(const std::array<std::vector<Scalar>, ChemicalCount> &planes) {
+        pool->parallelFor(height, [&](unsigned int y) {
+            using Batch = simd::NativeBatch<Scalar>;
+            using Single = simd::ScalarBatch<Scalar>;
+            const std::size_t rowBegin = static_cast<std::size_t>(y) * width;
+            const std::size_t rowEnd = rowBegin + width;
+
+            auto cells = [&](auto batch, std::size_t i) {
+                using CellBatch = decltype(batch);
+                std::array<CellBatch, ChemicalCount> conc, rates;
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    conc[chem] = CellBatch::load(planes[chem].data() + i);
+                }
+                reaction.nonlinear(conc, rates);
+                for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+                    rates[chem].store(nonlinear[chem].data() + i);
+                }
+            };
+
+            std::size_t i = rowBegin;
+            for(; i + Batch::Lanes <= rowEnd; i += Batch::Lanes) {
+                cells(Batch{}, i);
+            }
+            for(; i < rowEnd; ++i) {
+                cells(Single{}, i);
+            }
+        });
+    }
+
+    /// The spectrum of a pair of the nonlinear planes, into out
+    void transformNonlinear(unsigned int pair, Complex *out) {
+        pack(pair, out, nonlinear);
+        fft.transform(out, false, *pool);
+    }
+
+    /// Transforms a pair's spectrum back into its two planes of out
+    void toRealSpace(unsigned int pair, const Complex *values, std::array<std::vector<Scalar>, ChemicalCount> &out) {
+        std::copy(values, values + cellCount, scratch.begin());
+        fft.transform(scratch.data(), true, *pool);
+
+        // The transforms aren't normalised, spectra are kept as the forward transform gives them
+        const Scalar scale = Scalar(1) / static_cast<Scalar>(cellCount);
+        Scalar *real = out[2 * pair].data();
+        Scalar *imag = 2 * pair + 1 < ChemicalCount ? out[2 * pair + 1].data() : nullptr;
+        for(std::size_t i = 0; i < cellCount; ++i) {
+            real[i] = scratch[i].real() * scale;
+            if(imag) {
+                imag[i] = scratch[i].imag() * scale;
+            }
+        }
+    }
+
+    unsigned int width, height;
+    std::size_t cellCount;
+    Reaction reaction;
+    Scalar timeStep;
+    FFT2D<Scalar> fft;
+    /// Each chemical in real space row by row, the same at the predicted step, and the nonlinear part of the kinetics
+    std::array<std::vector<Scalar>, ChemicalCount> grid;
+    std::array<std::vector<Scalar>, ChemicalCount> stage;
+    std::array<std::vector<Scalar>, ChemicalCount> nonlinear;
+    /// The spectrum of each pair of chemicals, which is what is stepped, the predicted step of it, and the spectra of
+    /// the nonlinear kinetics at the start of the step and at the prediction
+    std::array<std::vector<Complex>, PairCount> spectrum;
+    std::array<std::vector<Complex>, PairCount> predicted;
+    std::array<std::vector<Complex>, PairCount> forcing;
+    std::array<std::vector<Complex>, PairCount> stageForcing;
+    std::array<std::vector<Factors>, PairCount> factors;
+    std::vector<Complex> scratch;
+    unsigned long long stepCount = 0;
+    ReactionState<ChemicalCount, Precision> state;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif //REACTIONDIFFUSION2_SPECTRALSOLVER_HPP
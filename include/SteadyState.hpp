@@ -0,0 +1,121 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_STEADYSTATE_HPP
+#define REACTIONDIFFUSION2_STEADYSTATE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+#include "ReactionDiffusion.hpp"
+
+/// When a simulation counts as steady, from the GridStatistics it is reduced to every so many steps
+struct SteadyStateCriterion {
+    /// The largest change of any concentration in a step may be at most this, negative to not check it
+    double maxChange = 1e-6;
+    /// No chemical's mean may move by more than this from one set of statistics to the next, negative to not check it
+    double maxMeanDrift = -1;
+    /// The checks above must hold for this many sets of statistics in a row
+    unsigned int checks = 3;
+    /// A hash seen before within the last HashesKept sets of statistics is steady at once, the grid either stopped
+    /// changing in its storage precision or is cycling
+    bool repeatedHash = true;
+};
+
+/**
+ * Decides from a run's successive GridStatistics whether it has reached a steady state
+ * @tparam ChemicalCount the number of chemicals in the grid
+ */
+template <unsigned int ChemicalCount>
+class SteadyStateDetector {
+public:
+    /// Repeats further apart than this many sets of statistics aren't noticed
+    static constexpr std::size_t HashesKept = 64;
+
+    explicit SteadyStateDetector(const SteadyStateCriterion &criterion = SteadyStateCriterion()) : criterion(criterion) {}
+
+    /**
+     * Adds the next statistics of the run, invalid ones are ignored
+     * @return whether the run is steady
+     */
+    bool add(const GridStatistics<ChemicalCount> &statistics) {
+        if(!statistics.valid || steady) {
+            return steady;
+        }
+
+        if(criterion.repeatedHash && statistics.hashed) {
+            const auto seen = std::find_if(hashes.begin(), hashes.end(), [&](const std::pair<unsigned long long, std::uint64_t> &hash) {
+                return hash.second == statistics.hash;
+            });
+            if(seen != hashes.end()) {
+                const unsigned long long period = statistics.step - seen->first;
+                reason = "the grid at step " + std::to_string(statistics.step) + " hashes the same as at step "
+                         + std::to_string(seen->first) + (period == statistics.step - hashes.back().first ? ", it stopped changing" : ", it is cycling");
+                return steady = true;
+            }
+            hashes.emplace_back(statistics.step, statistics.hash);
+            if(hashes.size() > HashesKept) {
+                hashes.pop_front();
+            }
+        }
+
+        bool holds = criterion.maxChange >= 0 || criterion.maxMeanDrift >= 0;
+        if(criterion.maxChange >= 0 && statistics.maxChange > criterion.maxChange) {
+            holds = false;
+        }
+        if(criterion.maxMeanDrift >= 0) {
+            double drift = last.valid ? 0.0 : INFINITY;
+            for(unsigned int chem = 0; last.valid && chem < ChemicalCount; ++chem) {
+                drift = std::max(drift, std::abs(statistics.mean[chem] - last.mean[chem]));
+            }
+            holds = holds && drift <= criterion.maxMeanDrift;
+        }
+        last = statistics;
+
+        held = holds ? held + 1 : 0;
+        if(held >= std::max(1u, criterion.checks)) {
+            char description[128];
+            std::snprintf(description, sizeof(description), "the criterion held for %u checks in a row up to step %llu, largest change %g",
+                          held, statistics.step, statistics.maxChange);
+            reason = description;
+            steady = true;
+        }
+        return steady;
+    }
+
+    bool isSteady() const {
+        return steady;
+    }
+
+    /// Why the run is steady, empty if it isn't
+    const std::string &getReason() const {
+        return reason;
+    }
+
+    const SteadyStateCriterion &getCriterion() const {
+        return criterion;
+    }
+
+    /// Forgets every statistics added, as when the grid is seeded again
+    void reset() {
+        steady = false;
+        held = 0;
+        last = GridStatistics<ChemicalCount>();
+        hashes.clear();
+        reason.clear();
+    }
+
+private:
+    SteadyStateCriterion criterion;
+    bool steady = false;
+    /// How many statistics in a row the criterion held for
+    unsigned int held = 0;
+    GridStatistics<ChemicalCount> last;
+    /// The steps and hashes of the latest hashed statistics
+    std::deque<std::pair<unsigned long long, std::uint64_t>> hashes;
+    std::string reason;
+};
+
+#endif //REACTIONDIFFUSION2_STEADYSTATE_HPP
@@ -0,0 +1,181 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_THREADPOOL_HPP
+#define REACTIONDIFFUSION2_THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Profiler.hpp"
+
+/**
+ * A persistent pool of worker threads for data parallel loops.
+ * Each call to parallelFor hands every thread (the calling thread included) an equal contiguous share of the indices.
+ * A thread works through its own share from the front and once it runs out steals from the back of the others, so
+ * uneven work evens out without any locking on the hot path.
+ */
+class ThreadPool {
+public:
+    /// Creates a pool that runs loops on threadCount threads in total, one of which is the calling thread
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+            : threadCount(threadCount == 0 ? 1 : threadCount), queues(new Queue[this->threadCount]) {
+        for(unsigned int id = 1; id < this->threadCount; ++id) {
+            workers.emplace_back([this, id]() { workerLoop(id); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Non-copyable
+    ThreadPool(const ThreadPool &other)= delete;
+    ThreadPool& operator=(const ThreadPool &source)= delete;
+
+    unsigned int size() const {
+        return threadCount;
+    }
+
+    /**
+     * Calls task(index) for every index in [0, count) across the pool and returns once all of them have finished.
+     * Must not be called from inside a task.
+     */
+    template <typename Task>
+    void parallelFor(unsigned int count, Task &&task) {
+        if(threadCount == 1 || count <= 1) {
+            for(unsigned int index = 0; index < count; ++index) {
+                task(index);
+            }
+            return;
+        }
+
+        // Split the indices evenly between the threads
+        for(unsigned int id = 0; id < threadCount; ++id) {
+            std::uint64_t begin = (static_cast<std::uint64_t>(count) * id) / threadCount;
+            std::uint64_t end = (static_cast<std::uint64_t>(count) * (id + 1)) / threadCount;
+            queues[id].range.store(pack(static_cast<unsigned int>(begin), static_cast<unsigned int>(end)), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            context = const_cast<void *>(static_cast<const void *>(&task));
+            invoke = [](void *target, unsigned int index) { (*static_cast<std::remove_reference_t<Task>*>(target))(index); };
+            running = threadCount - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return running == 0; });
+    }
+
+private:
+    /// The remaining range of indices owned by one thread, packed as [begin, end) so it can be claimed with a single CAS
+    struct alignas(64) Queue {
+        std::atomic<std::uint64_t> range{0};
+    };
+
+    static std::uint64_t pack(unsigned int begin, unsigned int end) {
+        return (static_cast<std::uint64_t>(end) << 32) | begin;
+    }
+
+    /// Takes the first index of the queue, returns false if it is empty
+    static bool popFront(Queue &queue, unsigned int &index) {
+        std::uint64_t range = queue.range.load(std::memory_order_acquire);
+        while(true) {
+            auto begin = static_cast<unsigned int>(range);
+            auto end = static_cast<unsigned int>(range >> 32);
+            if(begin >= end) {
+                return false;
+            }
+            if(queue.range.compare_exchange_weak(range, pack(begin + 1, end), std::memory_order_acq_rel)) {
+                index = begin;
+                return true;
+            }
+        }
+    }
+
+    /// Takes the last index of the queue, returns false if it is empty
+    static bool popBack(Queue &queue, unsigned int &index) {
+        std::uint64_t range = queue.range.load(std::memory_order_acquire);
+        while(true) {
+            auto begin = static_cast<unsigned int>(range);
+            auto end = static_cast<unsigned int>(range >> 32);
+            if(begin >= end) {
+                return false;
+            }
+            if(queue.range.compare_exchange_weak(range, pack(begin, end - 1), std::memory_order_acq_rel)) {
+                index = end - 1;
+                return true;
+            }
+        }
+    }
+
+    /// Runs this thread's own share and then steals from the others until every queue is empty
+    void drain(unsigned int id) {
+        unsigned int index;
+        while(popFront(queues[id], index)) {
+            invoke(context, index);
+        }
+
+        for(unsigned int offset = 1; offset < threadCount; ++offset) {
+            Queue &victim = queues[(id + offset) % threadCount];
+            while(popBack(victim, index)) {
+                invoke(context, index);
+            }
+        }
+    }
+
+    void workerLoop(unsigned int id) {
+        REACTIONDIFFUSION2_PROFILE_THREAD("pool worker");
+        unsigned int seenGeneration = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+                if(stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+
+            drain(id);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+            }
+            finished.notify_one();
+        }
+    }
+
+    const unsigned int threadCount;
+    std::unique_ptr<Queue[]> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    unsigned int generation = 0;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    void *context = nullptr;
+    void (*invoke)(void *, unsigned int) = nullptr;
+};
+
+#endif //REACTIONDIFFUSION2_THREADPOOL_HPP
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_TRIPLEBUFFER_HPP
+#define REACTIONDIFFUSION2_TRIPLEBUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Hands the latest of a stream of values from one writer thread to one reader thread without either ever waiting.
+ * The writer fills its own buffer and publishes it by swapping it with the middle buffer. The reader takes the middle
+ * buffer, if it has been published since it last looked, by swapping it with its own. Values the reader is too slow
+ * to see are overwritten, so the reader always gets the most recent one.
+ * @tparam T the type of value passed between the threads
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer()= default;
+
+    /// Starts every buffer as a copy of initial, so their storage can be allocated once up front
+    explicit TripleBuffer(const T &initial) : buffers{initial, initial, initial} {}
+
+    // Non-copyable
+    TripleBuffer(const TripleBuffer &other)= delete;
+    TripleBuffer& operator=(const TripleBuffer &source)= delete;
+
+    /// The buffer the writer fills, only to be used by the writer thread
+    T &writeBuffer() {
+        return buffers[writeIndex];
+    }
+
+    /// Makes the write buffer the latest value and gives the writer another buffer to fill
+    void publish() {
+        writeIndex = middle.exchange(static_cast<std::uint8_t>(writeIndex | FreshBit), std::memory_order_acq_rel) & IndexMask;
+    }
+
+    /**
+     * Takes the latest published value for the reader, if there is one it hasn't already taken.
+     * @return true if readBuffer now holds a new value
+     */
+    bool update() {
+        if((middle.load(std::memory_order_acquire) & FreshBit) == 0) {
+            return false;
+        }
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    /// The buffer the reader last took, only to be used by the reader thread
+    const T &readBuffer() const {
+        return buffers[readIndex];
+    }
+
+private:
+    /// Set in middle while it holds a value the reader hasn't taken
+    static constexpr std::uint8_t FreshBit = 4;
+    static constexpr std::uint8_t IndexMask = 3;
+
+    std::array<T, 3> buffers;
+    // Each index on its own cache line so the two threads don't contend over them
+    alignas(64) std::atomic<std::uint8_t> middle{1};
+    alignas(64) std::uint8_t writeIndex = 0;
+    alignas(64) std::uint8_t readIndex = 2;
+};
+
+#endif //REACTIONDIFFUSION2_TRIPLEBUFFER_HPP
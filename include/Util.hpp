@@ -5,9 +5,44 @@
 #ifndef REACTIONDIFFUSION_UTIL_HPP
 #define REACTIONDIFFUSION_UTIL_HPP
 
-#include <SFML/Graphics/Color.hpp>
+#include <cstdint>
 
-float hueToRGB(float v1, float v2, float vH) {
+/**
+ * An RGBA colour. Laid out the same way as the pixels handed to the renderer, without depending on SFML so the
+ * simulation core can be built headless.
+ */
+struct Rgba {
+    std::uint8_t r = 0, g = 0, b = 0, a = 255;
+
+    Rgba()= default;
+    Rgba(std::uint8_t r, std::uint8_t g, std::uint8_t b, std::uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
+
+    /// Unpacks a colour from a 32 bit RRGGBBAA integer
+    explicit Rgba(std::uint32_t color)
+            : r(static_cast<std::uint8_t>(color >> 24)), g(static_cast<std::uint8_t>(color >> 16)),
+              b(static_cast<std::uint8_t>(color >> 8)), a(static_cast<std::uint8_t>(color)) {}
+
+    /// Packs the colour into a 32 bit RRGGBBAA integer
+    std::uint32_t toInteger() const {
+        return (static_cast<std::uint32_t>(r) << 24) | (static_cast<std::uint32_t>(g) << 16) | (static_cast<std::uint32_t>(b) << 8) | a;
+    }
+};
+
+/**
+ * The coordinate within [0, size) that a coordinate beyond an edge of a grid wraps to, or if mirror is set mirrors to
+ * about the edge (-1 is 0 and size is size - 1), repeating every 2 * size
+ */
+inline unsigned int foldCoordinate(int coordinate, unsigned int size, bool mirror) {
+    const int length = static_cast<int>(size);
+    if(!mirror) {
+        return static_cast<unsigned int>(((coordinate % length) + length) % length);
+    }
+    const int period = 2 * length;
+    const int folded = ((coordinate % period) + period) % period;
+    return static_cast<unsigned int>(folded < length ? folded : period - 1 - folded);
+}
+
+inline float hueToRGB(float v1, float v2, float vH) {
     if (vH < 0)
         vH += 1;
 
@@ -27,13 +62,13 @@ float hueToRGB(float v1, float v2, float vH) {
 }
 
 /**
- * Convert HSL to an SFML RGB Color
+ * Convert HSL to an RGB colour
  *
  * @param hue the hue of the colour - between 0 and 360 inclusive
  * @param saturation the saturation - between 0 and 1
  * @param luminosity the luminosity - between 0 and 1
  */
-sf::Color colorFromHSL(unsigned int hue, float saturation, float luminosity) {
+inline Rgba colorFromHSL(unsigned int hue, float saturation, float luminosity) {
     unsigned char r = 0;
     unsigned char g = 0;
     unsigned char b = 0;
@@ -55,7 +90,7 @@ sf::Color colorFromHSL(unsigned int hue, float saturation, float luminosity) {
         b = static_cast<unsigned char>(255 * hueToRGB(v1, v2, convertedHue - (1.0f / 3)));
     }
 
-    return sf::Color(r, g, b);
+    return Rgba(r, g, b);
 }
 
 #endif //REACTIONDIFFUSION_UTIL_HPP
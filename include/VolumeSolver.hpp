@@ -0,0 +1,279 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_VOLUMESOLVER_HPP
+#define REACTIONDIFFUSION2_VOLUMESOLVER_HPP
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Kernels.hpp"
+#include "Profiler.hpp"
+#include "Reactions.hpp"
+#include "Seeders.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+#include "VolumeState.hpp"
+
+/**
+ * The volumetric counterpart of ClassicStencil: weights for the cell itself, its 6 face neighbours, 12 edge neighbours
+ * and 8 corner neighbours. With the edge and corner weights at 0 it is the 7 point stencil, and the face taps are all
+ * that apply reads.
+ * @tparam Scalar the type the stencil is computed in
+ */
+template <typename Scalar = double>
+struct VolumeStencil {
+    Scalar center, face, edge, corner;
+
+    /// The 7 point Laplacian, scaled like the classic stencil so the center weighs -1
+    static VolumeStencil sevenPoint() {
+        return {Scalar(-1), Scalar(1) / 6, Scalar(0), Scalar(0)};
+    }
+
+    /// The isotropic 27 point Laplacian, faces, edges and corners weighted 14:3:1 as the classic stencil weighs edges
+    /// and corners 4:1
+    static VolumeStencil twentySevenPoint() {
+        return {Scalar(-1), Scalar(14) / 128, Scalar(3) / 128, Scalar(1) / 128};
+    }
+
+    /// Whether any neighbour beyond the faces has a weight
+    bool isFull() const {
+        return edge != 0 || corner != 0;
+    }
+
+    /**
+     * Applies the stencil to the cells starting at x
+     * @param rows the nine rows around the cells' own, rows[3 * dz + dy] for the row dy - 1 rows and dz - 1 slabs away
+     * @tparam Full whether edges and corners are read, see isFull
+     */
+    template <typename Batch, bool Full>
+    inline Batch apply(const Scalar *const *rows, int x) const {
+        auto tap = [&](unsigned int row, int dx) {
+            return Batch::load(rows[row] + x + dx);
+        };
+
+        Batch faces = tap(4, -1) + tap(4, 1) + tap(3, 0) + tap(5, 0) + tap(1, 0) + tap(7, 0);
+        if constexpr(!Full) {
+            return faces * Batch::broadcast(face) + tap(4, 0) * Batch::broadcast(center);
+        } else {
+            Batch edges = tap(3, -1) + tap(3, 1) + tap(5, -1) + tap(5, 1) + tap(1, -1) + tap(1, 1) + tap(7, -1) + tap(7, 1)
+                          + tap(0, 0) + tap(2, 0) + tap(6, 0) + tap(8, 0);
+            Batch corners = tap(0, -1) + tap(0, 1) + tap(2, -1) + tap(2, 1) + tap(6, -1) + tap(6, 1) + tap(8, -1) + tap(8, 1);
+            return faces * Batch::broadcast(face) + edges * Batch::broadcast(edge) + corners * Batch::broadcast(corner)
+                   + tap(4, 0) * Batch::broadcast(center);
+        }
+    }
+};
+
+/**
+ * Fuses a volume stencil with a reaction (see Reactions.hpp) as StencilKernel does in two dimensions
+ * @tparam Reaction the reaction to step
+ */
+template <typename Reaction>
+struct VolumeKernel {
+    using Scalar = typename Reaction::Scalar;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+    using Rows = std::array<std::array<const Scalar *, 9>, ChemicalCount>;
+
+    VolumeStencil<Scalar> stencil;
+    Reaction reaction;
+
+    /**
+     * Steps cells [xBegin, xEnd) of a row given the nine rows around it for each chemical, see VolumeStencil::apply
+     * @param out the row to write for each chemical
+     */
+    template <bool Full>
+    void row(const Rows &rows, Scalar *const *out, int xBegin, int xEnd) const {
+        using Batch = simd::NativeBatch<Scalar>;
+        using Single = simd::ScalarBatch<Scalar>;
+
+        int x = xBegin;
+        for(; x + static_cast<int>(Batch::Lanes) <= xEnd; x += Batch::Lanes) {
+            cells<Batch, Full>(rows, out, x);
+        }
+        for(; x < xEnd; ++x) {
+            cells<Single, Full>(rows, out, x);
+        }
+    }
+
+private:
+    template <typename Batch, bool Full>
+    inline void cells(const Rows &rows, Scalar *const *out, int x) const {
+        std::array<Batch, ChemicalCount> conc, conv, next;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            conv[chem] = stencil.template apply<Batch, Full>(rows[chem].data(), x);
+            conc[chem] = Batch::load(rows[chem][4] + x);
+        }
+
+        reaction.react(conc, conv, next);
+
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            next[chem].store(out[chem] + x);
+        }
+    }
+};
+
+/**
+ * Steps a reaction (see Reactions.hpp) on a volumetric grid with a 7 or 27 point stencil. The outer shell of the
+ * volume is held fixed, as ReactionDiffusion holds the outer ring of a grid.
+ *
+ * A 3D stencil reads every cell from three slabs, so stepping slab after slab streams the volume through memory three
+ * times over unless three whole slabs stay in cache. The solver splits the interior into columns of blockRows whole
+ * rows and marches each column through z (2.5D blocking), so only three slabs of a column need to stay in cache for
+ * every cell to be read from memory once a step. Columns keep whole rows, which are contiguous, as columns narrower
+ * than the volume read each row in short pieces a page apart and lose more to the prefetcher than blocking saves.
+ * Columns, and stretches of z within them when there are too few columns to go round, are shared out over a thread pool.
+ * @tparam Reaction the reaction to step
+ */
+template <typename Reaction>
+class VolumeSolver {
+public:
+    using Scalar = typename Reaction::Scalar;
+    static constexpr unsigned int ChemicalCount = Reaction::ChemicalCount;
+
+    /// Three slabs of a 16 row column of a volume 1024 cells wide, two chemicals in double, and the slab written take
+    /// 1MiB of cache
+    static constexpr unsigned int DefaultBlockRows = 16;
+
+    /**
+     * @param layout the size of the volume, at least 3 cells along each side
+     * @param blockRows rows in each column, 0 steps whole slabs in turn without blocking
+     */
+    VolumeSolver(const VolumeLayout &layout, const VolumeStencil<Scalar> &stencil, const Reaction &reaction,
+                 std::unique_ptr<AbstractVolumeSeeder<ChemicalCount, Scalar>> seeder, unsigned int blockRows = DefaultBlockRows,
+                 unsigned int threadCount = std::thread::hardware_concurrency())
+            : kernel{stencil, reaction}, blockRows(blockRows),
+              current(std::make_unique<VolumeState<ChemicalCount, Scalar>>(clamped(layout), reaction.background())),
+              next(std::make_unique<VolumeState<ChemicalCount, Scalar>>(clamped(layout), reaction.background()))
+    {
+        pool = std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount);
+        seed(std::move(seeder));
+    }
+
+    /// Resets the volume to the reaction's background and seeds it
+    void seed(std::unique_ptr<AbstractVolumeSeeder<ChemicalCount, Scalar>> seeder) {
+        current->fill(kernel.reaction.background());
+        seeder->seed(*current);
+        // The fixed outer shell is never written, so it has to be in both buffers
+        next->copyFrom(*current);
+        stepCount = 0;
+    }
+
+    /// Advances the simulation by the given number of steps
+    void update(unsigned int steps = 1) {
+        for(unsigned int step = 0; step < steps; ++step) {
+            if(kernel.stencil.isFull()) {
+                this->step<true>();
+            } else {
+                this->step<false>();
+            }
+            std::swap(current, next);
+            ++stepCount;
+        }
+    }
+
+    const VolumeState<ChemicalCount, Scalar> &getState() const {
+        return *current;
+    }
+
+    const VolumeStencil<Scalar> &getStencil() const {
+        return kernel.stencil;
+    }
+
+    const Reaction &getReaction() const {
+        return kernel.reaction;
+    }
+
+    unsigned int getBlockRows() const {
+        return blockRows;
+    }
+
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+    /// The number of steps taken since the volume was last seeded
+    unsigned long long getStepCount() const {
+        return stepCount;
+    }
+
+private:
+    /// Splitting into a few tasks per thread gives idle threads something to steal
+    static constexpr unsigned int TasksPerThread = 4;
+    /// Stretches of z are kept at least this many slabs deep, each one reads in two slabs it doesn't step
+    static constexpr unsigned int MinStretchSlabs = 8;
+
+    static VolumeLayout clamped(const VolumeLayout &layout) {
+        return {std::max(layout.width, 3u), std::max(layout.height, 3u), std::max(layout.depth, 3u)};
+    }
+
+    template <bool Full>
+    void step() {
+        const unsigned int width = current->getWidth();
+        const unsigned int height = current->getHeight();
+        const unsigned int depth = current->getDepth();
+        REACTIONDIFFUSION2_PROFILE_SCOPE("volume step", static_cast<double>(width - 2) * (height - 2) * (depth - 2),
+                                         static_cast<double>(width - 2) * (height - 2) * (depth - 2) * 2 * ChemicalCount * sizeof(Scalar));
+
+        if(blockRows == 0) {
+            pool->parallelFor(depth - 2, [&](unsigned int slab) {
+                simd::FlushDenormals flush;
+                for(unsigned int y = 1; y < height - 1; ++y) {
+                    stepRow<Full>(width, y, slab + 1);
+                }
+            });
+            return;
+        }
+
+        const unsigned int columns = (height - 2 + blockRows - 1) / blockRows;
+        const unsigned int wanted = (pool->size() * TasksPerThread + columns - 1) / columns;
+        const unsigned int stretches = std::max(1u, std::min(wanted, (depth - 2) / MinStretchSlabs));
+
+        pool->parallelFor(columns * stretches, [&](unsigned int task) {
+            simd::FlushDenormals flush;
+            const unsigned int column = task / stretches;
+            const unsigned int stretch = task % stretches;
+            const unsigned int y0 = 1 + column * blockRows;
+            const unsigned int zBegin = 1 + (depth - 2) * stretch / stretches;
+            const unsigned int zEnd = 1 + (depth - 2) * (stretch + 1) / stretches;
+            marchColumn<Full>(width, y0, std::min(y0 + blockRows, height - 1), zBegin, zEnd);
+        });
+    }
+
+    /**
+     * Steps rows [y0, y1) of slabs [zBegin, zEnd), one slab after the next. The column's slabs above, at
+     * and below the one being stepped are the rolling window: each is read in from memory as the slab above, then
+     * reused from cache as the other two.
+     */
+    template <bool Full>
+    void marchColumn(unsigned int width, unsigned int y0, unsigned int y1, unsigned int zBegin, unsigned int zEnd) {
+        for(unsigned int z = zBegin; z < zEnd; ++z) {
+            for(unsigned int y = y0; y < y1; ++y) {
+                stepRow<Full>(width, y, z);
+            }
+        }
+    }
+
+    /// Steps the interior cells of row y of slab z
+    template <bool Full>
+    inline void stepRow(unsigned int width, unsigned int y, unsigned int z) {
+        typename VolumeKernel<Reaction>::Rows rows;
+        std::array<Scalar *, ChemicalCount> out;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int row = 0; row < 9; ++row) {
+                rows[chem][row] = current->row(chem, y + row % 3 - 1, z + row / 3 - 1);
+            }
+            out[chem] = next->row(chem, y, z);
+        }
+        kernel.template row<Full>(rows, out.data(), 1, static_cast<int>(width) - 1);
+    }
+
+    VolumeKernel<Reaction> kernel;
+    unsigned int blockRows;
+    std::unique_ptr<VolumeState<ChemicalCount, Scalar>> current, next;
+    unsigned long long stepCount = 0;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif //REACTIONDIFFUSION2_VOLUMESOLVER_HPP
@@ -0,0 +1,163 @@
+#pragma once
+#ifndef REACTIONDIFFUSION2_VOLUMESTATE_HPP
+#define REACTIONDIFFUSION2_VOLUMESTATE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "GridArena.hpp"
+#include "Precision.hpp"
+#include "ReactionState.hpp"
+#include "Simd.hpp"
+
+/// The size of a volumetric grid
+struct VolumeLayout {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int depth = 0;
+};
+
+/// The axis a slice through a volume is taken across, the slice holds every cell with the same coordinate on it
+enum class VolumeAxis {
+    X,
+    Y,
+    Z
+};
+
+/**
+ * The current state of each cell of a volumetric grid. Each chemical has its own plane, a structure of arrays as in
+ * ReactionState: rows of width cells, padded so each starts on a simd::Alignment boundary, height rows to a slab and
+ * depth slabs. There are no tiles, VolumeSolver blocks the grid as it steps it.
+ * @tparam ChemicalCount the number of chemicals to simulate
+ * @tparam ScalarType the type concentrations are computed and stored in
+ */
+template <unsigned int ChemicalCount, typename ScalarType = double>
+class VolumeState {
+public:
+    using Scalar = ScalarType;
+
+    /// Construct a new volume with every cell set to initialAmounts
+    VolumeState(const VolumeLayout &layout, const std::array<Scalar, ChemicalCount> &initialAmounts)
+            : layout(layout), rowStride(simd::paddedLength<Scalar>(layout.width)),
+              slabStride(rowStride * layout.height), planeSize(slabStride * layout.depth)
+    {
+        storage = static_cast<Scalar *>(GridArena::shared().allocate(planeSize * ChemicalCount * sizeof(Scalar)));
+        fill(initialAmounts);
+    }
+
+    VolumeState(const VolumeState &other)= delete;
+    VolumeState& operator=(const VolumeState &source)= delete;
+
+    ~VolumeState() {
+        GridArena::shared().release(storage, planeSize * ChemicalCount * sizeof(Scalar));
+    }
+
+    unsigned int getWidth() const {
+        return layout.width;
+    }
+
+    unsigned int getHeight() const {
+        return layout.height;
+    }
+
+    unsigned int getDepth() const {
+        return layout.depth;
+    }
+
+    const VolumeLayout &getLayout() const {
+        return layout;
+    }
+
+    /// Values from one row to the next
+    std::size_t getRowStride() const {
+        return rowStride;
+    }
+
+    /// Values from one slab to the next
+    std::size_t getSlabStride() const {
+        return slabStride;
+    }
+
+    /// Sets every cell to the given amounts
+    void fill(const std::array<Scalar, ChemicalCount> &amounts) {
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            std::fill_n(plane(chem), planeSize, amounts[chem]);
+        }
+    }
+
+    /// Copies every cell of another volume of the same layout
+    void copyFrom(const VolumeState &other) {
+        std::memcpy(storage, other.storage, planeSize * ChemicalCount * sizeof(Scalar));
+    }
+
+    inline std::array<Scalar, ChemicalCount> getConcentration(unsigned int x, unsigned int y, unsigned int z) const {
+        std::array<Scalar, ChemicalCount> conc;
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            conc[chem] = row(chem, y, z)[x];
+        }
+        return conc;
+    }
+
+    inline void setConcentration(unsigned int x, unsigned int y, unsigned int z, const std::array<Scalar, ChemicalCount> &conc) {
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            row(chem, y, z)[x] = conc[chem];
+        }
+    }
+
+    /// The first value of row y of slab z of a chemical's plane
+    inline Scalar *row(unsigned int chem, unsigned int y, unsigned int z) {
+        return plane(chem) + z * slabStride + y * rowStride;
+    }
+
+    inline const Scalar *row(unsigned int chem, unsigned int y, unsigned int z) const {
+        return plane(chem) + z * slabStride + y * rowStride;
+    }
+
+    /// The layout of the slice across the given axis, width then height as copySlice lays them out
+    GridLayout sliceLayout(VolumeAxis axis) const {
+        switch(axis) {
+            case VolumeAxis::X:
+                return GridLayout{layout.height, layout.depth};
+            case VolumeAxis::Y:
+                return GridLayout{layout.width, layout.depth};
+            default:
+                return GridLayout{layout.width, layout.height};
+        }
+    }
+
+    /**
+     * Copies the slice at index along an axis into a two dimensional grid laid out as sliceLayout, so it can be
+     * coloured and written as a ReactionDiffusion's grid is. Across X the slice's rows run along Y, otherwise along X.
+     */
+    template <typename Precision>
+    void copySlice(VolumeAxis axis, unsigned int index, ReactionState<ChemicalCount, Precision> &slice) const {
+        using SliceScalar = typename Precision::Scalar;
+        const GridLayout sliceSize = sliceLayout(axis);
+        std::vector<SliceScalar> values(sliceSize.width);
+
+        for(unsigned int chem = 0; chem < ChemicalCount; ++chem) {
+            for(unsigned int y = 0; y < sliceSize.height; ++y) {
+                for(unsigned int x = 0; x < sliceSize.width; ++x) {
+                    const Scalar value = axis == VolumeAxis::X ? row(chem, x, y)[index]
+                                         : axis == VolumeAxis::Y ? row(chem, index, y)[x] : row(chem, y, index)[x];
+                    values[x] = static_cast<SliceScalar>(value);
+                }
+                slice.setRow(chem, y, values.data());
+            }
+        }
+    }
+
+private:
+    inline Scalar *plane(unsigned int chem) const {
+        return storage + chem * planeSize;
+    }
+
+    VolumeLayout layout;
+    std::size_t rowStride, slabStride, planeSize;
+    Scalar *storage = nullptr;
+};
+
+#endif //REACTIONDIFFUSION2_VOLUMESTATE_HPP
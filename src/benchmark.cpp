@@ -0,0 +1,693 @@
+/**
+ * Benchmarks each hot path of the simulation separately across grid sizes and chemical counts.
+ * Reports cells per second and the effective memory bandwidth (the bytes each cell has to move at a minimum) and can
+ * write the results as JSON so runs from different builds can be compared. Heap allocations are counted too: a
+ * benchmark that allocates more per iteration than it is allowed, none unless it says otherwise, fails the run, so
+ * stepping a warmed up simulation is checked to allocate nothing. So does a reduced precision whose drift from double
+ * precision is beyond its tolerance.
+ */
+#include "AdaptiveSolver.hpp"
+#include "ParameterSweep.hpp"
+#include "ReactionDiffusion.hpp"
+#include "Convolution.hpp"
+#include "ReactionModel.hpp"
+#include "Seeders.hpp"
+#include "SpectralSolver.hpp"
+#include "VolumeSolver.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Every allocation made through operator new, on any thread, counted by the replacements below
+std::atomic<unsigned long long> allocationCount{0};
+
+void *countedAllocation(std::size_t bytes, std::size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    bytes = std::max<std::size_t>(bytes, 1);
+    void *memory = alignment > alignof(std::max_align_t)
+                   ? std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment) : std::malloc(bytes);
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new(std::size_t bytes) {
+    return countedAllocation(bytes, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t bytes) {
+    return countedAllocation(bytes, alignof(std::max_align_t));
+}
+void *operator new(std::size_t bytes, std::align_val_t alignment) {
+    return countedAllocation(bytes, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t bytes, std::align_val_t alignment) {
+    return countedAllocation(bytes, static_cast<std::size_t>(alignment));
+}
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+void operator delete(void *memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+void operator delete[](void *memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+struct Options {
+    std::vector<unsigned int> sizes = {256, 512, 1024, 2048, 4096, 8192};
+    std::vector<unsigned int> chemicals = {2, 3, 4};
+    double minTime = 0.5;
+    unsigned int threads = 0;
+    unsigned int tileSize = GridLayout().tileSize;
+    unsigned int temporalBlocking = 4;
+    unsigned int accuracySteps = 2000;
+    unsigned int earlySteps = 100;
+    unsigned int sweepSize = 64;
+    unsigned int sweepInstances = 64;
+    unsigned int volumeSize = 128;
+    std::string filter;
+    std::string json;
+};
+
+/// The grid a benchmark ran on, size cells along each of its dimensions
+struct Shape {
+    unsigned int size;
+    unsigned int dimensions;
+
+    Shape(unsigned int size, unsigned int dimensions = 2) : size(size), dimensions(dimensions) {}
+
+    /// N^2 or N^3
+    std::string text() const {
+        return std::to_string(size) + "^" + std::to_string(dimensions);
+    }
+};
+
+struct Result {
+    std::string name;
+    Shape shape;
+    unsigned int chemicals;
+    unsigned int threads;
+    unsigned long long iterations;
+    double secondsPerIteration;
+    double cellsPerIteration;
+    double bytesPerCell;
+    double allocationsPerIteration;
+
+    double cellsPerSecond() const {
+        return cellsPerIteration / secondsPerIteration;
+    }
+
+    double gigabytesPerSecond() const {
+        return cellsPerSecond() * bytesPerCell / 1e9;
+    }
+};
+
+/// How far a reduced precision run has drifted from the double precision run of the same grid
+struct AccuracyResult {
+    std::string precision;
+    unsigned int size;
+    unsigned long long steps;
+    double maxError;
+    double rmsError;
+    /// The largest rmsError the precision is allowed
+    double tolerance;
+};
+
+/// Forces the generic virtual path by being a different type to GrayScottModel
+class VirtualGrayScottModel : public GrayScottModel {};
+
+class Benchmark {
+public:
+    explicit Benchmark(const Options &options) : options(options) {}
+
+    /**
+     * Runs op once to warm up and then repeatedly until at least minTime has passed, recording the average time.
+     * @param cellsPerIteration the number of cells op processes each call
+     * @param bytesPerCell the minimum number of bytes that have to be read and written for each cell
+     * @param allowedAllocations how many heap allocations op may make per call once warmed up
+     */
+    template <typename Op>
+    void measure(const std::string &name, const Shape &shape, unsigned int chemicals, unsigned int threads,
+                 double cellsPerIteration, double bytesPerCell, Op &&op, double allowedAllocations = 0) {
+        if(!enabled(name)) {
+            return;
+        }
+
+        op();
+
+        unsigned long long iterations = 0;
+        const unsigned long long allocationsBefore = allocationCount.load();
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            op();
+            ++iterations;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while(elapsed.count() < options.minTime);
+
+        const double allocations = static_cast<double>(allocationCount.load() - allocationsBefore) / iterations;
+        Result result{name, shape, chemicals, threads, iterations, elapsed.count() / iterations, cellsPerIteration, bytesPerCell, allocations};
+        report(result);
+        results.push_back(result);
+
+        if(allocations > allowedAllocations) {
+            std::cerr << name << " made " << allocations << " heap allocations per iteration, at most "
+                      << allowedAllocations << " are allowed\n";
+            failed = true;
+        }
+    }
+
+    /// Whether any benchmark allocated more than it was allowed, or any precision drifted beyond its tolerance
+    bool hasFailed() const {
+        return failed;
+    }
+
+    void addAccuracy(const AccuracyResult &result) {
+        std::cout << std::left << std::setw(24) << ("accuracy-" + result.precision) << std::right
+                  << std::setw(6) << result.size << "^2 after " << result.steps << " steps"
+                  << "  max error " << std::setprecision(3) << std::scientific << result.maxError
+                  << "  rms error " << result.rmsError << "\n" << std::defaultfloat;
+        accuracy.push_back(result);
+
+        if(!(result.rmsError <= result.tolerance)) {
+            std::cerr << "accuracy-" << result.precision << " drifted from double precision by an rms error of "
+                      << result.rmsError << ", at most " << result.tolerance << " is allowed\n";
+            failed = true;
+        }
+    }
+
+    bool enabled(const std::string &name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    bool writeJson(const std::string &path) const {
+        std::ofstream file(path);
+        if(!file) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return false;
+        }
+
+        file << "{\n  \"results\": [\n";
+        for(std::size_t i = 0; i < results.size(); ++i) {
+            const Result &result = results[i];
+            file << "    {\"name\": \"" << result.name << "\", \"size\": " << result.shape.size
+                 << ", \"shape\": \"" << result.shape.text() << "\""
+                 << ", \"chemicals\": " << result.chemicals << ", \"threads\": " << result.threads
+                 << ", \"iterations\": " << result.iterations
+                 << ", \"seconds_per_iteration\": " << std::setprecision(9) << result.secondsPerIteration
+                 << ", \"cells_per_second\": " << result.cellsPerSecond()
+                 << ", \"bytes_per_cell\": " << result.bytesPerCell
+                 << ", \"gigabytes_per_second\": " << result.gigabytesPerSecond()
+                 << ", \"allocations_per_iteration\": " << result.allocationsPerIteration << "}"
+                 << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "  ],\n  \"accuracy\": [\n";
+        for(std::size_t i = 0; i < accuracy.size(); ++i) {
+            const AccuracyResult &result = accuracy[i];
+            file << "    {\"precision\": \"" << result.precision << "\", \"size\": " << result.size
+                 << ", \"steps\": " << result.steps << ", \"max_error\": " << std::setprecision(9) << result.maxError
+                 << ", \"rms_error\": " << result.rmsError << ", \"rms_tolerance\": " << result.tolerance << "}"
+                 << (i + 1 < accuracy.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    const Options &options;
+
+private:
+    static void report(const Result &result) {
+        std::cout << std::left << std::setw(24) << result.name << std::right
+                  << std::setw(8) << result.shape.text() << " x" << result.chemicals
+                  << std::setw(4) << result.threads << "t"
+                  << std::setw(14) << std::setprecision(4) << std::scientific << result.cellsPerSecond() << " cells/s"
+                  << std::setw(10) << std::fixed << std::setprecision(2) << result.gigabytesPerSecond() << " GB/s"
+                  << std::setw(12) << std::setprecision(3) << result.secondsPerIteration * 1e3 << " ms/iter"
+                  << std::setw(10) << std::setprecision(1) << result.allocationsPerIteration << " allocs/iter\n"
+                  << std::defaultfloat;
+    }
+
+    std::vector<Result> results;
+    std::vector<AccuracyResult> accuracy;
+    bool failed = false;
+};
+
+/// Fills every cell of the state with random concentrations, the same every run
+template <unsigned int ChemicalCount>
+void randomise(ReactionState<ChemicalCount> &state) {
+    const CounterRandom random(1);
+    for(unsigned int y = 0; y < state.getHeight(); ++y) {
+        for(unsigned int x = 0; x < state.getWidth(); ++x) {
+            state.setConcentration(x, y, CellConcentration<ChemicalCount>::makeRandom(random, static_cast<std::uint64_t>(y) * state.getWidth() + x));
+        }
+    }
+}
+
+/// Benchmarks that work for any number of chemicals
+template <unsigned int ChemicalCount>
+void runChemicalBenchmarks(Benchmark &bench, const GridLayout &layout) {
+    const unsigned int size = layout.width;
+    const double interiorCells = static_cast<double>(size - 2) * (size - 2);
+    const double cells = static_cast<double>(size) * size;
+    constexpr double cellBytes = ChemicalCount * sizeof(double);
+
+    auto state = std::make_unique<ReactionState<ChemicalCount>>(layout);
+    randomise(*state);
+
+    if(bench.enabled("convolution")) {
+        std::unique_ptr<AbstractConvolution<ChemicalCount>> convolution(new ClassicConvolution<ChemicalCount>(-1, 0.2, 0.05));
+        auto result = std::make_unique<ReactionState<ChemicalCount>>(layout);
+
+        // Read every cell once and write a result per cell
+        bench.measure("convolution", size, ChemicalCount, 1, interiorCells, cellBytes * 2, [&]() {
+            for(unsigned int y = 1; y < size - 1; ++y) {
+                for(unsigned int x = 1; x < size - 1; ++x) {
+                    result->setConcentration(x, y, (*convolution)(x, y, *state));
+                }
+            }
+        });
+    }
+
+    // Read every cell and write four bytes of colour
+    bench.measure("getColoring", size, ChemicalCount, 1, cells, cellBytes + 4, [&]() {
+        state->getColoring();
+    });
+
+    if(bench.enabled("toColor")) {
+        // One row of cells converted once per row of the grid, so this measures the conversion rather than the memory system
+        const CounterRandom random(1);
+        std::vector<CellConcentration<ChemicalCount>> row(size);
+        for(unsigned int x = 0; x < size; ++x) {
+            row[x] = CellConcentration<ChemicalCount>::makeRandom(random, x);
+        }
+        std::vector<Rgba> colors(size);
+
+        bench.measure("toColor", size, ChemicalCount, 1, cells, cellBytes + 4, [&]() {
+            for(unsigned int repeat = 0; repeat < size; ++repeat) {
+                for(unsigned int x = 0; x < size; ++x) {
+                    colors[x] = row[x].toColor();
+                }
+            }
+        });
+    }
+}
+
+/**
+ * A seeded Gray-Scott simulation of the given precision. Every tile is stepped every step, so the update benchmarks
+ * measure the same work however far the pattern has spread.
+ */
+template <typename Precision = DoublePrecision>
+std::unique_ptr<ReactionDiffusion<2, Precision>> makeSimulation(const Benchmark &bench, const GridLayout &layout,
+        AbstractReactionModel<2, typename Precision::Scalar> *model = BasicGrayScottModel<typename Precision::Scalar>::coral()) {
+    auto simulation = std::make_unique<ReactionDiffusion<2, Precision>>(layout,
+            std::unique_ptr<AbstractConvolution<2, Precision>>(new ClassicConvolution<2, Precision>(-1, 0.2, 0.05)),
+            std::unique_ptr<AbstractSeeder<2, Precision>>(new SquareCenterSeed<2, Precision>(layout.width / 4, {0, 1})),
+            std::unique_ptr<AbstractReactionModel<2, typename Precision::Scalar>>(model), bench.options.threads);
+    simulation->setActivityThreshold(-1);
+    return simulation;
+}
+
+/**
+ * Measures the fused update computed and stored in a reduced precision, and how far accuracySteps steps of it drift
+ * from the same steps in double precision.
+ * @param tolerance the rms drift the precision fails beyond
+ */
+template <typename Precision>
+void runPrecisionBenchmarks(Benchmark &bench, const GridLayout &layout, const std::string &precision, double tolerance) {
+    const unsigned int size = layout.width;
+    const double interiorCells = static_cast<double>(size - 2) * (size - 2);
+    constexpr double cellBytes = 2 * sizeof(typename Precision::Storage);
+
+    if(bench.enabled("update-" + precision)) {
+        auto simulation = makeSimulation<Precision>(bench, layout);
+        bench.measure("update-" + precision, size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    if(bench.enabled("accuracy-" + precision)) {
+        auto reduced = makeSimulation<Precision>(bench, layout);
+        auto baseline = makeSimulation<DoublePrecision>(bench, layout);
+        reduced->update(bench.options.accuracySteps);
+        baseline->update(bench.options.accuracySteps);
+
+        std::vector<typename Precision::Scalar> reducedRow(size);
+        std::vector<double> baselineRow(size);
+        double maxError = 0, squaredError = 0;
+        for(unsigned int chem = 0; chem < 2; ++chem) {
+            for(unsigned int y = 0; y < layout.height; ++y) {
+                reduced->getState().copyRow(chem, y, reducedRow.data());
+                baseline->getState().copyRow(chem, y, baselineRow.data());
+                for(unsigned int x = 0; x < size; ++x) {
+                    double error = std::abs(static_cast<double>(reducedRow[x]) - baselineRow[x]);
+                    maxError = std::max(maxError, error);
+                    squaredError += error * error;
+                }
+            }
+        }
+
+        bench.addAccuracy({precision, size, bench.options.accuracySteps, maxError,
+                           std::sqrt(squaredError / (2.0 * size * layout.height)), tolerance});
+    }
+}
+
+/// Benchmarks of the Gray-Scott model, which only has two chemicals
+void runGrayScottBenchmarks(Benchmark &bench, const GridLayout &layout) {
+    const unsigned int size = layout.width;
+    const double interiorCells = static_cast<double>(size - 2) * (size - 2);
+    constexpr double cellBytes = 2 * sizeof(double);
+
+    if(bench.enabled("GrayScottModel::update")) {
+        auto state = std::make_unique<ReactionState<2>>(layout);
+        auto laplacian = std::make_unique<ReactionState<2>>(layout);
+        auto result = std::make_unique<ReactionState<2>>(layout);
+        randomise(*state);
+        randomise(*laplacian);
+        std::unique_ptr<AbstractReactionModel<2>> model(GrayScottModel::coral());
+
+        // Read the concentration and convolution and write the new concentration
+        bench.measure("GrayScottModel::update", size, 2, 1, interiorCells, cellBytes * 3, [&]() {
+            for(unsigned int y = 1; y < size - 1; ++y) {
+                for(unsigned int x = 1; x < size - 1; ++x) {
+                    result->setConcentration(x, y, model->update(state->getConcentration(x, y), laplacian->getConcentration(x, y).conc));
+                }
+            }
+        });
+    }
+
+    // Read the current state and write the next one
+    if(bench.enabled("update")) {
+        auto simulation = makeSimulation(bench, layout);
+        bench.measure("update", size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // Every cell stepped, with the halo beyond the edges refreshed from the opposite ones each step
+    if(bench.enabled("update-periodic")) {
+        GridLayout periodic = layout;
+        periodic.boundary = BoundaryCondition::Periodic;
+        auto simulation = makeSimulation(bench, periodic);
+        bench.measure("update-periodic", size, 2, simulation->getThreadCount(), static_cast<double>(size) * size, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // Reduced to the statistics a steady state is detected from every step, to compare with update
+    for(const std::string name : {"update-reduced", "update-reduced-hash"}) {
+        if(!bench.enabled(name)) {
+            continue;
+        }
+
+        auto simulation = makeSimulation(bench, layout);
+        simulation->setReductionInterval(1, name == "update-reduced-hash");
+        bench.measure(name, size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // With noise drawn for every concentration of every cell each step, which also keeps every tile active
+    if(bench.enabled("update-noise")) {
+        auto simulation = makeSimulation(bench, layout);
+        simulation->setNoise({1e-4, 1e-4}, 1);
+        bench.measure("update-noise", size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // Several steps per pass over memory, each still counted as reading and writing every cell once
+    if(bench.enabled("update-blocked")) {
+        GridLayout blocked = layout;
+        blocked.haloWidth = bench.options.temporalBlocking;
+        auto simulation = makeSimulation(bench, blocked);
+        bench.measure("update-blocked", size, 2, simulation->getThreadCount(), interiorCells * blocked.haloWidth, cellBytes * 2, [&]() {
+            simulation->update(blocked.haloWidth);
+        });
+    }
+
+    // The first steps after seeding a small square, with and without skipping the tiles it hasn't reached yet.
+    // Both count every cell of every step, so the sparse rate is the rate the grid appears to be stepped at
+    for(const std::string name : {"update-early-dense", "update-early-sparse"}) {
+        if(!bench.enabled(name)) {
+            continue;
+        }
+
+        auto simulation = makeSimulation(bench, layout);
+        simulation->setActivityThreshold(name == "update-early-sparse" ? 0 : -1);
+        const unsigned int steps = bench.options.earlySteps;
+        // The seeder handed to each reseed is the one allocation
+        bench.measure(name, size, 2, simulation->getThreadCount(), interiorCells * steps, cellBytes * 2, [&]() {
+            simulation->seedReaction(std::unique_ptr<AbstractSeeder<2>>(new SquareCenterSeed<2>(40, {0, 1})));
+            simulation->update(steps);
+        }, 1);
+    }
+
+    if(bench.enabled("update-virtual")) {
+        auto simulation = makeSimulation(bench, layout, new VirtualGrayScottModel());
+        bench.measure("update-virtual", size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // The other reactions on the same fused kernel, for comparison with update
+    const std::pair<const char *, AbstractReactionModel<2> *(*)()> models[] = {
+            {"update-brusselator", []() -> AbstractReactionModel<2> * { return new BrusselatorModel<>(); }},
+            {"update-fitzhugh-nagumo", []() -> AbstractReactionModel<2> * { return new FitzHughNagumoModel<>(); }},
+            {"update-schnakenberg", []() -> AbstractReactionModel<2> * { return new SchnakenbergModel<>(); }}};
+    for(const auto &[name, makeModel] : models) {
+        if(!bench.enabled(name)) {
+            continue;
+        }
+
+        auto simulation = makeSimulation(bench, layout, makeModel());
+        bench.measure(name, size, 2, simulation->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            simulation->update();
+        });
+    }
+
+    // A step of the spectral integrator, four FFTs of the grid, counted like an explicit step though it may advance
+    // the pattern many times as far
+    if(bench.enabled("spectral-step") && SpectralSolver<GrayScottReaction<double>>::supportsSize(size, size)) {
+        const double cells = static_cast<double>(size) * size;
+        SpectralSolver<GrayScottReaction<double>> solver(size, size, ClassicStencil<double>{-1, 0.2, 0.05},
+                                                         GrayScottReaction<double>(), 1,
+                                                         std::unique_ptr<AbstractSeeder<2>>(new SquareCenterSeed<2>(40, {0, 1})),
+                                                         bench.options.threads);
+        bench.measure("spectral-step", size, 2, solver.getThreadCount(), cells, cellBytes * 2, [&]() {
+            solver.update();
+        });
+    }
+
+    // An accepted step of the adaptive integrator, three stencil passes, each advancing the pattern by however long
+    // the tolerance lets it
+    if(bench.enabled("adaptive-step")) {
+        AdaptiveSolver<GrayScottReaction<double>> solver(size, size, ClassicStencil<double>{-1, 0.2, 0.05},
+                                                         GrayScottReaction<double>(), 1e-3,
+                                                         std::unique_ptr<AbstractSeeder<2>>(new SquareCenterSeed<2>(40, {0, 1})),
+                                                         bench.options.threads);
+        bench.measure("adaptive-step", size, 2, solver.getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            solver.advance(solver.getStepSize());
+        });
+    }
+}
+
+void runSize(Benchmark &bench, unsigned int size) {
+    GridLayout layout{size, size, bench.options.tileSize};
+
+    for(unsigned int chemicals : bench.options.chemicals) {
+        switch(chemicals) {
+            case 2: runChemicalBenchmarks<2>(bench, layout); break;
+            case 3: runChemicalBenchmarks<3>(bench, layout); break;
+            case 4: runChemicalBenchmarks<4>(bench, layout); break;
+            default: std::cerr << "Unsupported chemical count " << chemicals << "\n";
+        }
+    }
+
+    runGrayScottBenchmarks(bench, layout);
+    // A few times the drift of 2000 steps on grids of 64^2 to 2048^2. Far longer runs drift apart chaotically whatever
+    // the precision, so these only hold up to the default --accuracy-steps
+    runPrecisionBenchmarks<SinglePrecision>(bench, layout, "float", 5e-5);
+    runPrecisionBenchmarks<HalfPrecision>(bench, layout, "half", 3e-2);
+    runPrecisionBenchmarks<Fixed16Precision>(bench, layout, "fixed16", 5e-3);
+}
+
+/**
+ * Compares stepping sweepInstances small Gray-Scott grids with different feed rates as one ParameterSweep against
+ * stepping a ReactionDiffusion for each of them in turn.
+ */
+void runSweepBenchmarks(Benchmark &bench) {
+    const unsigned int size = bench.options.sweepSize;
+    const unsigned int count = bench.options.sweepInstances;
+    const unsigned int steps = 10;
+    const double interiorCells = static_cast<double>(size - 2) * (size - 2) * count * steps;
+    constexpr double cellBytes = 2 * sizeof(double);
+    const GridLayout layout{size, size, bench.options.tileSize};
+
+    std::vector<GrayScottReaction<double>> instances;
+    for(unsigned int i = 0; i < count; ++i) {
+        instances.push_back({0.01 + 0.09 * i / count, 0.062, 1.0, 0.5});
+    }
+
+    if(bench.enabled("sweep-batched")) {
+        ParameterSweep<double> sweep(size, size, instances, ClassicStencil<double>{-1, 0.2, 0.05},
+                                     std::unique_ptr<AbstractSeeder<2>>(new SquareCenterSeed<2>(size / 4, {0, 1})),
+                                     bench.options.threads);
+        bench.measure("sweep-batched", size, 2, sweep.getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            sweep.update(steps);
+        });
+    }
+
+    if(bench.enabled("sweep-separate")) {
+        std::vector<std::unique_ptr<ReactionDiffusion<2>>> simulations;
+        for(const GrayScottReaction<double> &instance : instances) {
+            simulations.push_back(makeSimulation(bench, layout, new GrayScottModel(instance.feed, instance.kill, instance.dA, instance.dB)));
+        }
+        bench.measure("sweep-separate", size, 2, simulations.front()->getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+            for(auto &simulation : simulations) {
+                simulation->update(steps);
+            }
+        });
+    }
+}
+
+/**
+ * Steps a volumeSize cube with the 7 and 27 point stencils, in the z-marched columns VolumeSolver steps it in by
+ * default and slab by slab without blocking
+ */
+void runVolumeBenchmarks(Benchmark &bench) {
+    const unsigned int size = bench.options.volumeSize;
+    const double interiorCells = static_cast<double>(size - 2) * (size - 2) * (size - 2);
+    constexpr double cellBytes = 2 * sizeof(double);
+    const VolumeLayout layout{size, size, size};
+
+    for(const bool full : {false, true}) {
+        for(const bool blocked : {true, false}) {
+            const std::string name = std::string(full ? "volume-27" : "volume-7") + (blocked ? "" : "-unblocked");
+            if(!bench.enabled(name)) {
+                continue;
+            }
+
+            VolumeSolver<GrayScottReaction<double>> solver(layout,
+                    full ? VolumeStencil<double>::twentySevenPoint() : VolumeStencil<double>::sevenPoint(), GrayScottReaction<double>(),
+                    std::unique_ptr<AbstractVolumeSeeder<2>>(new CubeCenterSeed<2>(size / 4, {0, 1})),
+                    blocked ? VolumeSolver<GrayScottReaction<double>>::DefaultBlockRows : 0, bench.options.threads);
+            bench.measure(name, {size, 3}, 2, solver.getThreadCount(), interiorCells, cellBytes * 2, [&]() {
+                solver.update();
+            });
+        }
+    }
+}
+
+std::vector<unsigned int> parseList(const std::string &text) {
+    std::vector<unsigned int> list;
+    std::istringstream stream(text);
+    std::string item;
+    while(std::getline(stream, item, ',')) {
+        list.push_back(static_cast<unsigned int>(std::stoul(item)));
+    }
+    return list;
+}
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --sizes LIST        comma separated grid sizes (default 256,512,1024,2048,4096,8192)\n"
+              << "  --chemicals LIST    comma separated chemical counts from 2, 3, 4 (default all)\n"
+              << "  --min-time SECONDS  minimum time to spend on each measurement (default 0.5)\n"
+              << "  --threads N         threads for the full update, 0 for one per hardware thread (default 0)\n"
+              << "  --tile-size N       cells along each side of a storage tile (default 128)\n"
+              << "  --temporal-blocking K  steps per pass for the temporally blocked update (default 4)\n"
+              << "  --accuracy-steps N  steps to run before comparing reduced precision against double, whose drift\n"
+              << "                      fails the run beyond each precision's tolerance (default 2000, the most the\n"
+              << "                      tolerances hold for)\n"
+              << "  --early-steps N     steps after seeding timed by the update-early benchmarks (default 100)\n"
+              << "  --sweep-size N      cells along each side of the instances of the sweep benchmarks (default 64)\n"
+              << "  --sweep-instances N  instances stepped by the sweep benchmarks (default 64)\n"
+              << "  --volume-size N     cells along each side of the cube of the volume benchmarks, 0 to skip them (default 128)\n"
+              << "  --filter TEXT       only run benchmarks whose name contains TEXT\n"
+              << "  --json PATH         also write the results to PATH as JSON\n";
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        try {
+            if(arg == "--sizes") options.sizes = parseList(value);
+            else if(arg == "--chemicals") options.chemicals = parseList(value);
+            else if(arg == "--min-time") options.minTime = std::stod(value);
+            else if(arg == "--threads") options.threads = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--tile-size") options.tileSize = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--temporal-blocking") options.temporalBlocking = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--accuracy-steps") options.accuracySteps = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--early-steps") options.earlySteps = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--sweep-size") options.sweepSize = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--sweep-instances") options.sweepInstances = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--volume-size") options.volumeSize = static_cast<unsigned int>(std::stoul(value));
+            else if(arg == "--filter") options.filter = value;
+            else if(arg == "--json") options.json = value;
+            else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch(const std::exception &) {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return 1;
+        }
+    }
+
+    Benchmark bench(options);
+    for(unsigned int size : options.sizes) {
+        if(size < 3) {
+            std::cerr << "Unsupported size " << size << "\n";
+            continue;
+        }
+        runSize(bench, size);
+    }
+    if(options.sweepSize >= 3 && options.sweepInstances > 0) {
+        runSweepBenchmarks(bench);
+    }
+    if(options.volumeSize >= 3) {
+        runVolumeBenchmarks(bench);
+    }
+
+    if(!options.json.empty() && !bench.writeJson(options.json)) {
+        return 1;
+    }
+
+    return bench.hasFailed() ? 1 : 0;
+}
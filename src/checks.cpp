@@ -0,0 +1,401 @@
+/**
+ * Checks of behaviour that the benchmarks can't see, each registered with CTest as `ReactionDiffusionChecks NAME`.
+ * A check prints what went wrong to standard error and exits with 1 if it fails.
+ */
+#include "Checkpoint.hpp"
+#include "Random.hpp"
+#include "ReactionDiffusion.hpp"
+#include "Reactions.hpp"
+#include "Recording.hpp"
+#include "Seeders.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#endif
+
+/// Runs a command line, returning its exit status or -1 if it didn't exit normally, as when it crashed
+int runCommand(const std::string &command) {
+    const int status = std::system(command.c_str());
+#if defined(__unix__) || defined(__APPLE__)
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#else
+    return status;
+#endif
+}
+
+std::vector<char> readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool writeFile(const std::string &path, const std::vector<char> &bytes) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(file);
+}
+
+/// A checkpoint with one field of its header overwritten
+struct HeaderCorruption {
+    const char *name;
+    std::size_t offset;
+    std::size_t size;
+    std::uint64_t value;
+};
+
+/**
+ * Restarts the headless runner from checkpoints with corrupt headers, each of which it must refuse with an error
+ * rather than crash on or read past the end of
+ * @param headless the path of ReactionDiffusionHeadless
+ */
+int checkCheckpointHeaders(const std::string &headless) {
+    const std::string path = "checks-checkpoint.bin";
+    const std::string corruptPath = "checks-checkpoint-corrupt.bin";
+    const std::string quiet = " > /dev/null 2>&1";
+    if(runCommand("\"" + headless + "\" --size 64 --steps 10 --checkpoint " + path + quiet) != 0) {
+        std::cerr << "Could not write a checkpoint to corrupt\n";
+        return 1;
+    }
+    const std::vector<char> original = readFile(path);
+    const std::string restart = "\"" + headless + "\" --steps 20 --restart " + corruptPath + quiet;
+    if(!writeFile(corruptPath, original) || runCommand(restart) != 0) {
+        std::cerr << "Could not restart from the checkpoint before corrupting it\n";
+        return 1;
+    }
+
+    const std::uint64_t top = std::numeric_limits<std::uint64_t>::max();
+    const HeaderCorruption corruptions[] = {
+        {"planeStride 2^63", offsetof(CheckpointHeader, planeStride), 8, std::uint64_t(1) << 63},
+        {"planeStride 2^62", offsetof(CheckpointHeader, planeStride), 8, std::uint64_t(1) << 62},
+        {"planeStride 0", offsetof(CheckpointHeader, planeStride), 8, 0},
+        {"planeOffset 2^63", offsetof(CheckpointHeader, planeOffset), 8, std::uint64_t(1) << 63},
+        {"planeOffset max", offsetof(CheckpointHeader, planeOffset), 8, top},
+        {"planeOffset 0", offsetof(CheckpointHeader, planeOffset), 8, 0},
+        {"width max", offsetof(CheckpointHeader, width), 4, 0xffffffff},
+        {"height max", offsetof(CheckpointHeader, height), 4, 0xffffffff},
+        {"width 0", offsetof(CheckpointHeader, width), 4, 0},
+        {"height 1", offsetof(CheckpointHeader, height), 4, 1},
+        {"storageSize 2^31", offsetof(CheckpointHeader, storageSize), 4, 0x80000000},
+        {"storageSize 0", offsetof(CheckpointHeader, storageSize), 4, 0},
+        {"chemicalCount 0", offsetof(CheckpointHeader, chemicalCount), 4, 0},
+        {"chemicalCount 2^31", offsetof(CheckpointHeader, chemicalCount), 4, 0x80000000},
+        {"parameterCount max", offsetof(CheckpointHeader, parameterCount), 4, 0xffffffff},
+        {"boundary 99", offsetof(CheckpointHeader, boundary), 4, 99},
+        {"version 99", offsetof(CheckpointHeader, version), 4, 99},
+        {"scalarType 99", offsetof(CheckpointHeader, scalarType), 4, 99},
+        {"magic", offsetof(CheckpointHeader, magic), 8, 0},
+    };
+
+    int failures = 0;
+    auto expectRefused = [&](const char *name, const std::vector<char> &bytes) {
+        if(!writeFile(corruptPath, bytes)) {
+            std::cerr << "Could not write " << corruptPath << "\n";
+            ++failures;
+            return;
+        }
+        const int status = runCommand(restart);
+        if(status != 1) {
+            std::cerr << "A checkpoint with a corrupt " << name << " gave exit status " << status << " rather than 1\n";
+            ++failures;
+        }
+    };
+    for(const HeaderCorruption &corruption : corruptions) {
+        std::vector<char> bytes = original;
+        std::memcpy(bytes.data() + corruption.offset, &corruption.value, corruption.size);
+        expectRefused(corruption.name, bytes);
+    }
+    std::vector<char> unterminated = original;
+    std::memset(unterminated.data() + offsetof(CheckpointHeader, model), 'x', CheckpointHeader::MaxModelName);
+    expectRefused("model name, unterminated", unterminated);
+    expectRefused("length, cut short", std::vector<char>(original.begin(), original.end() - 1));
+    expectRefused("length, cut inside the header", std::vector<char>(original.begin(), original.begin() + 16));
+
+    std::remove(path.c_str());
+    std::remove(corruptPath.c_str());
+    return failures == 0 ? 0 : 1;
+}
+
+/// A counter and key and the words Philox4x32-10 gives for them
+struct PhiloxAnswer {
+    Philox::Counter counter;
+    Philox::Key key;
+    Philox::Counter expected;
+};
+
+/**
+ * Checks Philox against the known-answer vectors published with the reference implementation (Random123's
+ * kat_vectors), CounterRandom's mapping of seed, stream and index onto its key and counter, and that uniforms gives
+ * exactly what uniform does one index at a time
+ */
+int checkPhilox() {
+    const PhiloxAnswer answers[] = {
+        {{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+    };
+
+    int failures = 0;
+    for(const PhiloxAnswer &answer : answers) {
+        const std::uint64_t seed = (static_cast<std::uint64_t>(answer.key[1]) << 32) | answer.key[0];
+        const std::uint64_t index = (static_cast<std::uint64_t>(answer.counter[1]) << 32) | answer.counter[0];
+        const std::uint64_t stream = (static_cast<std::uint64_t>(answer.counter[3]) << 32) | answer.counter[2];
+        if(Philox::generate(answer.counter, answer.key) != answer.expected || CounterRandom(seed).words(stream, index) != answer.expected) {
+            std::cerr << "Philox gives the wrong words for the counter " << std::hex << answer.counter[0] << " " << answer.counter[1]
+                      << " " << answer.counter[2] << " " << answer.counter[3] << std::dec << "\n";
+            ++failures;
+        }
+    }
+
+    // More than one block, not a whole number of them, and across a carry into the index's high word
+    const CounterRandom random(0x0123456789abcdefULL);
+    const std::uint64_t first = 0xffffff80ULL;
+    const std::size_t count = 203;
+    std::vector<double> lanes[4];
+    for(auto &lane : lanes) {
+        lane.resize(count);
+    }
+    double *const out[4] = {lanes[0].data(), lanes[1].data(), lanes[2].data(), lanes[3].data()};
+    random.uniforms<double, 4>(7, first, count, out);
+    for(std::size_t i = 0; i < count; ++i) {
+        for(unsigned int lane = 0; lane < 4; ++lane) {
+            if(lanes[lane][i] != random.uniform<double>(7, first + i, lane)) {
+                std::cerr << "uniforms gives " << lanes[lane][i] << " for lane " << lane << " of index " << first + i
+                          << " where uniform gives " << random.uniform<double>(7, first + i, lane) << "\n";
+                ++failures;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/// Seeds every cell with random concentrations, so every cell along every edge is busy from the first step
+template <typename Precision>
+class RandomSeeder : public AbstractSeeder<2, Precision> {
+public:
+    explicit RandomSeeder(std::uint64_t seed) : random(seed) {}
+
+    void seed(ReactionState<2, Precision> &state) override {
+        for(unsigned int y = 0; y < state.getHeight(); ++y) {
+            for(unsigned int x = 0; x < state.getWidth(); ++x) {
+                const auto cell = CellConcentration<2, typename Precision::Scalar>::makeRandom(random, static_cast<std::uint64_t>(y) * state.getWidth() + x);
+                state.setConcentration(x, y, cell.conc);
+            }
+        }
+    }
+
+private:
+    CounterRandom random;
+};
+
+/// Steps a randomly seeded Gray-Scott grid, with noise unless it is 0, and returns every plane, row by row
+template <typename Precision>
+std::vector<typename Precision::Scalar> stepGrid(const GridLayout &layout, unsigned int threads, unsigned int steps, double noise) {
+    using Scalar = typename Precision::Scalar;
+    ReactionDiffusion<2, Precision> model(layout, ClassicStencil<Scalar>{-1, 0.2, 0.05}, GrayScottReaction<Scalar>{},
+                                          std::make_unique<RandomSeeder<Precision>>(1), threads);
+    model.setNoise({noise, noise}, 2);
+    model.update(steps);
+
+    const auto &state = model.getState();
+    std::vector<Scalar> cells(static_cast<std::size_t>(layout.width) * layout.height * 2);
+    for(unsigned int chem = 0; chem < 2; ++chem) {
+        for(unsigned int y = 0; y < layout.height; ++y) {
+            state.copyRow(chem, y, cells.data() + (static_cast<std::size_t>(chem) * layout.height + y) * layout.width);
+        }
+    }
+    return cells;
+}
+
+/**
+ * Steps the same grid with every boundary, with and without noise, on different numbers of threads, tile sizes and
+ * depths of temporal blocking, each of which must give exactly the grid of one thread stepping whole tiles a step at
+ * a time
+ */
+template <typename Precision>
+int checkDeterminism(const char *precision) {
+    const BoundaryCondition boundaries[] = {BoundaryCondition::FixedRing, BoundaryCondition::Periodic, BoundaryCondition::ZeroFlux,
+                                            BoundaryCondition::FixedValue};
+    const char *boundaryNames[] = {"fixed-ring", "periodic", "zero-flux", "fixed-value"};
+    const unsigned int steps = 60;
+
+    int failures = 0;
+    for(unsigned int boundary = 0; boundary < std::size(boundaries); ++boundary) {
+        for(double noise : {0.0, 0.001}) {
+            // Sides that aren't a multiple of the tiles, so the last tiles are partly beyond the grid
+            GridLayout layout;
+            layout.width = 150;
+            layout.height = 90;
+            layout.boundary = boundaries[boundary];
+            const auto expected = stepGrid<Precision>(layout, 1, steps, noise);
+
+            for(unsigned int threads : {1u, 3u}) {
+                for(unsigned int tileSize : {16u, 128u}) {
+                    for(unsigned int haloWidth : {1u, 3u}) {
+                        layout.tileSize = tileSize;
+                        layout.haloWidth = haloWidth;
+                        if(stepGrid<Precision>(layout, threads, steps, noise) != expected) {
+                            std::cerr << "A " << precision << " " << boundaryNames[boundary] << (noise != 0 ? " noisy" : "")
+                                      << " grid stepped by " << threads << (threads == 1 ? " thread" : " threads")
+                                      << " in tiles of " << tileSize << " blocked " << haloWidth
+                                      << " steps deep differs from one stepped by one thread\n";
+                            ++failures;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/// Reads every frame of a recording back in a shuffled order, each of which must be exactly the frame recorded
+int checkFrames(RecordingReader &reader, const std::vector<std::vector<std::uint8_t>> &frames, const std::string &what) {
+    std::vector<std::size_t> order(reader.getFrameCount());
+    for(std::size_t frame = 0; frame < order.size(); ++frame) {
+        order[frame] = frame;
+    }
+    // Every frame twice, so some are read straight after themselves and some straight after the frame before
+    order.insert(order.end(), order.begin(), order.end());
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+    int failures = 0;
+    for(std::size_t frame : order) {
+        const std::uint8_t *read = reader.readFrame(frame);
+        if(read == nullptr || std::memcmp(read, frames[frame].data(), frames[frame].size()) != 0) {
+            std::cerr << "Frame " << frame << " of " << what << (read == nullptr ? " couldn't be read" : " differs from the frame recorded")
+                      << "\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+/**
+ * Records a short run, keeping a copy of every frame, and reads the recording back: whole, and cut short inside its
+ * last frame so the index has to be rebuilt from the frames
+ */
+template <typename Precision>
+int checkRecording(RecordingContent content, const std::string &what) {
+    using Scalar = typename Precision::Scalar;
+    using Storage = typename Precision::Storage;
+    const std::string path = "checks-recording.bin";
+    const unsigned int frameCount = 40;
+
+    GridLayout layout;
+    layout.width = 72;
+    layout.height = 40;
+    ReactionDiffusion<2, Precision> model(layout, ClassicStencil<Scalar>{-1, 0.2, 0.05}, GrayScottReaction<Scalar>{},
+                                          std::make_unique<SquareCenterSeed<2, Precision>>(12, std::array<Scalar, 2>{0, 1}), 1);
+
+    // Every frame fits in the queue, so none are dropped however slow the writer is
+    FrameRecorder recorder(8, frameCount);
+    std::string error = recorder.open(path, model, content);
+    if(!error.empty()) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::vector<std::vector<std::uint8_t>> frames;
+    for(unsigned int frame = 0; frame < frameCount; ++frame) {
+        // Mostly one step apart, for small deltas, with a few long gaps
+        model.update(frame % 10 == 9 ? 50 : 1);
+        recorder.record(model);
+
+        const std::size_t cells = static_cast<std::size_t>(layout.width) * layout.height;
+        std::vector<std::uint8_t> bytes(content == RecordingContent::Coloring ? cells * 4 : cells * 2 * sizeof(Storage));
+        if(content == RecordingContent::Coloring) {
+            std::memcpy(bytes.data(), model.getColoring(), bytes.size());
+        } else {
+            auto out = reinterpret_cast<Storage *>(bytes.data());
+            for(unsigned int chem = 0; chem < 2; ++chem) {
+                for(unsigned int y = 0; y < layout.height; ++y) {
+                    model.getState().copyStoredRow(chem, y, out + static_cast<std::size_t>(chem * layout.height + y) * layout.width);
+                }
+            }
+        }
+        frames.push_back(std::move(bytes));
+    }
+    error = recorder.close();
+    if(!error.empty() || recorder.getDroppedFrames() != 0) {
+        std::cerr << (error.empty() ? "The recorder dropped frames" : error) << "\n";
+        return 1;
+    }
+
+    int failures = 0;
+    RecordingReader reader;
+    error = reader.open(path);
+    if(!error.empty() || reader.getFrameCount() != frameCount) {
+        std::cerr << "The " << what << " recording " << (error.empty() ? "has the wrong number of frames" : error) << "\n";
+        return 1;
+    }
+    for(unsigned int frame = 0; frame < frameCount; ++frame) {
+        if(reader.findStep(reader.getStepCount(frame)) != frame) {
+            std::cerr << "Frame " << frame << " of the " << what << " recording isn't found by its step\n";
+            ++failures;
+        }
+    }
+    failures += checkFrames(reader, frames, "the " + what + " recording");
+
+    // Cut inside the last frame, the index at the end goes with it
+    std::vector<char> bytes = readFile(path);
+    std::uint64_t indexOffset = 0;
+    std::memcpy(&indexOffset, bytes.data() + bytes.size() - sizeof(recording::Footer), sizeof(indexOffset));
+    bytes.resize(static_cast<std::size_t>(indexOffset) - 1);
+    if(!writeFile(path, bytes)) {
+        std::cerr << "Could not write " << path << "\n";
+        return 1;
+    }
+    error = reader.open(path);
+    if(!error.empty() || reader.getFrameCount() != frameCount - 1) {
+        std::cerr << "The " << what << " recording cut short " << (error.empty() ? "has the wrong number of frames" : error) << "\n";
+        return 1;
+    }
+    failures += checkFrames(reader, frames, "the " + what + " recording cut short");
+
+    std::remove(path.c_str());
+    return failures == 0 ? 0 : 1;
+}
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " CHECK [arguments]\n"
+              << "  checkpoint-headers HEADLESS  restarting HEADLESS from corrupt checkpoints fails cleanly\n"
+              << "  recording           recordings read back exactly, in any order and when cut short\n"
+              << "  philox              Philox gives the published known answers, and CounterRandom agrees with it\n"
+              << "  determinism         every boundary steps to the same grid, with or without noise, on any threads,\n"
+              << "                      tiles or temporal blocking\n";
+}
+
+int main(int argc, char **argv) {
+    const std::string check = argc > 1 ? argv[1] : "";
+    if(check == "checkpoint-headers" && argc == 3) {
+        return checkCheckpointHeaders(argv[2]);
+    }
+    if(check == "recording" && argc == 2) {
+        return checkRecording<DoublePrecision>(RecordingContent::State, "double state")
+               | checkRecording<HalfPrecision>(RecordingContent::State, "half state")
+               | checkRecording<DoublePrecision>(RecordingContent::Coloring, "colouring");
+    }
+    if(check == "philox" && argc == 2) {
+        return checkPhilox();
+    }
+    if(check == "determinism" && argc == 2) {
+        return checkDeterminism<DoublePrecision>("double") | checkDeterminism<SinglePrecision>("float")
+               | checkDeterminism<HalfPrecision>("half") | checkDeterminism<Fixed16Precision>("fixed16");
+    }
+    printUsage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,1105 @@
+/**
+ * Runs the simulation without a display, for batch runs on machines without SFML.
+ */
+#include "AdaptiveSolver.hpp"
+#include "Checkpoint.hpp"
+#include "ReactionDiffusion.hpp"
+#include "Recording.hpp"
+#include "Convolution.hpp"
+#include "DistributedSimulation.hpp"
+#include "Multiresolution.hpp"
+#include "Profiler.hpp"
+#include "ReactionModel.hpp"
+#include "Seeders.hpp"
+#include "SpectralSolver.hpp"
+#include "SteadyState.hpp"
+#include "VolumeSolver.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+#include <csignal>
+#include <sys/wait.h>
+#endif
+
+constexpr unsigned int CHEMICALS = 2;
+
+/// The --boundary name of each BoundaryCondition
+const std::pair<const char *, BoundaryCondition> BOUNDARIES[] = {
+        {"fixed-ring", BoundaryCondition::FixedRing},
+        {"periodic", BoundaryCondition::Periodic},
+        {"zero-flux", BoundaryCondition::ZeroFlux},
+        {"fixed-value", BoundaryCondition::FixedValue}};
+
+struct Options {
+    GridLayout layout{300, 300};
+    /// Empty until given, so a restart can take it from the checkpoint
+    std::string model;
+    std::string precision = "double";
+    double feed = -1, kill = -1, diffusionA = -1, diffusionB = -1;
+    /// The parameters of the checkpoint a run restarts from, in the order of its reaction's parameters(), used for
+    /// any not given
+    std::vector<double> restoredParameters;
+    std::string seed = "square";
+    unsigned int seedSize = 40;
+    unsigned long long steps = 1000;
+    unsigned int threads = 0;
+    double activityThreshold = 0;
+    std::string output;
+    std::string format = "ppm";
+    unsigned long long outputEvery = 0;
+    std::string checkpoint;
+    unsigned long long checkpointEvery = 0;
+    std::string restart;
+    std::string record;
+    unsigned long long recordEvery = 10;
+    std::string recordContent = "coloring";
+    unsigned int keyframeInterval = 32;
+    std::string integrator = "explicit";
+    double timeStep = -1;
+    double tolerance = -1;
+    /// Empty until given, so a restart can take it from the checkpoint
+    std::string boundary;
+    unsigned int ranks = 1;
+    /// 0 for a two dimensional grid
+    unsigned int depth = 0;
+    unsigned int stencil = 0;
+    unsigned int blockRows = VolumeSolver<GrayScottReaction<double>>::DefaultBlockRows;
+    std::string sliceAxis = "z";
+    /// The middle of the volume if negative
+    long long slice = -1;
+    std::string trace;
+    unsigned long long checkEvery = 0;
+    SteadyStateCriterion steady;
+    bool hash = false;
+    bool stopWhenSteady = false;
+    bool statistics = false;
+    unsigned int warmLevels = 0;
+    unsigned int warmSteps = 1000;
+    /// Drawn from the system's entropy source unless given
+    std::uint64_t randomSeed = 0;
+    bool randomSeedGiven = false;
+    double noise = 0;
+    bool hugePages = true;
+};
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --size N            cells along each side of a square grid (default 300)\n"
+              << "  --width N           cells across the grid\n"
+              << "  --height N          cells down the grid\n"
+              << "  --tile-size N       cells along each side of a storage tile, a power of two (default 128)\n"
+              << "  --temporal-blocking K  steps to advance each tile per pass over memory (default 1)\n"
+              << "  --boundary NAME     fixed-ring (the outermost cells are never stepped), periodic, zero-flux or\n"
+              << "                      fixed-value (held at the model's background) (default fixed-ring)\n"
+              << "  --precision NAME    double, float, half or fixed16, the last two store floats in 16 bits (default double)\n"
+              << "  --model NAME        Gray-Scott preset, coral or mitosis, or brusselator, fitzhugh-nagumo or\n"
+              << "                      schnakenberg (default coral)\n"
+              << "  --feed F            override the feed rate of the Gray-Scott preset\n"
+              << "  --kill K            override the kill rate of the Gray-Scott preset\n"
+              << "  --diffusion-a D     override the diffusion rate of the first chemical\n"
+              << "  --diffusion-b D     override the diffusion rate of the second chemical\n"
+              << "  --seed NAME         square or spots (default square)\n"
+              << "  --seed-size N       size of the seeded square (default 40)\n"
+              << "  --steps N           number of steps to run (default 1000)\n"
+              << "  --threads N         worker threads, 0 for one per hardware thread (default 0)\n"
+              << "  --activity-threshold E  skip tiles whose neighbourhood changed by at most E in the last step,\n"
+              << "                      0 only skips exact fixed points, negative steps every tile (default 0)\n"
+              << "  --output PREFIX     write the final state to PREFIX_<step>.<format>\n"
+              << "  --output-every N    also write every N steps\n"
+              << "  --format FORMAT     ppm (colouring) or raw (the chemical planes as doubles) (default ppm)\n"
+              << "  --checkpoint PATH   save a checkpoint to PATH at the end of the run\n"
+              << "  --checkpoint-every N  also save one every N steps, written in the background\n"
+              << "  --restart PATH      carry on from a checkpoint up to --steps in total. The grid size, precision and\n"
+              << "                      model parameters come from the checkpoint unless given\n"
+              << "  --record PATH       record frames to PATH, compressed in the background\n"
+              << "  --record-every N    steps between recorded frames (default 10)\n"
+              << "  --record-content C  coloring (RGBA) or state (the chemical planes as stored) (default coloring)\n"
+              << "  --keyframe-interval N  frames between the keyframes a reader can seek to (default 32)\n"
+              << "  --integrator NAME   explicit, spectral to step diffusion exactly in Fourier space on a periodic\n"
+              << "                      grid whose sides are powers of two, which takes far longer steps, or adaptive to\n"
+              << "                      take Runge-Kutta steps as long as --tolerance allows. --steps and --output-every\n"
+              << "                      count the model's explicit steps for adaptive (default explicit)\n"
+              << "  --time-step DT      time each spectral step advances, in the model's own units (default the model's\n"
+              << "                      explicit step)\n"
+              << "  --tolerance E       largest error of any concentration in an adaptive step (default 0.001)\n"
+              << "  --ranks N           split the grid into N bands of rows, each stepped by its own process, exchanging\n"
+              << "                      edge rows through shared memory every step. --threads is per process, and 0\n"
+              << "                      shares the hardware threads out between them (default 1)\n"
+              << "  --depth N           cells deep, which makes the grid a volume with a fixed outer shell. --seed-size\n"
+              << "                      is then the side of a cube, and spots seeds balls (default 0, a flat grid)\n"
+              << "  --stencil N         7 or 27 point Laplacian for a volume (default 7)\n"
+              << "  --block-rows N      rows of the columns a volume is stepped in, 0 steps whole slabs (default 16)\n"
+              << "  --slice-axis A      x, y or z, the axis frames of a volume are sliced across (default z)\n"
+              << "  --slice N           where along the axis frames are sliced (default the middle)\n"
+              << "  --trace PATH        write the time spent in each phase of the run to PATH as Chrome trace events, and\n"
+              << "                      a summary of the phases at the end. Rank N of a split run writes PATH.N. Needs\n"
+              << "                      a build with REACTIONDIFFUSION_PROFILING\n"
+              << "  --check-every N     reduce the grid to its largest change and mean concentrations every N steps, fused\n"
+              << "                      into the step, and check whether it has reached a steady state\n"
+              << "  --steady-change E   steady once no concentration changes by more than E in a step, negative to not\n"
+              << "                      check (default 1e-6)\n"
+              << "  --steady-drift D    and no mean concentration moves by more than D between checks, negative to not\n"
+              << "                      check (default -1)\n"
+              << "  --steady-checks K   checks in a row the above must hold for (default 3)\n"
+              << "  --hash              also hash the grid at each check, a hash seen before is steady at once\n"
+              << "  --stop-when-steady  end the run as soon as it is steady\n"
+              << "  --statistics        print the statistics of every check\n"
+              << "  --warm-levels L     warm the seeded grid up on L successively coarser grids, each with half the cells\n"
+              << "                      along each side and diffusion scaled to match, before stepping it at full\n"
+              << "                      resolution. Their steps count towards --steps (default 0)\n"
+              << "  --warm-steps N      steps taken on each coarser grid (default 1000)\n"
+              << "  --random-seed N     seed of the random numbers placing spots and drawing noise, the same seed gives\n"
+              << "                      the same run on any number of threads (default a fresh seed, printed)\n"
+              << "  --noise A           add noise uniform in [-A, A) to every concentration every step (default 0)\n"
+              << "  --no-huge-pages     don't ask for transparent huge pages to back grids of 2MiB or more\n";
+}
+
+/// Whether the model is one of the Gray-Scott presets, which feed and kill apply to
+bool isGrayScott(const Options &options) {
+    return options.model == "coral" || options.model == "mitosis";
+}
+
+/// Parses the command line into options, returns false and prints why if it can't
+bool parseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            return false;
+        }
+        // Switches, which take no value
+        if(arg == "--hash" || arg == "--stop-when-steady" || arg == "--statistics") {
+            (arg == "--hash" ? options.hash : arg == "--stop-when-steady" ? options.stopWhenSteady : options.statistics) = true;
+            continue;
+        }
+        if(arg == "--no-huge-pages") {
+            options.hugePages = false;
+            continue;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+
+        std::istringstream value(argv[++i]);
+        if(arg == "--size") {
+            value >> options.layout.width;
+            options.layout.height = options.layout.width;
+        }
+        else if(arg == "--width") value >> options.layout.width;
+        else if(arg == "--height") value >> options.layout.height;
+        else if(arg == "--tile-size") value >> options.layout.tileSize;
+        else if(arg == "--temporal-blocking") value >> options.layout.haloWidth;
+        else if(arg == "--boundary") value >> options.boundary;
+        else if(arg == "--precision") value >> options.precision;
+        else if(arg == "--model") value >> options.model;
+        else if(arg == "--feed") value >> options.feed;
+        else if(arg == "--kill") value >> options.kill;
+        else if(arg == "--diffusion-a") value >> options.diffusionA;
+        else if(arg == "--diffusion-b") value >> options.diffusionB;
+        else if(arg == "--seed") value >> options.seed;
+        else if(arg == "--seed-size") value >> options.seedSize;
+        else if(arg == "--steps") value >> options.steps;
+        else if(arg == "--threads") value >> options.threads;
+        else if(arg == "--activity-threshold") value >> options.activityThreshold;
+        else if(arg == "--output") value >> options.output;
+        else if(arg == "--output-every") value >> options.outputEvery;
+        else if(arg == "--format") value >> options.format;
+        else if(arg == "--checkpoint") value >> options.checkpoint;
+        else if(arg == "--checkpoint-every") value >> options.checkpointEvery;
+        else if(arg == "--restart") value >> options.restart;
+        else if(arg == "--record") value >> options.record;
+        else if(arg == "--record-every") value >> options.recordEvery;
+        else if(arg == "--record-content") value >> options.recordContent;
+        else if(arg == "--keyframe-interval") value >> options.keyframeInterval;
+        else if(arg == "--integrator") value >> options.integrator;
+        else if(arg == "--time-step") value >> options.timeStep;
+        else if(arg == "--tolerance") value >> options.tolerance;
+        else if(arg == "--ranks") value >> options.ranks;
+        else if(arg == "--depth") value >> options.depth;
+        else if(arg == "--stencil") value >> options.stencil;
+        else if(arg == "--block-rows") value >> options.blockRows;
+        else if(arg == "--slice-axis") value >> options.sliceAxis;
+        else if(arg == "--slice") value >> options.slice;
+        else if(arg == "--trace") value >> options.trace;
+        else if(arg == "--check-every") value >> options.checkEvery;
+        else if(arg == "--warm-levels") value >> options.warmLevels;
+        else if(arg == "--warm-steps") value >> options.warmSteps;
+        else if(arg == "--random-seed") {
+            value >> options.randomSeed;
+            options.randomSeedGiven = true;
+        }
+        else if(arg == "--noise") value >> options.noise;
+        else if(arg == "--steady-change") value >> options.steady.maxChange;
+        else if(arg == "--steady-drift") value >> options.steady.maxMeanDrift;
+        else if(arg == "--steady-checks") value >> options.steady.checks;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+
+        if(value.fail()) {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return false;
+        }
+    }
+
+    if(options.layout.width < 3 || options.layout.height < 3) {
+        std::cerr << "The grid must be at least 3x3\n";
+        return false;
+    }
+    if(options.layout.tileSize == 0) {
+        std::cerr << "The tile size must be positive\n";
+        return false;
+    }
+    if(options.layout.haloWidth == 0) {
+        std::cerr << "Temporal blocking must be at least 1\n";
+        return false;
+    }
+    if(!options.boundary.empty()) {
+        auto named = std::find_if(std::begin(BOUNDARIES), std::end(BOUNDARIES), [&](const auto &boundary) {
+            return options.boundary == boundary.first;
+        });
+        if(named == std::end(BOUNDARIES)) {
+            std::cerr << "Unknown boundary " << options.boundary << "\n";
+            return false;
+        }
+        options.layout.boundary = named->second;
+    }
+    if(options.precision != "double" && options.precision != "float" && options.precision != "half" && options.precision != "fixed16") {
+        std::cerr << "Unknown precision " << options.precision << "\n";
+        return false;
+    }
+    if(options.seed != "square" && options.seed != "spots") {
+        std::cerr << "Unknown seed " << options.seed << "\n";
+        return false;
+    }
+    if(options.recordContent != "coloring" && options.recordContent != "state") {
+        std::cerr << "Unknown recording content " << options.recordContent << "\n";
+        return false;
+    }
+    if(options.recordEvery == 0) {
+        std::cerr << "Frames must be recorded at least every step\n";
+        return false;
+    }
+    if(options.format != "ppm" && options.format != "raw") {
+        std::cerr << "Unknown format " << options.format << "\n";
+        return false;
+    }
+    if(options.integrator != "explicit" && options.integrator != "spectral" && options.integrator != "adaptive") {
+        std::cerr << "Unknown integrator " << options.integrator << "\n";
+        return false;
+    }
+    if(options.integrator != "spectral" && options.timeStep >= 0) {
+        std::cerr << "Only the spectral integrator takes --time-step, the others step by the model's own time step\n";
+        return false;
+    }
+    if(options.integrator != "adaptive" && options.tolerance >= 0) {
+        std::cerr << "Only the adaptive integrator takes --tolerance\n";
+        return false;
+    }
+    if(options.integrator == "spectral" && !SpectralSolver<GrayScottReaction<double>>::supportsSize(options.layout.width, options.layout.height)) {
+        std::cerr << "The spectral integrator needs a grid whose sides are powers of two\n";
+        return false;
+    }
+    if(options.integrator == "spectral" && !options.boundary.empty() && options.layout.boundary != BoundaryCondition::Periodic) {
+        std::cerr << "The spectral integrator's grid is always periodic\n";
+        return false;
+    }
+    if(options.integrator == "adaptive" && options.layout.boundary != BoundaryCondition::FixedRing) {
+        std::cerr << "The adaptive integrator only holds the outer ring fixed\n";
+        return false;
+    }
+    if(options.integrator != "explicit") {
+        if(options.precision != "double" && options.precision != "float") {
+            std::cerr << "The " << options.integrator << " integrator needs double or float precision\n";
+            return false;
+        }
+        if(!options.checkpoint.empty() || !options.restart.empty() || !options.record.empty()) {
+            std::cerr << "The " << options.integrator << " integrator can't checkpoint, restart or record\n";
+            return false;
+        }
+        if(options.timeStep == 0 || options.tolerance == 0) {
+            std::cerr << "The " << (options.timeStep == 0 ? "time step" : "tolerance") << " must be positive\n";
+            return false;
+        }
+    }
+
+    if(options.depth != 0) {
+        if(options.depth < 3) {
+            std::cerr << "A volume must be at least 3 cells deep\n";
+            return false;
+        }
+        if(options.integrator != "explicit" || options.ranks != 1 || options.layout.boundary != BoundaryCondition::FixedRing
+           || options.layout.haloWidth != 1) {
+            std::cerr << "A volume is only stepped by the explicit integrator in one process, with a fixed outer shell and no\n"
+                      << "temporal blocking\n";
+            return false;
+        }
+        if(options.precision != "double" && options.precision != "float") {
+            std::cerr << "A volume needs double or float precision\n";
+            return false;
+        }
+        if(!options.checkpoint.empty() || !options.restart.empty() || !options.record.empty()) {
+            std::cerr << "A volume can't checkpoint, restart or record\n";
+            return false;
+        }
+        if(options.stencil != 0 && options.stencil != 7 && options.stencil != 27) {
+            std::cerr << "Unknown stencil " << options.stencil << ", a volume takes 7 or 27\n";
+            return false;
+        }
+        if(options.sliceAxis != "x" && options.sliceAxis != "y" && options.sliceAxis != "z") {
+            std::cerr << "Unknown slice axis " << options.sliceAxis << "\n";
+            return false;
+        }
+        const unsigned int extent = options.sliceAxis == "x" ? options.layout.width
+                                    : options.sliceAxis == "y" ? options.layout.height : options.depth;
+        if(options.slice >= static_cast<long long>(extent)) {
+            std::cerr << "The slice is beyond the volume, which is " << extent << " cells along " << options.sliceAxis << "\n";
+            return false;
+        }
+    } else if(options.stencil != 0) {
+        std::cerr << "Only a volume takes --stencil, a flat grid always uses the 9 point stencil\n";
+        return false;
+    }
+    if(!options.trace.empty() && !Profiler::isCompiledIn()) {
+        std::cerr << "--trace needs a build with the REACTIONDIFFUSION_PROFILING CMake option on\n";
+        return false;
+    }
+    if(options.checkEvery != 0 && (options.integrator != "explicit" || options.ranks != 1 || options.depth != 0)) {
+        std::cerr << "Only the explicit integrator on a flat grid in one process checks for a steady state\n";
+        return false;
+    }
+    if(options.checkEvery == 0 && (options.hash || options.stopWhenSteady || options.statistics)) {
+        std::cerr << "--hash, --stop-when-steady and --statistics need --check-every\n";
+        return false;
+    }
+    if(options.warmLevels != 0 && (options.integrator != "explicit" || options.ranks != 1 || options.depth != 0
+                                   || !options.restart.empty())) {
+        std::cerr << "Only a fresh run of the explicit integrator on a flat grid in one process can be warmed up\n";
+        return false;
+    }
+    if(options.noise != 0 && (options.integrator != "explicit" || options.ranks != 1 || options.depth != 0)) {
+        std::cerr << "Only the explicit integrator on a flat grid in one process adds noise\n";
+        return false;
+    }
+    if(options.ranks == 0) {
+        std::cerr << "There must be at least one rank\n";
+        return false;
+    }
+    if(options.ranks > 1) {
+        if(options.integrator != "explicit" || options.layout.boundary != BoundaryCondition::FixedRing || options.layout.haloWidth != 1) {
+            std::cerr << "Only the explicit integrator with fixed-ring boundaries and no temporal blocking can be split across ranks\n";
+            return false;
+        }
+        if(!options.checkpoint.empty() || !options.restart.empty() || !options.record.empty()) {
+            std::cerr << "A run split across ranks can't checkpoint, restart or record\n";
+            return false;
+        }
+        if(options.layout.height - 2 < options.ranks) {
+            std::cerr << "Every rank needs at least one row of the grid\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Settles which model a run uses once a restart has had the chance to take it from the checkpoint, coral unless
+ * given, returns false and prints why if it can't be used
+ */
+bool resolveModel(Options &options) {
+    if(options.model.empty()) {
+        options.model = "coral";
+    }
+    if(!isGrayScott(options) && options.model != "brusselator" && options.model != "fitzhugh-nagumo"
+       && options.model != "schnakenberg") {
+        std::cerr << "Unknown model " << options.model << "\n";
+        return false;
+    }
+    if(!isGrayScott(options) && options.precision == "fixed16") {
+        // Fixed16 stores [0, 1], which only Gray-Scott stays within
+        std::cerr << "The " << options.model << " model needs a floating point precision\n";
+        return false;
+    }
+    return true;
+}
+
+template <typename Scalar>
+std::unique_ptr<AbstractReactionModel<CHEMICALS, Scalar>> makeModel(const Options &options) {
+    // Given values first, then the checkpoint's, then the preset's
+    auto parameter = [&](double given, unsigned int index, Scalar preset) {
+        if(given >= 0) {
+            return static_cast<Scalar>(given);
+        }
+        return index < options.restoredParameters.size() ? static_cast<Scalar>(options.restoredParameters[index]) : preset;
+    };
+
+    if(options.model == "brusselator") {
+        BrusselatorReaction<Scalar> reaction;
+        return std::make_unique<BrusselatorModel<Scalar>>(parameter(-1, 0, reaction.a), parameter(-1, 1, reaction.b),
+                                                          parameter(options.diffusionA, 2, reaction.dU),
+                                                          parameter(options.diffusionB, 3, reaction.dV), parameter(-1, 4, reaction.dt));
+    }
+    if(options.model == "fitzhugh-nagumo") {
+        FitzHughNagumoReaction<Scalar> reaction;
+        return std::make_unique<FitzHughNagumoModel<Scalar>>(parameter(-1, 0, reaction.a0), parameter(-1, 1, reaction.a1),
+                                                             parameter(-1, 2, reaction.epsilon),
+                                                             parameter(options.diffusionA, 3, reaction.dU),
+                                                             parameter(options.diffusionB, 4, reaction.dV), parameter(-1, 5, reaction.dt));
+    }
+    if(options.model == "schnakenberg") {
+        SchnakenbergReaction<Scalar> reaction;
+        return std::make_unique<SchnakenbergModel<Scalar>>(parameter(-1, 0, reaction.a), parameter(-1, 1, reaction.b),
+                                                           parameter(options.diffusionA, 2, reaction.dU),
+                                                           parameter(options.diffusionB, 3, reaction.dV), parameter(-1, 4, reaction.dt));
+    }
+
+    using Model = BasicGrayScottModel<Scalar>;
+    std::unique_ptr<Model> preset(options.model == "mitosis" ? Model::mitosis() : Model::coral());
+
+    // Feed, kill, diffusion A and B, see GrayScottReaction::parameters
+    return std::make_unique<Model>(parameter(options.feed, 0, preset->getFeed()), parameter(options.kill, 1, preset->getKill()),
+                                   parameter(options.diffusionA, 2, preset->getDiffusionA()),
+                                   parameter(options.diffusionB, 3, preset->getDiffusionB()));
+}
+
+/// Writes the state of a ReactionDiffusion or one of the other integrators to PREFIX_<step>.<format>
+template <typename Model>
+bool writeFrame(Model &model, unsigned long long step, const Options &options) {
+    REACTIONDIFFUSION2_PROFILE_SCOPE("write frame");
+    std::string path = options.output + "_" + std::to_string(step) + "." + options.format;
+    std::ofstream file(path, std::ios::binary);
+    if(!file) {
+        std::cerr << "Could not open " << path << " for writing\n";
+        return false;
+    }
+
+    const auto &state = model.getState();
+    const unsigned int width = state.getWidth();
+    const unsigned int height = state.getHeight();
+
+    if(options.format == "ppm") {
+        // Composite over black, as the viewer does
+        const std::uint8_t *coloring = model.getColoring();
+        file << "P6\n" << width << " " << height << "\n255\n";
+        for(std::size_t cell = 0; cell < static_cast<std::size_t>(width) * height; ++cell) {
+            const std::uint8_t *pixel = coloring + cell * 4;
+            for(unsigned int channel = 0; channel < 3; ++channel) {
+                file.put(static_cast<char>((pixel[channel] * pixel[3]) / 255));
+            }
+        }
+    } else {
+        // Every plane in turn, row by row, widened to doubles whatever the precision
+        std::vector<typename Model::Scalar> row(width);
+        std::vector<double> wide(width);
+        for(unsigned int chem = 0; chem < CHEMICALS; ++chem) {
+            for(unsigned int y = 0; y < height; ++y) {
+                state.copyRow(chem, y, row.data());
+                std::copy(row.begin(), row.end(), wide.begin());
+                file.write(reinterpret_cast<const char *>(wide.data()), static_cast<std::streamsize>(width * sizeof(double)));
+            }
+        }
+    }
+
+    return static_cast<bool>(file);
+}
+
+/**
+ * Writes the Chrome trace of this process's run if one was asked for, and prints a summary of the time spent in each
+ * phase at rank 0
+ * @return false if the trace couldn't be written
+ */
+bool writeTrace(const Options &options, unsigned int rank = 0) {
+    if(options.trace.empty()) {
+        return true;
+    }
+
+    const Profiler &profiler = Profiler::instance();
+    if(rank == 0) {
+        std::cerr << std::left << std::setw(20) << "phase" << std::right << std::setw(10) << "calls" << std::setw(12) << "seconds"
+                  << std::setw(14) << "cells/s" << std::setw(10) << "GB/s" << "\n";
+        for(const ProfilePhase &phase : profiler.getPhases()) {
+            std::cerr << std::left << std::setw(20) << phase.name << std::right << std::setw(10) << phase.calls
+                      << std::setw(12) << std::setprecision(4) << phase.seconds;
+            if(phase.cells > 0) {
+                std::cerr << std::setw(14) << phase.cells / phase.seconds << std::setw(10) << phase.bytes / phase.seconds / 1e9;
+            }
+            std::cerr << "\n";
+        }
+        std::cerr << std::setprecision(6);
+    }
+    if(profiler.getDroppedEvents() != 0) {
+        std::cerr << "The trace is missing the last " << profiler.getDroppedEvents() << " events, which didn't fit in its buffers\n";
+    }
+
+    const std::string path = rank == 0 ? options.trace : options.trace + "." + std::to_string(rank);
+    const std::string error = profiler.writeChromeTrace(path, rank);
+    if(!error.empty()) {
+        std::cerr << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+/// Steps until the next multiple of every, or 0 if every is 0
+unsigned long long stepsUntil(unsigned long long stepCount, unsigned long long every) {
+    return every == 0 ? 0 : every - stepCount % every;
+}
+
+/// What runSteps does after the check that follows a batch of steps
+enum class StepOutcome {
+    Continue,
+    Stop,
+    Fail
+};
+
+/**
+ * The loop every runner shares. Steps up to --steps, cut short at every multiple of --output-every to write a frame
+ * and at every multiple of each interval to run the check, then writes a last frame unless the final step wrote one.
+ * @param stepCount returns the steps taken so far
+ * @param step takes the given number of steps, returning false if the run failed
+ * @param output writes the frame of the given step, returning false if it couldn't be written
+ * @param intervals further intervals to stop at, those of 0 are ignored
+ * @param check called after every batch of steps and its frame, returning whether to go on, stop early or fail
+ * @param elapsed set to the time spent in the loop, the last frame excluded
+ * @return false if a step, a frame or the check failed
+ */
+template <typename StepCount, typename Step, typename Output, typename Check>
+bool runSteps(const Options &options, StepCount &&stepCount, Step &&step, Output &&output,
+              std::initializer_list<unsigned long long> intervals, Check &&check, std::chrono::duration<double> &elapsed) {
+    const unsigned long long outputEvery = options.output.empty() ? 0 : options.outputEvery;
+
+    auto start = std::chrono::steady_clock::now();
+    while(stepCount() < options.steps) {
+        // Step up to the next frame or interval in one go so temporal blocking can span as many steps as possible
+        unsigned long long steps = std::min<unsigned long long>(options.steps - stepCount(), std::numeric_limits<unsigned int>::max());
+        if(outputEvery != 0) {
+            steps = std::min(steps, stepsUntil(stepCount(), outputEvery));
+        }
+        for(unsigned long long every : intervals) {
+            if(every != 0) {
+                steps = std::min(steps, stepsUntil(stepCount(), every));
+            }
+        }
+        if(!step(static_cast<unsigned int>(steps))) {
+            return false;
+        }
+
+        if(outputEvery != 0 && stepCount() % outputEvery == 0) {
+            if(!output(stepCount())) {
+                return false;
+            }
+        }
+        const StepOutcome outcome = check();
+        if(outcome == StepOutcome::Fail) {
+            return false;
+        }
+        if(outcome == StepOutcome::Stop) {
+            break;
+        }
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    // A run stopped early ends before --steps
+    if(!options.output.empty() && (outputEvery == 0 || stepCount() % outputEvery != 0)) {
+        return output(stepCount());
+    }
+    return true;
+}
+
+/// runSteps with no further intervals or check
+template <typename StepCount, typename Step, typename Output>
+bool runSteps(const Options &options, StepCount &&stepCount, Step &&step, Output &&output, std::chrono::duration<double> &elapsed) {
+    return runSteps(options, stepCount, step, output, {}, []() { return StepOutcome::Continue; }, elapsed);
+}
+
+template <typename Precision>
+std::unique_ptr<AbstractSeeder<CHEMICALS, Precision>> makeSeeder(const Options &options) {
+    if(options.seed == "spots") {
+        return std::make_unique<SpotSeeder<CHEMICALS, Precision>>(20, 4, 25, std::array<typename Precision::Scalar, CHEMICALS>{0, 1},
+                                                                  options.randomSeed);
+    }
+    return std::make_unique<SquareCenterSeed<CHEMICALS, Precision>>(options.seedSize, std::array<typename Precision::Scalar, CHEMICALS>{0, 1});
+}
+
+/// Calls function with the reaction of a model made by makeModel
+template <typename Scalar, typename Function>
+int withReaction(const AbstractReactionModel<CHEMICALS, Scalar> &model, Function &&function) {
+    if(auto grayScott = dynamic_cast<const StaticReactionModel<GrayScottReaction<Scalar>> *>(&model)) {
+        return function(grayScott->getReaction());
+    }
+    if(auto brusselator = dynamic_cast<const StaticReactionModel<BrusselatorReaction<Scalar>> *>(&model)) {
+        return function(brusselator->getReaction());
+    }
+    if(auto fitzHughNagumo = dynamic_cast<const StaticReactionModel<FitzHughNagumoReaction<Scalar>> *>(&model)) {
+        return function(fitzHughNagumo->getReaction());
+    }
+    if(auto schnakenberg = dynamic_cast<const StaticReactionModel<SchnakenbergReaction<Scalar>> *>(&model)) {
+        return function(schnakenberg->getReaction());
+    }
+    std::cerr << "The integrator doesn't support this model\n";
+    return 1;
+}
+
+/// Runs the reaction with a SpectralSolver, writing frames as run does
+template <typename Reaction>
+int runSpectral(const Options &options, const Reaction &reaction) {
+    using Scalar = typename Reaction::Scalar;
+    const Scalar timeStep = options.timeStep > 0 ? static_cast<Scalar>(options.timeStep) : reaction.timeStep();
+    SpectralSolver<Reaction> solver(options.layout.width, options.layout.height, ClassicStencil<Scalar>{-1, 0.2, 0.05}, reaction,
+                                    timeStep, makeSeeder<ScalarPrecision<Scalar>>(options), options.threads);
+
+    std::chrono::duration<double> elapsed;
+    auto stepCount = [&]() { return solver.getStepCount(); };
+    auto step = [&](unsigned int steps) {
+        solver.update(steps);
+        return true;
+    };
+    auto output = [&](unsigned long long at) { return writeFrame(solver, at, options); };
+    if(!runSteps(options, stepCount, step, output, elapsed)) {
+        return 1;
+    }
+
+    const unsigned long long stepsTaken = solver.getStepCount();
+    double cells = static_cast<double>(options.layout.width) * options.layout.height * static_cast<double>(stepsTaken);
+    std::cerr << stepsTaken << " spectral steps of " << timeStep << " (" << timeStep / reaction.timeStep() << " explicit steps) of "
+              << options.layout.width << "x" << options.layout.height << " on " << solver.getThreadCount() << " threads in "
+              << elapsed.count() << "s (" << stepsTaken / elapsed.count() << " steps/s, " << cells / elapsed.count() << " cells/s)\n";
+
+    return 0;
+}
+
+/// Runs the reaction with an AdaptiveSolver, writing frames as run does at multiples of the model's own time step
+template <typename Reaction>
+int runAdaptive(const Options &options, const Reaction &reaction) {
+    using Scalar = typename Reaction::Scalar;
+    const Scalar tolerance = options.tolerance > 0 ? static_cast<Scalar>(options.tolerance) : Scalar(1e-3);
+    AdaptiveSolver<Reaction> solver(options.layout.width, options.layout.height, ClassicStencil<Scalar>{-1, 0.2, 0.05}, reaction,
+                                    tolerance, makeSeeder<ScalarPrecision<Scalar>>(options), options.threads);
+
+    // Progress is counted in the model's explicit steps, so frames line up with the explicit integrator's
+    unsigned long long reached = 0;
+    std::chrono::duration<double> elapsed;
+    auto stepCount = [&]() { return reached; };
+    auto step = [&](unsigned int steps) {
+        if(!solver.advance(static_cast<Scalar>(steps) * reaction.timeStep())) {
+            std::cerr << "The adaptive integrator couldn't meet the tolerance after " << solver.getTime() / reaction.timeStep()
+                      << " steps, the simulation blew up\n";
+            return false;
+        }
+        reached += steps;
+        return true;
+    };
+    auto output = [&](unsigned long long at) { return writeFrame(solver, at, options); };
+    if(!runSteps(options, stepCount, step, output, elapsed)) {
+        return 1;
+    }
+
+    const unsigned long long stepsTaken = solver.getStepCount();
+    double cells = static_cast<double>(options.layout.width) * options.layout.height * static_cast<double>(stepsTaken);
+    std::cerr << stepsTaken << " adaptive steps (" << solver.getRejectedCount() << " retried) covering " << reached
+              << " explicit steps of " << options.layout.width << "x" << options.layout.height << " on " << solver.getThreadCount()
+              << " threads in " << elapsed.count() << "s (" << stepsTaken / elapsed.count() << " steps/s, "
+              << cells / elapsed.count() << " cells/s)\n";
+
+    return 0;
+}
+
+/// A grid held only for writeFrame to write: the whole grid gathered from every rank, or a slice through a volume
+template <typename Precision>
+struct FrameGrid {
+    using Scalar = typename Precision::Scalar;
+
+    ReactionState<CHEMICALS, Precision> state;
+
+    const ReactionState<CHEMICALS, Precision> &getState() const {
+        return state;
+    }
+
+    std::uint8_t *getColoring() {
+        return state.getColoring();
+    }
+};
+
+/// Runs this process's rank of a DistributedSimulation, writing frames from rank 0 as run does
+template <typename Precision>
+int runRank(const Options &options, AbstractHaloTransport &transport) {
+    using Scalar = typename Precision::Scalar;
+    const bool first = transport.getRank() == 0;
+    const unsigned int threads = options.threads != 0 ? options.threads
+                                                      : std::max(1u, std::thread::hardware_concurrency() / options.ranks);
+    auto model = makeModel<Scalar>(options);
+
+    // Only rank 0 holds the whole grid, to seed the others and collect frames
+    FrameGrid<Precision> whole;
+    if(first) {
+        whole.state = ReactionState<CHEMICALS, Precision>(options.layout, model->getBackground());
+        makeSeeder<Precision>(options)->seed(whole.state);
+    }
+
+    auto convolution = std::unique_ptr<AbstractConvolution<CHEMICALS, Precision>>(new ClassicConvolution<CHEMICALS, Precision>(-1, 0.2, 0.05));
+    DistributedSimulation<CHEMICALS, Precision> simulation(options.layout, transport, std::move(convolution), std::move(model), threads);
+    simulation.getModel().setActivityThreshold(static_cast<Scalar>(options.activityThreshold));
+    simulation.scatter(first ? &whole.state : nullptr);
+
+    std::chrono::duration<double> elapsed;
+    auto stepCount = [&]() { return simulation.getStepCount(); };
+    auto step = [&](unsigned int steps) {
+        simulation.update(steps);
+        return true;
+    };
+    auto output = [&](unsigned long long at) {
+        simulation.gather(first ? &whole.state : nullptr);
+        return !first || writeFrame(whole, at, options);
+    };
+    auto check = [&]() {
+        // Every rank has finished before the clock stops
+        if(simulation.getStepCount() == options.steps) {
+            transport.barrier();
+        }
+        return StepOutcome::Continue;
+    };
+    transport.barrier();
+    if(!runSteps(options, stepCount, step, output, {}, check, elapsed)) {
+        return 1;
+    }
+
+    if(first) {
+        double cells = static_cast<double>(options.layout.width) * options.layout.height * static_cast<double>(options.steps);
+        std::cerr << options.steps << " steps of " << options.layout.width << "x" << options.layout.height << " on "
+                  << options.ranks << " ranks of " << simulation.getModel().getThreadCount() << " threads in "
+                  << elapsed.count() << "s (" << options.steps / elapsed.count() << " steps/s, " << cells / elapsed.count()
+                  << " cells/s)\n";
+    }
+    return writeTrace(options, transport.getRank()) ? 0 : 1;
+}
+
+/// Runs the reaction with a VolumeSolver, writing a slice through the volume as run writes the grid
+template <typename Reaction>
+int runVolume(const Options &options, const Reaction &reaction) {
+    using Scalar = typename Reaction::Scalar;
+    const VolumeLayout layout{options.layout.width, options.layout.height, options.depth};
+    const std::array<Scalar, CHEMICALS> setTo{0, 1};
+    std::unique_ptr<AbstractVolumeSeeder<CHEMICALS, Scalar>> seeder;
+    if(options.seed == "spots") {
+        seeder = std::make_unique<BallSeeder<CHEMICALS, Scalar>>(20, 4, 25, setTo, options.randomSeed);
+    } else {
+        seeder = std::make_unique<CubeCenterSeed<CHEMICALS, Scalar>>(options.seedSize, setTo);
+    }
+    VolumeSolver<Reaction> solver(layout, options.stencil == 27 ? VolumeStencil<Scalar>::twentySevenPoint() : VolumeStencil<Scalar>::sevenPoint(),
+                                  reaction, std::move(seeder), options.blockRows, options.threads);
+
+    const VolumeAxis axis = options.sliceAxis == "x" ? VolumeAxis::X : options.sliceAxis == "y" ? VolumeAxis::Y : VolumeAxis::Z;
+    const unsigned int extent = axis == VolumeAxis::X ? layout.width : axis == VolumeAxis::Y ? layout.height : layout.depth;
+    const unsigned int index = options.slice >= 0 ? static_cast<unsigned int>(options.slice) : extent / 2;
+    FrameGrid<ScalarPrecision<Scalar>> slice{ReactionState<CHEMICALS, ScalarPrecision<Scalar>>(solver.getState().sliceLayout(axis))};
+    std::chrono::duration<double> elapsed;
+    auto stepCount = [&]() { return solver.getStepCount(); };
+    auto step = [&](unsigned int steps) {
+        solver.update(steps);
+        return true;
+    };
+    auto output = [&](unsigned long long at) {
+        solver.getState().copySlice(axis, index, slice.state);
+        return writeFrame(slice, at, options);
+    };
+    if(!runSteps(options, stepCount, step, output, elapsed)) {
+        return 1;
+    }
+
+    const unsigned long long stepsTaken = solver.getStepCount();
+    double cells = static_cast<double>(layout.width) * layout.height * layout.depth * static_cast<double>(stepsTaken);
+    std::cerr << stepsTaken << " steps of " << layout.width << "x" << layout.height << "x" << layout.depth << " with the "
+              << (options.stencil == 27 ? 27 : 7) << " point stencil on " << solver.getThreadCount() << " threads in "
+              << elapsed.count() << "s (" << stepsTaken / elapsed.count() << " steps/s, " << cells / elapsed.count() << " cells/s)\n";
+
+    return 0;
+}
+
+/// Forks a process for every rank after the first, which this one runs, and waits for them all
+template <typename Precision>
+int runDistributed(const Options &options) {
+#if REACTIONDIFFUSION2_SHARED_MEMORY
+    const std::string name = "/reaction-diffusion-" + std::to_string(getpid());
+    SharedMemoryTransport transport;
+    std::string error = transport.create(name, options.ranks, DistributedSimulation<CHEMICALS, Precision>::messageSize(options.layout.width));
+    if(!error.empty()) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    std::vector<pid_t> children;
+    for(unsigned int rank = 1; rank < options.ranks; ++rank) {
+        const pid_t child = fork();
+        if(child == 0) {
+            SharedMemoryTransport joined;
+            error = joined.attach(name, rank);
+            if(!error.empty()) {
+                std::cerr << error << "\n";
+                std::_Exit(1);
+            }
+            std::_Exit(runRank<Precision>(options, joined));
+        }
+        if(child < 0) {
+            std::cerr << "Could not start rank " << rank << ": " << std::strerror(errno) << "\n";
+            for(pid_t started : children) {
+                kill(started, SIGTERM);
+                waitpid(started, nullptr, 0);
+            }
+            return 1;
+        }
+        children.push_back(child);
+    }
+
+    int result = runRank<Precision>(options, transport);
+    for(pid_t child : children) {
+        // The others would wait forever on a rank that has given up
+        if(result != 0) {
+            kill(child, SIGTERM);
+        }
+        int status = 0;
+        if(waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            result = 1;
+        }
+    }
+    return result;
+#else
+    std::cerr << "Splitting a run across ranks needs POSIX shared memory\n";
+    return 1;
+#endif
+}
+
+/// Prints the statistics of a check on one line
+template <unsigned int ChemicalCount>
+void printStatistics(const GridStatistics<ChemicalCount> &statistics) {
+    std::cerr << "step " << statistics.step << ": largest change " << statistics.maxChange << ", means";
+    for(double mean : statistics.mean) {
+        std::cerr << " " << std::setprecision(10) << mean << std::setprecision(6);
+    }
+    if(statistics.hashed) {
+        std::cerr << ", hash " << std::hex << std::setw(16) << std::setfill('0') << statistics.hash << std::dec << std::setfill(' ');
+    }
+    std::cerr << "\n";
+}
+
+template <typename Precision>
+int run(const Options &options, const Checkpoint &restart) {
+    using Scalar = typename Precision::Scalar;
+    if(options.ranks > 1) {
+        return runDistributed<Precision>(options);
+    }
+    if(options.integrator != "explicit" || options.depth != 0) {
+        if constexpr(std::is_same<Precision, ScalarPrecision<Scalar>>::value) {
+            return withReaction(*makeModel<Scalar>(options), [&](const auto &reaction) {
+                if(options.depth != 0) {
+                    return runVolume(options, reaction);
+                }
+                return options.integrator == "spectral" ? runSpectral(options, reaction) : runAdaptive(options, reaction);
+            });
+        }
+    }
+
+    const ClassicStencil<Scalar> stencil{-1, 0.2, 0.05};
+    auto convolution = std::unique_ptr<AbstractConvolution<CHEMICALS, Precision>>(
+            new ClassicConvolution<CHEMICALS, Precision>(stencil.center, stencil.edge, stencil.corner));
+    ReactionDiffusion<CHEMICALS, Precision> model(options.layout, std::move(convolution), makeSeeder<Precision>(options),
+                                                  makeModel<Scalar>(options), options.threads);
+    model.setActivityThreshold(static_cast<Scalar>(options.activityThreshold));
+    model.setReductionInterval(static_cast<unsigned int>(std::min<unsigned long long>(options.checkEvery, std::numeric_limits<unsigned int>::max())),
+                               options.hash);
+    SteadyStateDetector<CHEMICALS> detector(options.steady);
+    if(options.noise != 0) {
+        model.setNoise({options.noise, options.noise}, options.randomSeed);
+    }
+
+    if(restart.isOpen()) {
+        std::string error = restart.restore(model);
+        if(!error.empty()) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+    if(options.warmLevels != 0) {
+        auto warmStart = std::chrono::steady_clock::now();
+        MultiresolutionWarmStart<CHEMICALS, Precision> warm(stencil, [&]() { return makeModel<Scalar>(options); }, options.warmLevels,
+                                                            options.warmSteps);
+        const unsigned int levels = warm.warm(model);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - warmStart;
+        std::cerr << "Warmed up for " << model.getStepCount() << " steps on " << levels << " coarser levels in " << elapsed.count() << "s\n";
+    }
+    const unsigned long long firstStep = model.getStepCount();
+    const unsigned long long checkpointEvery = options.checkpoint.empty() ? 0 : options.checkpointEvery;
+    const unsigned long long recordEvery = options.record.empty() ? 0 : options.recordEvery;
+    CheckpointWriter checkpoints;
+
+    FrameRecorder recorder(options.keyframeInterval);
+    if(!options.record.empty()) {
+        std::string error = recorder.open(options.record, model, options.recordContent == "state" ? RecordingContent::State : RecordingContent::Coloring);
+        if(!error.empty()) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        recorder.record(model);
+    }
+
+    std::chrono::duration<double> elapsed;
+    auto stepCount = [&]() { return model.getStepCount(); };
+    auto step = [&](unsigned int steps) {
+        model.update(steps);
+        return true;
+    };
+    auto output = [&](unsigned long long at) { return writeFrame(model, at, options); };
+    auto check = [&]() {
+        if(recordEvery != 0 && model.getStepCount() % recordEvery == 0) {
+            recorder.record(model);
+        }
+        if(checkpointEvery != 0 && model.getStepCount() % checkpointEvery == 0 && model.getStepCount() < options.steps) {
+            // Skipped if the last one is still being written, the next will catch up
+            checkpoints.save(model, options.checkpoint);
+        }
+        if(options.checkEvery != 0 && model.getStepCount() % options.checkEvery == 0) {
+            const GridStatistics<CHEMICALS> &statistics = model.getStatistics();
+            if(options.statistics) {
+                printStatistics(statistics);
+            }
+            if(!detector.isSteady() && detector.add(statistics)) {
+                std::cerr << "Steady at step " << model.getStepCount() << ": " << detector.getReason() << "\n";
+                if(options.stopWhenSteady) {
+                    return StepOutcome::Stop;
+                }
+            }
+        }
+        return StepOutcome::Continue;
+    };
+    if(!runSteps(options, stepCount, step, output, {checkpointEvery, recordEvery, options.checkEvery}, check, elapsed)) {
+        return 1;
+    }
+
+    std::string recordingError = recorder.close();
+    if(!recordingError.empty()) {
+        std::cerr << recordingError << "\n";
+        return 1;
+    }
+    if(recorder.getDroppedFrames() != 0) {
+        std::cerr << "Dropped " << recorder.getDroppedFrames() << " of " << recorder.getDroppedFrames() + recorder.getRecordedFrames()
+                  << " frames, the recorder couldn't keep up\n";
+    }
+
+    std::string checkpointError = checkpoints.wait();
+    if(checkpointError.empty() && !options.checkpoint.empty()) {
+        checkpointError = saveCheckpoint(model, options.checkpoint);
+    }
+    if(!checkpointError.empty()) {
+        std::cerr << checkpointError << "\n";
+        return 1;
+    }
+
+    if(options.checkEvery != 0 && !detector.isSteady()) {
+        std::cerr << "Not steady after " << model.getStepCount() << " steps\n";
+    }
+
+    const unsigned long long stepsTaken = model.getStepCount() - firstStep;
+    double cells = static_cast<double>(options.layout.width) * options.layout.height * static_cast<double>(stepsTaken);
+    std::cerr << stepsTaken << " steps of " << options.layout.width << "x" << options.layout.height << " on " << model.getThreadCount()
+              << " threads in " << elapsed.count() << "s (" << stepsTaken / elapsed.count() << " steps/s, "
+              << cells / elapsed.count() << " cells/s)\n";
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    REACTIONDIFFUSION2_PROFILE_THREAD("main");
+    Profiler::instance().setTracing(!options.trace.empty());
+    GridArena::shared().setHugePages(options.hugePages);
+
+    // Printed so a run that turns out interesting can be repeated
+    if(!options.randomSeedGiven && (options.seed == "spots" || options.noise != 0)) {
+        options.randomSeed = randomSeed();
+        std::cerr << "Random seed " << options.randomSeed << "\n";
+    }
+
+    // A restart takes the grid it needs from the checkpoint
+    Checkpoint restart;
+    if(!options.restart.empty()) {
+        std::string error = restart.open(options.restart);
+        if(!error.empty()) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+
+        const CheckpointHeader &header = restart.getHeader();
+        const char *precision = checkpointPrecisionName(static_cast<CheckpointType>(header.scalarType),
+                                                        static_cast<CheckpointType>(header.storageType));
+        if(header.chemicalCount != CHEMICALS || !precision) {
+            std::cerr << options.restart << " is not a checkpoint of a Gray-Scott simulation\n";
+            return 1;
+        }
+        if(header.width < 3 || header.height < 3) {
+            std::cerr << options.restart << " has a corrupt header, its grid is smaller than 3x3\n";
+            return 1;
+        }
+        options.layout.width = header.width;
+        options.layout.height = header.height;
+        options.precision = precision;
+        if(options.boundary.empty()) {
+            options.layout.boundary = static_cast<BoundaryCondition>(header.boundary);
+        }
+
+        // Checkpoints from before the model was recorded are taken to be of whichever model is given
+        const std::string model = header.modelName();
+        if(options.model.empty() && !model.empty()) {
+            // Every Gray-Scott parameter is restored, so which preset doesn't matter
+            options.model = model == GrayScottReaction<double>::Name ? "coral" : model;
+        }
+        const std::string given = isGrayScott(options) ? GrayScottReaction<double>::Name : options.model;
+        if(!model.empty() && model != given) {
+            std::cerr << options.restart << " is a checkpoint of the " << model << " model, not " << given << "\n";
+            return 1;
+        }
+        options.restoredParameters.assign(header.parameters, header.parameters + header.parameterCount);
+    }
+    if(!resolveModel(options)) {
+        return 1;
+    }
+
+    int result;
+    if(options.precision == "float") {
+        result = run<SinglePrecision>(options, restart);
+    } else if(options.precision == "half") {
+        result = run<HalfPrecision>(options, restart);
+    } else if(options.precision == "fixed16") {
+        result = run<Fixed16Precision>(options, restart);
+    } else {
+        result = run<DoublePrecision>(options, restart);
+    }
+
+    // Each rank of a split run writes its own trace
+    if(result == 0 && options.ranks == 1 && !writeTrace(options)) {
+        return 1;
+    }
+    return result;
+}
@@ -1,29 +1,73 @@
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Window/Event.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/Graphics/Font.hpp>
 
 #include "ReactionDiffusion.hpp"
+#include "ReactionRenderer.hpp"
+#include "ProfilerHud.hpp"
+#include "SimulationThread.hpp"
 #include "Convolution.hpp"
 #include "ReactionModel.hpp"
 
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <sstream>
 
 constexpr unsigned int WINDOW_SIZE = 300;
 constexpr unsigned int CHEMICALS = 2;
 
+/// Loads the font for the overlay from $REACTIONDIFFUSION_FONT or wherever a common one is usually installed
+bool loadHudFont(sf::Font &font) {
+    const char *fromEnvironment = std::getenv("REACTIONDIFFUSION_FONT");
+    if(fromEnvironment && font.loadFromFile(fromEnvironment)) {
+        return true;
+    }
+    for(const char *path : {"/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf", "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+                            "/usr/share/fonts/dejavu/DejaVuSansMono.ttf", "/System/Library/Fonts/Menlo.ttc",
+                            "C:/Windows/Fonts/consola.ttf"}) {
+        if(font.loadFromFile(path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int main() {
+    REACTIONDIFFUSION2_PROFILE_THREAD("render");
 
     sf::RenderWindow window(sf::VideoMode(WINDOW_SIZE, WINDOW_SIZE, 32), "Gray-Scott Reaction Diffusion");
+    window.setVerticalSyncEnabled(true);
     // Create a new model that fits to the window size with a half cell gap around the edges
-    auto convolution = std::unique_ptr<AbstractConvolution<WINDOW_SIZE, CHEMICALS>>(new ClassicConvolution<WINDOW_SIZE, CHEMICALS>(-1, 0.2, 0.05));
-    auto seeder = std::unique_ptr<AbstractSeeder<WINDOW_SIZE, CHEMICALS>>(new SquareCenterSeed<WINDOW_SIZE, CHEMICALS>(40, {0, 1}));
-    //auto seeder = std::unique_ptr<AbstractSeeder<WINDOW_SIZE, CHEMICALS>>(new SpotSeeder<WINDOW_SIZE, CHEMICALS>(20, 4, 25, {0, 1}));
+    auto convolution = std::unique_ptr<AbstractConvolution<CHEMICALS>>(new ClassicConvolution<CHEMICALS>(-1, 0.2, 0.05));
+    auto seeder = std::unique_ptr<AbstractSeeder<CHEMICALS>>(new SquareCenterSeed<CHEMICALS>(40, {0, 1}));
+    //auto seeder = std::unique_ptr<AbstractSeeder<CHEMICALS>>(new SpotSeeder<CHEMICALS>(20, 4, 25, {0, 1}));
     auto reactionModel = std::unique_ptr<AbstractReactionModel<CHEMICALS>>(GrayScottModel::coral());
 
-    ReactionDiffusion<WINDOW_SIZE, CHEMICALS> model(std::move(convolution), std::move(seeder), std::move(reactionModel));
+    GridLayout layout;
+    layout.width = WINDOW_SIZE;
+    layout.height = WINDOW_SIZE;
+
+    ReactionDiffusion<CHEMICALS> model(layout, std::move(convolution), std::move(seeder), std::move(reactionModel));
+
+    // Step on a thread of its own from here on, starting paused
+    SimulationSettings settings;
+    settings.paused = true;
+    SimulationThread<CHEMICALS> simulation(model, settings);
+    ReactionRenderer<CHEMICALS> renderer(simulation, layout.width, layout.height);
+
+    // The overlay needs a font, without one the title bar still has the statistics
+    sf::Font font;
+    std::unique_ptr<ProfilerHud> hud;
+    if(loadHudFont(font)) {
+        hud = std::make_unique<ProfilerHud>(font);
+    } else {
+        std::cerr << "No font found for the overlay, set REACTIONDIFFUSION_FONT to a TrueType font to show it\n";
+    }
 
     // Run the main application loop
-    sf::Clock clock;
-    bool paused = true;
+    sf::Clock titleClock;
     while(window.isOpen()) {
         sf::Event event;
         while(window.pollEvent(event)) {
@@ -36,24 +80,45 @@ int main() {
                 if(event.key.code == sf::Keyboard::Escape) {
                     window.close();
                     return 0;
-                } else if(event.key.code == sf::Keyboard::Space) {
-                    paused = !paused;
+                }
+                // H shows and hides the overlay
+                if(event.key.code == sf::Keyboard::H && hud) {
+                    hud->toggle();
                 }
             }
 
-            model.onEvent(event);
+            // Space pauses, S steps once, T toggles the throttle and +/- change the steps per frame
+            renderer.onEvent(event);
         }
 
-        // Update the model
-        if(!paused) {
-            for(int i = 0; i < 2; ++i) {
-                model.update(clock.restart());
-            }
+        // Pick up the latest snapshot from the simulation
+        renderer.refresh();
+
+        // Show the live statistics in the title bar
+        if(titleClock.getElapsedTime().asSeconds() >= 0.5f) {
+            const SimulationStats &stats = renderer.getStats();
+            std::ostringstream title;
+            title << "Gray-Scott Reaction Diffusion - step " << stats.stepCount << ", " << static_cast<unsigned long long>(stats.stepsPerSecond)
+                  << " steps/s, " << stats.settings.stepsPerFrame << " steps/frame" << (stats.settings.throttle ? "" : " (free)")
+                  << (stats.settings.paused ? " [paused]" : "");
+            window.setTitle(title.str());
+            titleClock.restart();
         }
 
         // Draw the result
-        window.clear(sf::Color::Black);
-        window.draw(model);
-        window.display();
+        {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("draw");
+            window.clear(sf::Color::Black);
+            window.draw(renderer);
+            if(hud) {
+                hud->update(renderer.getStats());
+                window.draw(*hud);
+            }
+        }
+        // Waits for the vertical sync, so it is timed apart from drawing
+        {
+            REACTIONDIFFUSION2_PROFILE_SCOPE("display");
+            window.display();
+        }
     }
 }
\ No newline at end of file
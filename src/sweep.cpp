@@ -0,0 +1,205 @@
+/**
+ * Maps Gray-Scott pattern regimes: steps a grid of (feed, kill) pairs together as one ParameterSweep and writes a
+ * summary of where each one ended up as CSV.
+ */
+#include "ParameterSweep.hpp"
+#include "Seeders.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// count values evenly spaced over [min, max]
+struct SweepRange {
+    double min, max;
+    unsigned int count;
+
+    double at(unsigned int index) const {
+        return count < 2 ? min : min + (max - min) * index / (count - 1);
+    }
+};
+
+struct Options {
+    unsigned int width = 64, height = 64;
+    SweepRange feed{0.01, 0.1, 16};
+    SweepRange kill{0.045, 0.07, 16};
+    double diffusionA = 1.0, diffusionB = 0.5;
+    std::string precision = "double";
+    std::string seed = "square";
+    unsigned int seedSize = 16;
+    unsigned int steps = 5000;
+    unsigned int threads = 0;
+    std::string output;
+    std::uint64_t randomSeed = 0;
+    bool randomSeedGiven = false;
+};
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --size N            cells along each side of every instance's grid (default 64)\n"
+              << "  --width N           cells across every instance's grid\n"
+              << "  --height N          cells down every instance's grid\n"
+              << "  --feed MIN:MAX:N    N feed rates from MIN to MAX (default 0.01:0.1:16)\n"
+              << "  --kill MIN:MAX:N    N kill rates from MIN to MAX, one instance per feed and kill pair\n"
+              << "                      (default 0.045:0.07:16)\n"
+              << "  --diffusion-a D     diffusion rate of chemical A (default 1)\n"
+              << "  --diffusion-b D     diffusion rate of chemical B (default 0.5)\n"
+              << "  --precision NAME    double or float (default double)\n"
+              << "  --seed NAME         square or spots, the same for every instance (default square)\n"
+              << "  --seed-size N       size of the seeded square (default 16)\n"
+              << "  --steps N           number of steps to run (default 5000)\n"
+              << "  --threads N         worker threads, 0 for one per hardware thread (default 0)\n"
+              << "  --output PATH       write the summaries to PATH rather than standard output\n"
+              << "  --random-seed N     seed of the random numbers placing spots, the same seed gives the same sweep\n"
+              << "                      (default a fresh seed, printed)\n";
+}
+
+std::istream &operator>>(std::istream &stream, SweepRange &range) {
+    char separator = 0, second = 0;
+    stream >> range.min >> separator >> range.max >> second >> range.count;
+    if(separator != ':' || second != ':') {
+        stream.setstate(std::ios::failbit);
+    }
+    return stream;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+
+        std::istringstream value(argv[++i]);
+        if(arg == "--size") {
+            value >> options.width;
+            options.height = options.width;
+        }
+        else if(arg == "--width") value >> options.width;
+        else if(arg == "--height") value >> options.height;
+        else if(arg == "--feed") value >> options.feed;
+        else if(arg == "--kill") value >> options.kill;
+        else if(arg == "--diffusion-a") value >> options.diffusionA;
+        else if(arg == "--diffusion-b") value >> options.diffusionB;
+        else if(arg == "--precision") value >> options.precision;
+        else if(arg == "--seed") value >> options.seed;
+        else if(arg == "--seed-size") value >> options.seedSize;
+        else if(arg == "--steps") value >> options.steps;
+        else if(arg == "--threads") value >> options.threads;
+        else if(arg == "--output") value >> options.output;
+        else if(arg == "--random-seed") {
+            value >> options.randomSeed;
+            options.randomSeedGiven = true;
+        }
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+
+        if(value.fail()) {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return false;
+        }
+    }
+
+    if(options.width < 3 || options.height < 3) {
+        std::cerr << "The grid must be at least 3x3\n";
+        return false;
+    }
+    if(options.feed.count == 0 || options.kill.count == 0) {
+        std::cerr << "The sweep needs at least one feed and one kill rate\n";
+        return false;
+    }
+    if(options.precision != "double" && options.precision != "float") {
+        std::cerr << "Unknown precision " << options.precision << "\n";
+        return false;
+    }
+    if(options.seed != "square" && options.seed != "spots") {
+        std::cerr << "Unknown seed " << options.seed << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+template <typename Scalar>
+int run(const Options &options) {
+    std::vector<GrayScottReaction<Scalar>> instances;
+    for(unsigned int k = 0; k < options.kill.count; ++k) {
+        for(unsigned int f = 0; f < options.feed.count; ++f) {
+            instances.push_back({static_cast<Scalar>(options.feed.at(f)), static_cast<Scalar>(options.kill.at(k)),
+                                 static_cast<Scalar>(options.diffusionA), static_cast<Scalar>(options.diffusionB)});
+        }
+    }
+
+    using Precision = typename ParameterSweep<Scalar>::Precision;
+    std::unique_ptr<AbstractSeeder<2, Precision>> seeder;
+    if(options.seed == "spots") {
+        seeder.reset(new SpotSeeder<2, Precision>(20, 4, 25, {0, 1}, options.randomSeed));
+    } else {
+        seeder.reset(new SquareCenterSeed<2, Precision>(options.seedSize, {0, 1}));
+    }
+
+    ParameterSweep<Scalar> sweep(options.width, options.height, instances, ClassicStencil<Scalar>{-1, 0.2, 0.05},
+                                 std::move(seeder), options.threads);
+
+    auto start = std::chrono::steady_clock::now();
+    sweep.update(options.steps);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const double cells = static_cast<double>(options.width - 2) * (options.height - 2) * instances.size() * options.steps;
+    std::cerr << instances.size() << " instances of " << options.width << "x" << options.height << " for "
+              << options.steps << " steps on " << sweep.getThreadCount() << " threads in " << elapsed.count()
+              << "s (" << cells / elapsed.count() << " cells/s)\n";
+
+    std::ofstream file;
+    if(!options.output.empty()) {
+        file.open(options.output);
+        if(!file) {
+            std::cerr << "Could not open " << options.output << " for writing\n";
+            return 1;
+        }
+    }
+    std::ostream &out = options.output.empty() ? std::cout : file;
+
+    out << "feed,kill,diffusion_a,diffusion_b,mean_a,mean_b,min_b,max_b,deviation_b,change\n" << std::setprecision(9);
+    for(const SweepSummary &summary : sweep.summarize()) {
+        out << summary.feed << "," << summary.kill << "," << summary.diffusionA << "," << summary.diffusionB << ","
+            << summary.meanA << "," << summary.meanB << "," << summary.minB << "," << summary.maxB << ","
+            << summary.deviationB << "," << summary.change << "\n";
+    }
+
+    if(!out) {
+        std::cerr << "Could not write the summaries\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Printed so a sweep seeded with spots can be run again
+    if(!options.randomSeedGiven && options.seed == "spots") {
+        options.randomSeed = randomSeed();
+        std::cerr << "Random seed " << options.randomSeed << "\n";
+    }
+
+    if(options.precision == "float") {
+        return run<float>(options);
+    }
+    return run<double>(options);
+}